@@ -1,3 +1,3 @@
 #!/bin/bash
 
-gcc -ggdb -Wall -Wextra slim_json.c tests.c -o tests
+gcc -ggdb -Wall -Wextra -pthread slim_json.c tests.c -o tests
@@ -25,12 +25,33 @@
 */
 #include "slim_json.h"
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <time.h>
+#include <float.h>
 
 #if defined(_MSC_VER)
 #include <BaseTsd.h>
+#include <intrin.h>
 typedef SSIZE_T ssize_t;
 #endif
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#else
+#include <io.h>
+#include <windows.h>
+#endif
+
 static size_t json_string_length(const char* _str) {
   size_t l = 0;
   while (*_str++ != '\0') {
@@ -55,33 +76,331 @@ static void json_string_cat(char* _dest, size_t _len, const char* _src) {
   _dest[_len] = '\0';
 }
 
-// skip_escaped: Skip if the character has a \ before it
-static ssize_t json_string_indexOf(char _c, const char* _str, size_t _len, unsigned char _skip_escaped) {
+/**********
+ ** SWAR **
+ **********/
+
+// Eight bytes per step. Padded input has JSON_PADDING readable bytes after
+// the end, so the word loops don't need a bounds check per byte.
+#define JSON_SWAR_ONES 0x0101010101010101ULL
+#define JSON_SWAR_LOW  0x7F7F7F7F7F7F7F7FULL
+
+static uint64_t json_swar_load(const char* _p) {
+  uint64_t w;
+  memcpy(&w, _p, sizeof(w));
+  return w;
+}
+
+// 0x80 in every byte of _w equal to _c, 0 elsewhere
+static uint64_t json_swar_eq(uint64_t _w, unsigned char _c) {
+  uint64_t x = _w ^ (JSON_SWAR_ONES * _c);
+  return ~(((x & JSON_SWAR_LOW) + JSON_SWAR_LOW) | x | JSON_SWAR_LOW);
+}
+
+// Index of the first byte flagged in a json_swar_eq mask
+static size_t json_swar_first(uint64_t _mask) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return __builtin_clzll(_mask) >> 3;
+#elif defined(__GNUC__)
+  return __builtin_ctzll(_mask) >> 3;
+#else
+  size_t i = 0;
+  while ((_mask & 0x80) == 0) {
+    _mask >>= 8;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static size_t json_swar_limit(size_t _len, unsigned char _padded) {
+  return _padded ? _len : (_len < 8 ? 0 : _len - 7);
+}
+
+// Position of _c in _str or _len
+static size_t json_string_find(char _c, const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = json_swar_limit(_len, _padded);
+  size_t i = 0;
+
+  for (; i < limit; i += 8) {
+    uint64_t m = json_swar_eq(json_swar_load(_str + i), _c);
+    if (m) {
+      i += json_swar_first(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  for (; i < _len; i++) {
+    if (_str[i] == _c) {
+      return i;
+    }
+  }
+
+  return _len;
+}
+
+static ssize_t json_string_indexOf(char _c, const char* _str, size_t _len, unsigned char _padded) {
   if (_str == NULL || _len == 0) {
     return -1;
   }
 
-  for (size_t i = 0; i < _len; i++) {
-    if (_str[i] == '\0') {
-      return -1;
+  size_t i = json_string_find(_c, _str, _len, _padded);
+  return i < _len ? (ssize_t)i : -1;
+}
+
+static char json_is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// Position of the first non whitespace byte or _len
+static size_t json_skip_space_swar(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = json_swar_limit(_len, _padded);
+  size_t i = 0;
+
+  for (; i < limit; i += 8) {
+    uint64_t w = json_swar_load(_str + i);
+    uint64_t m = ~(json_swar_eq(w, ' ') | json_swar_eq(w, '\n') | json_swar_eq(w, '\r') | json_swar_eq(w, '\t'));
+    m &= JSON_SWAR_ONES << 7;
+    if (m) {
+      i += json_swar_first(m);
+      return i < _len ? i : _len;
     }
-    else if (_str[i] == _c) {
-      if (_skip_escaped == 1 && i > 0 && _str[i - 1] == '\\') {
-	continue;
-      }
+  }
 
-      return i;
+  while (i < _len && json_is_space(_str[i])) {
+    i++;
+  }
+
+  return i;
+}
+
+// Position of the first '"' or '\\' or _len
+static size_t json_scan_string_swar(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = json_swar_limit(_len, _padded);
+  size_t i = 0;
+
+  for (; i < limit; i += 8) {
+    uint64_t w = json_swar_load(_str + i);
+    uint64_t m = json_swar_eq(w, '"') | json_swar_eq(w, '\\');
+    if (m) {
+      i += json_swar_first(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  while (i < _len && _str[i] != '"' && _str[i] != '\\') {
+    i++;
+  }
+
+  return i;
+}
+
+/**********
+ ** SIMD **
+ **********/
+
+// SSE2 and AVX2 versions of the scanners above, picked at runtime. Blocks
+// that would cross the end of unpadded input are left to the SWAR tail.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JSON_SIMD_X86 1
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static size_t json_skip_space_sse2(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = _padded ? _len : (_len < 16 ? 0 : _len - 15);
+  size_t i = 0;
+
+  for (; i < limit; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(_str + i));
+    __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+			      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+    unsigned m = ~_mm_movemask_epi8(ws) & 0xFFFF;
+    if (m) {
+      i += __builtin_ctz(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  return i + json_skip_space_swar(_str + i, _len - i, _padded);
+}
+
+__attribute__((target("sse2")))
+static size_t json_scan_string_sse2(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = _padded ? _len : (_len < 16 ? 0 : _len - 15);
+  size_t i = 0;
+
+  for (; i < limit; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(_str + i));
+    __m128i q = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    unsigned m = _mm_movemask_epi8(q);
+    if (m) {
+      i += __builtin_ctz(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  return i + json_scan_string_swar(_str + i, _len - i, _padded);
+}
+
+__attribute__((target("avx2")))
+static size_t json_skip_space_avx2(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = _padded ? _len : (_len < 32 ? 0 : _len - 31);
+  size_t i = 0;
+
+  for (; i < limit; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(_str + i));
+    __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+				 _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+    unsigned m = ~(unsigned)_mm256_movemask_epi8(ws);
+    if (m) {
+      i += __builtin_ctz(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  return i + json_skip_space_sse2(_str + i, _len - i, _padded);
+}
+
+__attribute__((target("avx2")))
+static size_t json_scan_string_avx2(const char* _str, size_t _len, unsigned char _padded) {
+  size_t limit = _padded ? _len : (_len < 32 ? 0 : _len - 31);
+  size_t i = 0;
+
+  for (; i < limit; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(_str + i));
+    __m256i q = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+    unsigned m = _mm256_movemask_epi8(q);
+    if (m) {
+      i += __builtin_ctz(m);
+      return i < _len ? i : _len;
+    }
+  }
+
+  return i + json_scan_string_sse2(_str + i, _len - i, _padded);
+}
+#endif
+
+static size_t json_skip_space(const char* _str, size_t _len, unsigned char _padded) {
+#if defined(JSON_SIMD_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return json_skip_space_avx2(_str, _len, _padded);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return json_skip_space_sse2(_str, _len, _padded);
+  }
+#endif
+  return json_skip_space_swar(_str, _len, _padded);
+}
+
+static size_t json_scan_string(const char* _str, size_t _len, unsigned char _padded) {
+#if defined(JSON_SIMD_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return json_scan_string_avx2(_str, _len, _padded);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return json_scan_string_sse2(_str, _len, _padded);
+  }
+#endif
+  return json_scan_string_swar(_str, _len, _padded);
+}
+
+/***********
+ ** ARENA **
+ ***********/
+
+#define JSON_ARENA_ALIGN 16
+#define JSON_ARENA_MIN_BLOCK 4096
+
+static size_t json_arena_align(size_t _size) {
+  return (_size + JSON_ARENA_ALIGN - 1) & ~((size_t)JSON_ARENA_ALIGN - 1);
+}
+
+static void json_arena_init(JsonArena* _arena, size_t _blockSize) {
+  _arena->first = NULL;
+  _arena->indexes = NULL;
+  _arena->spare = NULL;
+  _arena->parent = NULL;
+  _arena->blockSize = _blockSize < JSON_ARENA_MIN_BLOCK ? JSON_ARENA_MIN_BLOCK : _blockSize;
+}
+
+static void* json_arena_alloc(JsonArena* _arena, size_t _size) {
+  size_t header = json_arena_align(sizeof(JsonArenaBlock));
+  _size = json_arena_align(_size);
+
+  JsonArenaBlock* block = _arena->first;
+  if (block == NULL || block->size - block->used < _size) {
+    size_t size = _arena->blockSize;
+    if (block != NULL) {
+      size = block->size * 2;
+    }
+    if (size < _size) {
+      size = _size;
+    }
+
+    block = malloc(header + size);
+    if (block == NULL) {
+      return NULL;
+    }
+    block->size = size;
+    block->used = 0;
+    block->next = _arena->first;
+    _arena->first = block;
+  }
+
+  void* p = (char*)block + header + block->used;
+  block->used += _size;
+  return p;
+}
+
+static void json_arena_freeIndexes(JsonObjectIndex* _index) {
+  while (_index) {
+    JsonObjectIndex* next = _index->next;
+    free(_index);
+    _index = next;
+  }
+}
+
+// Drops everything allocated but keeps the newest, largest block and the
+// object indexes for reuse. The indexes become spares in the order they were
+// built, so a similar document asks for them in the same order.
+static void json_arena_reset(JsonArena* _arena) {
+  JsonArenaBlock* keep = _arena->first;
+  if (keep != NULL) {
+    JsonArenaBlock* block = keep->next;
+    while (block) {
+      JsonArenaBlock* next = block->next;
+      free(block);
+      block = next;
     }
+    keep->next = NULL;
+    keep->used = 0;
   }
 
-  return -1;
+  JsonObjectIndex* spare = _arena->spare;
+  JsonObjectIndex* index = _arena->indexes;
+  while (index) {
+    JsonObjectIndex* next = index->next;
+    index->next = spare;
+    spare = index;
+    index = next;
+  }
+  _arena->spare = spare;
+  _arena->indexes = NULL;
+}
+
+static void json_arena_free(JsonArena* _arena) {
+  json_arena_reset(_arena);
+  free(_arena->first);
+  _arena->first = NULL;
+  json_arena_freeIndexes(_arena->spare);
+  _arena->spare = NULL;
 }
 
 /*************
  ** DECODER **
  *************/
 
-static JsonValue* json_decode_value(JsonStream* _enc);
+static char json_decode_value(JsonStream* _enc, JsonValue* _v);
 
 static char json_equal_strings(const char* _strA, size_t _lenA, const char* _strB, size_t _lenB) {
   if (_strA == NULL || _strB == NULL) {
@@ -101,21 +420,203 @@ static char json_equal_strings(const char* _strA, size_t _lenA, const char* _str
   return 1;
 }
 
+/**********
+ ** HASH **
+ **********/
+
+static void* json_atomic_loadPtr(void* volatile* _ptr) {
+#if defined(_MSC_VER)
+  return _InterlockedCompareExchangePointer(_ptr, NULL, NULL);
+#else
+  return __atomic_load_n(_ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Stores _desired if *_ptr is still _expected, returns the value *_ptr ends up with
+static void* json_atomic_casPtr(void* volatile* _ptr, void* _expected, void* _desired) {
+#if defined(_MSC_VER)
+  void* old = _InterlockedCompareExchangePointer(_ptr, _desired, _expected);
+  return old == _expected ? _desired : old;
+#else
+  if (__atomic_compare_exchange_n(_ptr, &_expected, _desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return _desired;
+  }
+  return _expected;
+#endif
+}
+
+// Stores _desired if *_ptr is still *_expected and returns 1, otherwise
+// loads the current value into *_expected and returns 0
+static char json_atomic_tryCasPtr(void* volatile* _ptr, void** _expected, void* _desired) {
+#if defined(_MSC_VER)
+  void* old = _InterlockedCompareExchangePointer(_ptr, _desired, *_expected);
+  if (old == *_expected) {
+    return 1;
+  }
+  *_expected = old;
+  return 0;
+#else
+  return __atomic_compare_exchange_n(_ptr, _expected, _desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Stores _desired and returns the previous value
+static void* json_atomic_swapPtr(void* volatile* _ptr, void* _desired) {
+#if defined(_MSC_VER)
+  return _InterlockedExchangePointer(_ptr, _desired);
+#else
+  return __atomic_exchange_n(_ptr, _desired, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Adds _delta (wrapping, so (size_t)-1 subtracts one) and returns the new value
+static size_t json_atomic_addSize(volatile size_t* _ptr, size_t _delta) {
+#if defined(_MSC_VER) && defined(_WIN64)
+  return (size_t)_InterlockedExchangeAdd64((volatile __int64*)_ptr, (__int64)_delta) + _delta;
+#elif defined(_MSC_VER)
+  return (size_t)_InterlockedExchangeAdd((volatile long*)_ptr, (long)_delta) + _delta;
+#else
+  return __atomic_add_fetch(_ptr, _delta, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static size_t json_atomic_loadSize(volatile size_t* _ptr) {
+#if defined(_MSC_VER)
+  return json_atomic_addSize(_ptr, 0);
+#else
+  return __atomic_load_n(_ptr, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static volatile uint64_t json_hash_key = 0;
+
+static uint64_t json_hash_mix(uint64_t _x) {
+  _x += 0x9e3779b97f4a7c15ULL;
+  _x = (_x ^ (_x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  _x = (_x ^ (_x >> 27)) * 0x94d049bb133111ebULL;
+  return _x ^ (_x >> 31);
+}
+
+static uint64_t json_hash_random() {
+  uint64_t r = 0;
+#if !defined(_WIN32)
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd >= 0) {
+    if (read(fd, &r, sizeof(r)) != sizeof(r)) {
+      r = 0;
+    }
+    close(fd);
+  }
+#endif
+  // Without a random device fall back to whatever differs between runs
+  uint64_t local = 0;
+  r ^= json_hash_mix((uint64_t)time(NULL) ^ (uint64_t)clock());
+  r ^= json_hash_mix((uint64_t)(uintptr_t)&local ^ ((uint64_t)(uintptr_t)&json_hash_key << 32));
+  return r;
+}
+
+// Process wide key, drawn on first use. The first thread to publish wins so
+// every table and compiled path agrees on the same key.
+static uint64_t json_hash_seed() {
+#if defined(_MSC_VER)
+  uint64_t key = (uint64_t)_InterlockedCompareExchange64((volatile __int64*)&json_hash_key, 0, 0);
+#else
+  uint64_t key = __atomic_load_n(&json_hash_key, __ATOMIC_ACQUIRE);
+#endif
+  if (key != 0) {
+    return key;
+  }
+
+  uint64_t fresh = json_hash_random() | 1;
+#if defined(_MSC_VER)
+  key = (uint64_t)_InterlockedCompareExchange64((volatile __int64*)&json_hash_key, (__int64)fresh, 0);
+#else
+  key = 0;
+  __atomic_compare_exchange_n(&json_hash_key, &key, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+  return key != 0 ? key : fresh;
+}
+
+#define JSON_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+#define JSON_SIPROUND(v0, v1, v2, v3)					\
+  do {									\
+    v0 += v1; v1 = JSON_ROTL(v1, 13); v1 ^= v0; v0 = JSON_ROTL(v0, 32);	\
+    v2 += v3; v3 = JSON_ROTL(v3, 16); v3 ^= v2;				\
+    v0 += v3; v3 = JSON_ROTL(v3, 21); v3 ^= v0;				\
+    v2 += v1; v1 = JSON_ROTL(v1, 17); v1 ^= v2; v2 = JSON_ROTL(v2, 32);	\
+  } while (0)
+
+// SipHash-1-3, keyed with the process seed
+static uint64_t json_siphash(const char* _str, size_t _len, uint64_t _k0, uint64_t _k1) {
+  uint64_t v0 = 0x736f6d6570736575ULL ^ _k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ _k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ _k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ _k1;
+  const unsigned char* p = (const unsigned char*)_str;
+  size_t left = _len;
+  uint64_t m;
+
+  while (left >= 8) {
+    memcpy(&m, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    m = __builtin_bswap64(m);
+#endif
+    v3 ^= m;
+    JSON_SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+    p += 8;
+    left -= 8;
+  }
+
+  m = (uint64_t)_len << 56;
+  for (size_t i = 0; i < left; i++) {
+    m |= (uint64_t)p[i] << (8 * i);
+  }
+  v3 ^= m;
+  JSON_SIPROUND(v0, v1, v2, v3);
+  v0 ^= m;
+
+  v2 ^= 0xff;
+  JSON_SIPROUND(v0, v1, v2, v3);
+  JSON_SIPROUND(v0, v1, v2, v3);
+  JSON_SIPROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static size_t json_string_hashKeyed(const char* _str, size_t _len, uint64_t _seed) {
+  return (size_t)json_siphash(_str, _len, _seed, json_hash_mix(_seed));
+}
+
 static size_t json_string_hash(const char* _str, size_t _len) {
-  size_t h = 0;
-  while (_len--) {
-    h = (h ^ *(_str++)) << 1;
+  return json_string_hashKeyed(_str, _len, json_hash_seed());
+}
+
+// Nodes come from the arena when there is one, from malloc otherwise
+static void* json_alloc(JsonStream* _enc, size_t _size) {
+  if (_enc->arena != NULL) {
+    return json_arena_alloc(_enc->arena, _size);
   }
+  return malloc(_size);
+}
 
-  return h;
+static void json_stream_init(JsonStream* _enc, const char* _json, size_t _len, JsonArena* _arena) {
+  _enc->current = _json;
+  _enc->start = _json;
+  _enc->length = _len;
+  _enc->position = 0;
+  _enc->arena = _arena;
+  _enc->insitu = NULL;
+  _enc->borrowed = 0;
+  _enc->padded = 0;
+  _enc->scratch = NULL;
+  _enc->scratchLength = 0;
+  _enc->scratchCapacity = 0;
 }
 
-static JsonStream* json_stream(const char* _json, size_t _len) {
-  JsonStream* enc = malloc(sizeof(JsonStream));
-  enc->current = _json;
-  enc->start = _json;
-  enc->length = _len;
-  enc->position = 0;
+static JsonStream* json_stream(const char* _json, size_t _len, JsonArena* _arena) {
+  JsonStream* enc = _arena ? json_arena_alloc(_arena, sizeof(JsonStream)) : malloc(sizeof(JsonStream));
+  json_stream_init(enc, _json, _len, _arena);
   return enc;
 }
 
@@ -153,56 +654,92 @@ static char* json_substring(const char* _str, size_t _len) {
 }
 
 static void json_string_ltrim(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
+  if (_enc == NULL || _enc->length == 0 || json_is_space(_enc->current[0]) == 0) {
     return;
   }
 
-  size_t pos = 0;
-  while (_enc->length > pos) {
-    switch(_enc->current[pos]) {
-    case '\0': return;
-    case ' ':
-    case '\n':
-    case '\r':
-    case '\t':
-      pos++;
-      continue;
-    }
-    break;
+  // Most values follow a single space or none, keep that off the kernels
+  if (_enc->length == 1 || json_is_space(_enc->current[1]) == 0) {
+    json_move_stream(_enc, 1);
+    return;
   }
 
-  json_move_stream(_enc, pos);
+  json_move_stream(_enc, 2 + json_skip_space(_enc->current + 2, _enc->length - 2, _enc->padded));
 }
 
-static JsonString* json_decode_string(JsonStream* _enc) {
+// Current character or '\0' at the end of the stream
+static char json_stream_peek(const JsonStream* _enc) {
+  return _enc->length ? _enc->current[0] : '\0';
+}
+
+static char json_decode_stringInto(JsonStream* _enc, JsonString* _str) {
   if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+    return 0;
   }
 
   json_string_ltrim(_enc);
 
-  if (_enc->current == NULL || _enc->current[0] != JSON_STRING) {
-    return NULL;
+  if (_enc->current == NULL || json_stream_peek(_enc) != JSON_STRING) {
+    return 0;
   }
 
   json_move_stream(_enc, 1);
 
-  ssize_t end = json_string_indexOf(JSON_STRING, _enc->current, _enc->length, 1);
-  if (end < 0) {
-    return NULL;
+  // Stop at quotes and backslashes, an escape skips the byte after it so
+  // runs like \\" are paired correctly
+  size_t end = json_scan_string(_enc->current, _enc->length, _enc->padded);
+  while (end < _enc->length && _enc->current[end] != JSON_STRING) {
+    end += 2;
+    if (end < _enc->length) {
+      end += json_scan_string(_enc->current + end, _enc->length - end, _enc->padded);
+    }
+  }
+
+  if (end >= _enc->length) {
+    return 0;
   }
 
-  JsonString* str = malloc(sizeof(JsonString));
+  JsonString* str = _str;
   str->length = end;
-  str->value = json_substring(_enc->current, end);
+  if (_enc->borrowed) {
+    // Length delimited, the closing quote is left alone
+    str->value = (char*)_enc->current;
+  }
+  else if (_enc->insitu != NULL) {
+    // Terminate in place of the closing quote, no copy
+    str->value = _enc->insitu + _enc->position;
+    str->value[end] = '\0';
+  }
+  else if (_enc->arena != NULL) {
+    str->value = json_arena_alloc(_enc->arena, end + 1);
+    str->value[end] = '\0';
+    while (end--) {
+      str->value[end] = _enc->current[end];
+    }
+  }
+  else {
+    str->value = json_substring(_enc->current, end);
+  }
 
   json_move_stream(_enc, str->length + 1);
 
+  return 1;
+}
+
+static JsonString* json_decode_string(JsonStream* _enc) {
+  JsonString* str = json_alloc(_enc, sizeof(JsonString));
+  if (json_decode_stringInto(_enc, str) == 0) {
+    if (_enc->arena == NULL) {
+      free(str);
+    }
+    return NULL;
+  }
+
   return str;
 }
 
 static void json_free_string(JsonString* _str) {
-  if (_str->value == NULL) {
+  if (_str == NULL || _str->value == NULL) {
     return;
   }
 
@@ -210,478 +747,1436 @@ static void json_free_string(JsonString* _str) {
   free(_str);
 }
 
-static JsonNumber* json_decode_number(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
-    return NULL;
-  }
+/**********
+ ** ATOF **
+ **********/
+
+// Number text to double. The digits go into a 64 bit mantissa and a power
+// of ten, small cases are exact in double arithmetic (Clinger), the rest go
+// through Eisel-Lemire and only the rare ambiguous case falls back to an exact
+// big decimal conversion.
+
+typedef struct {
+  uint64_t mantissa; // Significant digits, wrapped when there are more than 19
+  int64_t exponent; // Power of ten applied to the mantissa
+  unsigned char negative;
+  unsigned char truncated; // The mantissa lost digits
+  unsigned char integer; // No fraction and no exponent
+  size_t length; // Bytes of the number text
+} JsonNumberText;
+
+// 128 bit mantissas of 10^q for q = -342 ... 308, rounded down, low word first
+#define JSON_POW10_MIN -342
+#define JSON_POW10_MAX 308
+static const uint64_t JSON_POW10_128[][2] = {
+  {0x113faa2906a13b3fULL, 0xeef453d6923bd65aULL}, {0x4ac7ca59a424c507ULL, 0x9558b4661b6565f8ULL},
+  {0x5d79bcf00d2df649ULL, 0xbaaee17fa23ebf76ULL}, {0xf4d82c2c107973dcULL, 0xe95a99df8ace6f53ULL},
+  {0x79071b9b8a4be869ULL, 0x91d8a02bb6c10594ULL}, {0x9748e2826cdee284ULL, 0xb64ec836a47146f9ULL},
+  {0xfd1b1b2308169b25ULL, 0xe3e27a444d8d98b7ULL}, {0xfe30f0f5e50e20f7ULL, 0x8e6d8c6ab0787f72ULL},
+  {0xbdbd2d335e51a935ULL, 0xb208ef855c969f4fULL}, {0xad2c788035e61382ULL, 0xde8b2b66b3bc4723ULL},
+  {0x4c3bcb5021afcc31ULL, 0x8b16fb203055ac76ULL}, {0xdf4abe242a1bbf3dULL, 0xaddcb9e83c6b1793ULL},
+  {0xd71d6dad34a2af0dULL, 0xd953e8624b85dd78ULL}, {0x8672648c40e5ad68ULL, 0x87d4713d6f33aa6bULL},
+  {0x680efdaf511f18c2ULL, 0xa9c98d8ccb009506ULL}, {0x0212bd1b2566def2ULL, 0xd43bf0effdc0ba48ULL},
+  {0x014bb630f7604b57ULL, 0x84a57695fe98746dULL}, {0x419ea3bd35385e2dULL, 0xa5ced43b7e3e9188ULL},
+  {0x52064cac828675b9ULL, 0xcf42894a5dce35eaULL}, {0x7343efebd1940993ULL, 0x818995ce7aa0e1b2ULL},
+  {0x1014ebe6c5f90bf8ULL, 0xa1ebfb4219491a1fULL}, {0xd41a26e077774ef6ULL, 0xca66fa129f9b60a6ULL},
+  {0x8920b098955522b4ULL, 0xfd00b897478238d0ULL}, {0x55b46e5f5d5535b0ULL, 0x9e20735e8cb16382ULL},
+  {0xeb2189f734aa831dULL, 0xc5a890362fddbc62ULL}, {0xa5e9ec7501d523e4ULL, 0xf712b443bbd52b7bULL},
+  {0x47b233c92125366eULL, 0x9a6bb0aa55653b2dULL}, {0x999ec0bb696e840aULL, 0xc1069cd4eabe89f8ULL},
+  {0xc00670ea43ca250dULL, 0xf148440a256e2c76ULL}, {0x380406926a5e5728ULL, 0x96cd2a865764dbcaULL},
+  {0xc605083704f5ecf2ULL, 0xbc807527ed3e12bcULL}, {0xf7864a44c633682eULL, 0xeba09271e88d976bULL},
+  {0x7ab3ee6afbe0211dULL, 0x93445b8731587ea3ULL}, {0x5960ea05bad82964ULL, 0xb8157268fdae9e4cULL},
+  {0x6fb92487298e33bdULL, 0xe61acf033d1a45dfULL}, {0xa5d3b6d479f8e056ULL, 0x8fd0c16206306babULL},
+  {0x8f48a4899877186cULL, 0xb3c4f1ba87bc8696ULL}, {0x331acdabfe94de87ULL, 0xe0b62e2929aba83cULL},
+  {0x9ff0c08b7f1d0b14ULL, 0x8c71dcd9ba0b4925ULL}, {0x07ecf0ae5ee44dd9ULL, 0xaf8e5410288e1b6fULL},
+  {0xc9e82cd9f69d6150ULL, 0xdb71e91432b1a24aULL}, {0xbe311c083a225cd2ULL, 0x892731ac9faf056eULL},
+  {0x6dbd630a48aaf406ULL, 0xab70fe17c79ac6caULL}, {0x092cbbccdad5b108ULL, 0xd64d3d9db981787dULL},
+  {0x25bbf56008c58ea5ULL, 0x85f0468293f0eb4eULL}, {0xaf2af2b80af6f24eULL, 0xa76c582338ed2621ULL},
+  {0x1af5af660db4aee1ULL, 0xd1476e2c07286faaULL}, {0x50d98d9fc890ed4dULL, 0x82cca4db847945caULL},
+  {0xe50ff107bab528a0ULL, 0xa37fce126597973cULL}, {0x1e53ed49a96272c8ULL, 0xcc5fc196fefd7d0cULL},
+  {0x25e8e89c13bb0f7aULL, 0xff77b1fcbebcdc4fULL}, {0x77b191618c54e9acULL, 0x9faacf3df73609b1ULL},
+  {0xd59df5b9ef6a2417ULL, 0xc795830d75038c1dULL}, {0x4b0573286b44ad1dULL, 0xf97ae3d0d2446f25ULL},
+  {0x4ee367f9430aec32ULL, 0x9becce62836ac577ULL}, {0x229c41f793cda73fULL, 0xc2e801fb244576d5ULL},
+  {0x6b43527578c1110fULL, 0xf3a20279ed56d48aULL}, {0x830a13896b78aaa9ULL, 0x9845418c345644d6ULL},
+  {0x23cc986bc656d553ULL, 0xbe5691ef416bd60cULL}, {0x2cbfbe86b7ec8aa8ULL, 0xedec366b11c6cb8fULL},
+  {0x7bf7d71432f3d6a9ULL, 0x94b3a202eb1c3f39ULL}, {0xdaf5ccd93fb0cc53ULL, 0xb9e08a83a5e34f07ULL},
+  {0xd1b3400f8f9cff68ULL, 0xe858ad248f5c22c9ULL}, {0x23100809b9c21fa1ULL, 0x91376c36d99995beULL},
+  {0xabd40a0c2832a78aULL, 0xb58547448ffffb2dULL}, {0x16c90c8f323f516cULL, 0xe2e69915b3fff9f9ULL},
+  {0xae3da7d97f6792e3ULL, 0x8dd01fad907ffc3bULL}, {0x99cd11cfdf41779cULL, 0xb1442798f49ffb4aULL},
+  {0x40405643d711d583ULL, 0xdd95317f31c7fa1dULL}, {0x482835ea666b2572ULL, 0x8a7d3eef7f1cfc52ULL},
+  {0xda3243650005eecfULL, 0xad1c8eab5ee43b66ULL}, {0x90bed43e40076a82ULL, 0xd863b256369d4a40ULL},
+  {0x5a7744a6e804a291ULL, 0x873e4f75e2224e68ULL}, {0x711515d0a205cb36ULL, 0xa90de3535aaae202ULL},
+  {0x0d5a5b44ca873e03ULL, 0xd3515c2831559a83ULL}, {0xe858790afe9486c2ULL, 0x8412d9991ed58091ULL},
+  {0x626e974dbe39a872ULL, 0xa5178fff668ae0b6ULL}, {0xfb0a3d212dc8128fULL, 0xce5d73ff402d98e3ULL},
+  {0x7ce66634bc9d0b99ULL, 0x80fa687f881c7f8eULL}, {0x1c1fffc1ebc44e80ULL, 0xa139029f6a239f72ULL},
+  {0xa327ffb266b56220ULL, 0xc987434744ac874eULL}, {0x4bf1ff9f0062baa8ULL, 0xfbe9141915d7a922ULL},
+  {0x6f773fc3603db4a9ULL, 0x9d71ac8fada6c9b5ULL}, {0xcb550fb4384d21d3ULL, 0xc4ce17b399107c22ULL},
+  {0x7e2a53a146606a48ULL, 0xf6019da07f549b2bULL}, {0x2eda7444cbfc426dULL, 0x99c102844f94e0fbULL},
+  {0xfa911155fefb5308ULL, 0xc0314325637a1939ULL}, {0x793555ab7eba27caULL, 0xf03d93eebc589f88ULL},
+  {0x4bc1558b2f3458deULL, 0x96267c7535b763b5ULL}, {0x9eb1aaedfb016f16ULL, 0xbbb01b9283253ca2ULL},
+  {0x465e15a979c1cadcULL, 0xea9c227723ee8bcbULL}, {0x0bfacd89ec191ec9ULL, 0x92a1958a7675175fULL},
+  {0xcef980ec671f667bULL, 0xb749faed14125d36ULL}, {0x82b7e12780e7401aULL, 0xe51c79a85916f484ULL},
+  {0xd1b2ecb8b0908810ULL, 0x8f31cc0937ae58d2ULL}, {0x861fa7e6dcb4aa15ULL, 0xb2fe3f0b8599ef07ULL},
+  {0x67a791e093e1d49aULL, 0xdfbdcece67006ac9ULL}, {0xe0c8bb2c5c6d24e0ULL, 0x8bd6a141006042bdULL},
+  {0x58fae9f773886e18ULL, 0xaecc49914078536dULL}, {0xaf39a475506a899eULL, 0xda7f5bf590966848ULL},
+  {0x6d8406c952429603ULL, 0x888f99797a5e012dULL}, {0xc8e5087ba6d33b83ULL, 0xaab37fd7d8f58178ULL},
+  {0xfb1e4a9a90880a64ULL, 0xd5605fcdcf32e1d6ULL}, {0x5cf2eea09a55067fULL, 0x855c3be0a17fcd26ULL},
+  {0xf42faa48c0ea481eULL, 0xa6b34ad8c9dfc06fULL}, {0xf13b94daf124da26ULL, 0xd0601d8efc57b08bULL},
+  {0x76c53d08d6b70858ULL, 0x823c12795db6ce57ULL}, {0x54768c4b0c64ca6eULL, 0xa2cb1717b52481edULL},
+  {0xa9942f5dcf7dfd09ULL, 0xcb7ddcdda26da268ULL}, {0xd3f93b35435d7c4cULL, 0xfe5d54150b090b02ULL},
+  {0xc47bc5014a1a6dafULL, 0x9efa548d26e5a6e1ULL}, {0x359ab6419ca1091bULL, 0xc6b8e9b0709f109aULL},
+  {0xc30163d203c94b62ULL, 0xf867241c8cc6d4c0ULL}, {0x79e0de63425dcf1dULL, 0x9b407691d7fc44f8ULL},
+  {0x985915fc12f542e4ULL, 0xc21094364dfb5636ULL}, {0x3e6f5b7b17b2939dULL, 0xf294b943e17a2bc4ULL},
+  {0xa705992ceecf9c42ULL, 0x979cf3ca6cec5b5aULL}, {0x50c6ff782a838353ULL, 0xbd8430bd08277231ULL},
+  {0xa4f8bf5635246428ULL, 0xece53cec4a314ebdULL}, {0x871b7795e136be99ULL, 0x940f4613ae5ed136ULL},
+  {0x28e2557b59846e3fULL, 0xb913179899f68584ULL}, {0x331aeada2fe589cfULL, 0xe757dd7ec07426e5ULL},
+  {0x3ff0d2c85def7621ULL, 0x9096ea6f3848984fULL}, {0x0fed077a756b53a9ULL, 0xb4bca50b065abe63ULL},
+  {0xd3e8495912c62894ULL, 0xe1ebce4dc7f16dfbULL}, {0x64712dd7abbbd95cULL, 0x8d3360f09cf6e4bdULL},
+  {0xbd8d794d96aacfb3ULL, 0xb080392cc4349decULL}, {0xecf0d7a0fc5583a0ULL, 0xdca04777f541c567ULL},
+  {0xf41686c49db57244ULL, 0x89e42caaf9491b60ULL}, {0x311c2875c522ced5ULL, 0xac5d37d5b79b6239ULL},
+  {0x7d633293366b828bULL, 0xd77485cb25823ac7ULL}, {0xae5dff9c02033197ULL, 0x86a8d39ef77164bcULL},
+  {0xd9f57f830283fdfcULL, 0xa8530886b54dbdebULL}, {0xd072df63c324fd7bULL, 0xd267caa862a12d66ULL},
+  {0x4247cb9e59f71e6dULL, 0x8380dea93da4bc60ULL}, {0x52d9be85f074e608ULL, 0xa46116538d0deb78ULL},
+  {0x67902e276c921f8bULL, 0xcd795be870516656ULL}, {0x00ba1cd8a3db53b6ULL, 0x806bd9714632dff6ULL},
+  {0x80e8a40eccd228a4ULL, 0xa086cfcd97bf97f3ULL}, {0x6122cd128006b2cdULL, 0xc8a883c0fdaf7df0ULL},
+  {0x796b805720085f81ULL, 0xfad2a4b13d1b5d6cULL}, {0xcbe3303674053bb0ULL, 0x9cc3a6eec6311a63ULL},
+  {0xbedbfc4411068a9cULL, 0xc3f490aa77bd60fcULL}, {0xee92fb5515482d44ULL, 0xf4f1b4d515acb93bULL},
+  {0x751bdd152d4d1c4aULL, 0x991711052d8bf3c5ULL}, {0xd262d45a78a0635dULL, 0xbf5cd54678eef0b6ULL},
+  {0x86fb897116c87c34ULL, 0xef340a98172aace4ULL}, {0xd45d35e6ae3d4da0ULL, 0x9580869f0e7aac0eULL},
+  {0x8974836059cca109ULL, 0xbae0a846d2195712ULL}, {0x2bd1a438703fc94bULL, 0xe998d258869facd7ULL},
+  {0x7b6306a34627ddcfULL, 0x91ff83775423cc06ULL}, {0x1a3bc84c17b1d542ULL, 0xb67f6455292cbf08ULL},
+  {0x20caba5f1d9e4a93ULL, 0xe41f3d6a7377eecaULL}, {0x547eb47b7282ee9cULL, 0x8e938662882af53eULL},
+  {0xe99e619a4f23aa43ULL, 0xb23867fb2a35b28dULL}, {0x6405fa00e2ec94d4ULL, 0xdec681f9f4c31f31ULL},
+  {0xde83bc408dd3dd04ULL, 0x8b3c113c38f9f37eULL}, {0x9624ab50b148d445ULL, 0xae0b158b4738705eULL},
+  {0x3badd624dd9b0957ULL, 0xd98ddaee19068c76ULL}, {0xe54ca5d70a80e5d6ULL, 0x87f8a8d4cfa417c9ULL},
+  {0x5e9fcf4ccd211f4cULL, 0xa9f6d30a038d1dbcULL}, {0x7647c3200069671fULL, 0xd47487cc8470652bULL},
+  {0x29ecd9f40041e073ULL, 0x84c8d4dfd2c63f3bULL}, {0xf468107100525890ULL, 0xa5fb0a17c777cf09ULL},
+  {0x7182148d4066eeb4ULL, 0xcf79cc9db955c2ccULL}, {0xc6f14cd848405530ULL, 0x81ac1fe293d599bfULL},
+  {0xb8ada00e5a506a7cULL, 0xa21727db38cb002fULL}, {0xa6d90811f0e4851cULL, 0xca9cf1d206fdc03bULL},
+  {0x908f4a166d1da663ULL, 0xfd442e4688bd304aULL}, {0x9a598e4e043287feULL, 0x9e4a9cec15763e2eULL},
+  {0x40eff1e1853f29fdULL, 0xc5dd44271ad3cdbaULL}, {0xd12bee59e68ef47cULL, 0xf7549530e188c128ULL},
+  {0x82bb74f8301958ceULL, 0x9a94dd3e8cf578b9ULL}, {0xe36a52363c1faf01ULL, 0xc13a148e3032d6e7ULL},
+  {0xdc44e6c3cb279ac1ULL, 0xf18899b1bc3f8ca1ULL}, {0x29ab103a5ef8c0b9ULL, 0x96f5600f15a7b7e5ULL},
+  {0x7415d448f6b6f0e7ULL, 0xbcb2b812db11a5deULL}, {0x111b495b3464ad21ULL, 0xebdf661791d60f56ULL},
+  {0xcab10dd900beec34ULL, 0x936b9fcebb25c995ULL}, {0x3d5d514f40eea742ULL, 0xb84687c269ef3bfbULL},
+  {0x0cb4a5a3112a5112ULL, 0xe65829b3046b0afaULL}, {0x47f0e785eaba72abULL, 0x8ff71a0fe2c2e6dcULL},
+  {0x59ed216765690f56ULL, 0xb3f4e093db73a093ULL}, {0x306869c13ec3532cULL, 0xe0f218b8d25088b8ULL},
+  {0x1e414218c73a13fbULL, 0x8c974f7383725573ULL}, {0xe5d1929ef90898faULL, 0xafbd2350644eeacfULL},
+  {0xdf45f746b74abf39ULL, 0xdbac6c247d62a583ULL}, {0x6b8bba8c328eb783ULL, 0x894bc396ce5da772ULL},
+  {0x066ea92f3f326564ULL, 0xab9eb47c81f5114fULL}, {0xc80a537b0efefebdULL, 0xd686619ba27255a2ULL},
+  {0xbd06742ce95f5f36ULL, 0x8613fd0145877585ULL}, {0x2c48113823b73704ULL, 0xa798fc4196e952e7ULL},
+  {0xf75a15862ca504c5ULL, 0xd17f3b51fca3a7a0ULL}, {0x9a984d73dbe722fbULL, 0x82ef85133de648c4ULL},
+  {0xc13e60d0d2e0ebbaULL, 0xa3ab66580d5fdaf5ULL}, {0x318df905079926a8ULL, 0xcc963fee10b7d1b3ULL},
+  {0xfdf17746497f7052ULL, 0xffbbcfe994e5c61fULL}, {0xfeb6ea8bedefa633ULL, 0x9fd561f1fd0f9bd3ULL},
+  {0xfe64a52ee96b8fc0ULL, 0xc7caba6e7c5382c8ULL}, {0x3dfdce7aa3c673b0ULL, 0xf9bd690a1b68637bULL},
+  {0x06bea10ca65c084eULL, 0x9c1661a651213e2dULL}, {0x486e494fcff30a62ULL, 0xc31bfa0fe5698db8ULL},
+  {0x5a89dba3c3efccfaULL, 0xf3e2f893dec3f126ULL}, {0xf89629465a75e01cULL, 0x986ddb5c6b3a76b7ULL},
+  {0xf6bbb397f1135823ULL, 0xbe89523386091465ULL}, {0x746aa07ded582e2cULL, 0xee2ba6c0678b597fULL},
+  {0xa8c2a44eb4571cdcULL, 0x94db483840b717efULL}, {0x92f34d62616ce413ULL, 0xba121a4650e4ddebULL},
+  {0x77b020baf9c81d17ULL, 0xe896a0d7e51e1566ULL}, {0x0ace1474dc1d122eULL, 0x915e2486ef32cd60ULL},
+  {0x0d819992132456baULL, 0xb5b5ada8aaff80b8ULL}, {0x10e1fff697ed6c69ULL, 0xe3231912d5bf60e6ULL},
+  {0xca8d3ffa1ef463c1ULL, 0x8df5efabc5979c8fULL}, {0xbd308ff8a6b17cb2ULL, 0xb1736b96b6fd83b3ULL},
+  {0xac7cb3f6d05ddbdeULL, 0xddd0467c64bce4a0ULL}, {0x6bcdf07a423aa96bULL, 0x8aa22c0dbef60ee4ULL},
+  {0x86c16c98d2c953c6ULL, 0xad4ab7112eb3929dULL}, {0xe871c7bf077ba8b7ULL, 0xd89d64d57a607744ULL},
+  {0x11471cd764ad4972ULL, 0x87625f056c7c4a8bULL}, {0xd598e40d3dd89bcfULL, 0xa93af6c6c79b5d2dULL},
+  {0x4aff1d108d4ec2c3ULL, 0xd389b47879823479ULL}, {0xcedf722a585139baULL, 0x843610cb4bf160cbULL},
+  {0xc2974eb4ee658828ULL, 0xa54394fe1eedb8feULL}, {0x733d226229feea32ULL, 0xce947a3da6a9273eULL},
+  {0x0806357d5a3f525fULL, 0x811ccc668829b887ULL}, {0xca07c2dcb0cf26f7ULL, 0xa163ff802a3426a8ULL},
+  {0xfc89b393dd02f0b5ULL, 0xc9bcff6034c13052ULL}, {0xbbac2078d443ace2ULL, 0xfc2c3f3841f17c67ULL},
+  {0xd54b944b84aa4c0dULL, 0x9d9ba7832936edc0ULL}, {0x0a9e795e65d4df11ULL, 0xc5029163f384a931ULL},
+  {0x4d4617b5ff4a16d5ULL, 0xf64335bcf065d37dULL}, {0x504bced1bf8e4e45ULL, 0x99ea0196163fa42eULL},
+  {0xe45ec2862f71e1d6ULL, 0xc06481fb9bcf8d39ULL}, {0x5d767327bb4e5a4cULL, 0xf07da27a82c37088ULL},
+  {0x3a6a07f8d510f86fULL, 0x964e858c91ba2655ULL}, {0x890489f70a55368bULL, 0xbbe226efb628afeaULL},
+  {0x2b45ac74ccea842eULL, 0xeadab0aba3b2dbe5ULL}, {0x3b0b8bc90012929dULL, 0x92c8ae6b464fc96fULL},
+  {0x09ce6ebb40173744ULL, 0xb77ada0617e3bbcbULL}, {0xcc420a6a101d0515ULL, 0xe55990879ddcaabdULL},
+  {0x9fa946824a12232dULL, 0x8f57fa54c2a9eab6ULL}, {0x47939822dc96abf9ULL, 0xb32df8e9f3546564ULL},
+  {0x59787e2b93bc56f7ULL, 0xdff9772470297ebdULL}, {0x57eb4edb3c55b65aULL, 0x8bfbea76c619ef36ULL},
+  {0xede622920b6b23f1ULL, 0xaefae51477a06b03ULL}, {0xe95fab368e45ecedULL, 0xdab99e59958885c4ULL},
+  {0x11dbcb0218ebb414ULL, 0x88b402f7fd75539bULL}, {0xd652bdc29f26a119ULL, 0xaae103b5fcd2a881ULL},
+  {0x4be76d3346f0495fULL, 0xd59944a37c0752a2ULL}, {0x6f70a4400c562ddbULL, 0x857fcae62d8493a5ULL},
+  {0xcb4ccd500f6bb952ULL, 0xa6dfbd9fb8e5b88eULL}, {0x7e2000a41346a7a7ULL, 0xd097ad07a71f26b2ULL},
+  {0x8ed400668c0c28c8ULL, 0x825ecc24c873782fULL}, {0x728900802f0f32faULL, 0xa2f67f2dfa90563bULL},
+  {0x4f2b40a03ad2ffb9ULL, 0xcbb41ef979346bcaULL}, {0xe2f610c84987bfa8ULL, 0xfea126b7d78186bcULL},
+  {0x0dd9ca7d2df4d7c9ULL, 0x9f24b832e6b0f436ULL}, {0x91503d1c79720dbbULL, 0xc6ede63fa05d3143ULL},
+  {0x75a44c6397ce912aULL, 0xf8a95fcf88747d94ULL}, {0xc986afbe3ee11abaULL, 0x9b69dbe1b548ce7cULL},
+  {0xfbe85badce996168ULL, 0xc24452da229b021bULL}, {0xfae27299423fb9c3ULL, 0xf2d56790ab41c2a2ULL},
+  {0xdccd879fc967d41aULL, 0x97c560ba6b0919a5ULL}, {0x5400e987bbc1c920ULL, 0xbdb6b8e905cb600fULL},
+  {0x290123e9aab23b68ULL, 0xed246723473e3813ULL}, {0xf9a0b6720aaf6521ULL, 0x9436c0760c86e30bULL},
+  {0xf808e40e8d5b3e69ULL, 0xb94470938fa89bceULL}, {0xb60b1d1230b20e04ULL, 0xe7958cb87392c2c2ULL},
+  {0xb1c6f22b5e6f48c2ULL, 0x90bd77f3483bb9b9ULL}, {0x1e38aeb6360b1af3ULL, 0xb4ecd5f01a4aa828ULL},
+  {0x25c6da63c38de1b0ULL, 0xe2280b6c20dd5232ULL}, {0x579c487e5a38ad0eULL, 0x8d590723948a535fULL},
+  {0x2d835a9df0c6d851ULL, 0xb0af48ec79ace837ULL}, {0xf8e431456cf88e65ULL, 0xdcdb1b2798182244ULL},
+  {0x1b8e9ecb641b58ffULL, 0x8a08f0f8bf0f156bULL}, {0xe272467e3d222f3fULL, 0xac8b2d36eed2dac5ULL},
+  {0x5b0ed81dcc6abb0fULL, 0xd7adf884aa879177ULL}, {0x98e947129fc2b4e9ULL, 0x86ccbb52ea94baeaULL},
+  {0x3f2398d747b36224ULL, 0xa87fea27a539e9a5ULL}, {0x8eec7f0d19a03aadULL, 0xd29fe4b18e88640eULL},
+  {0x1953cf68300424acULL, 0x83a3eeeef9153e89ULL}, {0x5fa8c3423c052dd7ULL, 0xa48ceaaab75a8e2bULL},
+  {0x3792f412cb06794dULL, 0xcdb02555653131b6ULL}, {0xe2bbd88bbee40bd0ULL, 0x808e17555f3ebf11ULL},
+  {0x5b6aceaeae9d0ec4ULL, 0xa0b19d2ab70e6ed6ULL}, {0xf245825a5a445275ULL, 0xc8de047564d20a8bULL},
+  {0xeed6e2f0f0d56712ULL, 0xfb158592be068d2eULL}, {0x55464dd69685606bULL, 0x9ced737bb6c4183dULL},
+  {0xaa97e14c3c26b886ULL, 0xc428d05aa4751e4cULL}, {0xd53dd99f4b3066a8ULL, 0xf53304714d9265dfULL},
+  {0xe546a8038efe4029ULL, 0x993fe2c6d07b7fabULL}, {0xde98520472bdd033ULL, 0xbf8fdb78849a5f96ULL},
+  {0x963e66858f6d4440ULL, 0xef73d256a5c0f77cULL}, {0xdde7001379a44aa8ULL, 0x95a8637627989aadULL},
+  {0x5560c018580d5d52ULL, 0xbb127c53b17ec159ULL}, {0xaab8f01e6e10b4a6ULL, 0xe9d71b689dde71afULL},
+  {0xcab3961304ca70e8ULL, 0x9226712162ab070dULL}, {0x3d607b97c5fd0d22ULL, 0xb6b00d69bb55c8d1ULL},
+  {0x8cb89a7db77c506aULL, 0xe45c10c42a2b3b05ULL}, {0x77f3608e92adb242ULL, 0x8eb98a7a9a5b04e3ULL},
+  {0x55f038b237591ed3ULL, 0xb267ed1940f1c61cULL}, {0x6b6c46dec52f6688ULL, 0xdf01e85f912e37a3ULL},
+  {0x2323ac4b3b3da015ULL, 0x8b61313bbabce2c6ULL}, {0xabec975e0a0d081aULL, 0xae397d8aa96c1b77ULL},
+  {0x96e7bd358c904a21ULL, 0xd9c7dced53c72255ULL}, {0x7e50d64177da2e54ULL, 0x881cea14545c7575ULL},
+  {0xdde50bd1d5d0b9e9ULL, 0xaa242499697392d2ULL}, {0x955e4ec64b44e864ULL, 0xd4ad2dbfc3d07787ULL},
+  {0xbd5af13bef0b113eULL, 0x84ec3c97da624ab4ULL}, {0xecb1ad8aeacdd58eULL, 0xa6274bbdd0fadd61ULL},
+  {0x67de18eda5814af2ULL, 0xcfb11ead453994baULL}, {0x80eacf948770ced7ULL, 0x81ceb32c4b43fcf4ULL},
+  {0xa1258379a94d028dULL, 0xa2425ff75e14fc31ULL}, {0x096ee45813a04330ULL, 0xcad2f7f5359a3b3eULL},
+  {0x8bca9d6e188853fcULL, 0xfd87b5f28300ca0dULL}, {0x775ea264cf55347dULL, 0x9e74d1b791e07e48ULL},
+  {0x95364afe032a819dULL, 0xc612062576589ddaULL}, {0x3a83ddbd83f52204ULL, 0xf79687aed3eec551ULL},
+  {0xc4926a9672793542ULL, 0x9abe14cd44753b52ULL}, {0x75b7053c0f178293ULL, 0xc16d9a0095928a27ULL},
+  {0x5324c68b12dd6338ULL, 0xf1c90080baf72cb1ULL}, {0xd3f6fc16ebca5e03ULL, 0x971da05074da7beeULL},
+  {0x88f4bb1ca6bcf584ULL, 0xbce5086492111aeaULL}, {0x2b31e9e3d06c32e5ULL, 0xec1e4a7db69561a5ULL},
+  {0x3aff322e62439fcfULL, 0x9392ee8e921d5d07ULL}, {0x09befeb9fad487c2ULL, 0xb877aa3236a4b449ULL},
+  {0x4c2ebe687989a9b3ULL, 0xe69594bec44de15bULL}, {0x0f9d37014bf60a10ULL, 0x901d7cf73ab0acd9ULL},
+  {0x538484c19ef38c94ULL, 0xb424dc35095cd80fULL}, {0x2865a5f206b06fb9ULL, 0xe12e13424bb40e13ULL},
+  {0xf93f87b7442e45d3ULL, 0x8cbccc096f5088cbULL}, {0xf78f69a51539d748ULL, 0xafebff0bcb24aafeULL},
+  {0xb573440e5a884d1bULL, 0xdbe6fecebdedd5beULL}, {0x31680a88f8953030ULL, 0x89705f4136b4a597ULL},
+  {0xfdc20d2b36ba7c3dULL, 0xabcc77118461cefcULL}, {0x3d32907604691b4cULL, 0xd6bf94d5e57a42bcULL},
+  {0xa63f9a49c2c1b10fULL, 0x8637bd05af6c69b5ULL}, {0x0fcf80dc33721d53ULL, 0xa7c5ac471b478423ULL},
+  {0xd3c36113404ea4a8ULL, 0xd1b71758e219652bULL}, {0x645a1cac083126e9ULL, 0x83126e978d4fdf3bULL},
+  {0x3d70a3d70a3d70a3ULL, 0xa3d70a3d70a3d70aULL}, {0xccccccccccccccccULL, 0xccccccccccccccccULL},
+  {0x0000000000000000ULL, 0x8000000000000000ULL}, {0x0000000000000000ULL, 0xa000000000000000ULL},
+  {0x0000000000000000ULL, 0xc800000000000000ULL}, {0x0000000000000000ULL, 0xfa00000000000000ULL},
+  {0x0000000000000000ULL, 0x9c40000000000000ULL}, {0x0000000000000000ULL, 0xc350000000000000ULL},
+  {0x0000000000000000ULL, 0xf424000000000000ULL}, {0x0000000000000000ULL, 0x9896800000000000ULL},
+  {0x0000000000000000ULL, 0xbebc200000000000ULL}, {0x0000000000000000ULL, 0xee6b280000000000ULL},
+  {0x0000000000000000ULL, 0x9502f90000000000ULL}, {0x0000000000000000ULL, 0xba43b74000000000ULL},
+  {0x0000000000000000ULL, 0xe8d4a51000000000ULL}, {0x0000000000000000ULL, 0x9184e72a00000000ULL},
+  {0x0000000000000000ULL, 0xb5e620f480000000ULL}, {0x0000000000000000ULL, 0xe35fa931a0000000ULL},
+  {0x0000000000000000ULL, 0x8e1bc9bf04000000ULL}, {0x0000000000000000ULL, 0xb1a2bc2ec5000000ULL},
+  {0x0000000000000000ULL, 0xde0b6b3a76400000ULL}, {0x0000000000000000ULL, 0x8ac7230489e80000ULL},
+  {0x0000000000000000ULL, 0xad78ebc5ac620000ULL}, {0x0000000000000000ULL, 0xd8d726b7177a8000ULL},
+  {0x0000000000000000ULL, 0x878678326eac9000ULL}, {0x0000000000000000ULL, 0xa968163f0a57b400ULL},
+  {0x0000000000000000ULL, 0xd3c21bcecceda100ULL}, {0x0000000000000000ULL, 0x84595161401484a0ULL},
+  {0x0000000000000000ULL, 0xa56fa5b99019a5c8ULL}, {0x0000000000000000ULL, 0xcecb8f27f4200f3aULL},
+  {0x4000000000000000ULL, 0x813f3978f8940984ULL}, {0x5000000000000000ULL, 0xa18f07d736b90be5ULL},
+  {0xa400000000000000ULL, 0xc9f2c9cd04674edeULL}, {0x4d00000000000000ULL, 0xfc6f7c4045812296ULL},
+  {0xf020000000000000ULL, 0x9dc5ada82b70b59dULL}, {0x6c28000000000000ULL, 0xc5371912364ce305ULL},
+  {0xc732000000000000ULL, 0xf684df56c3e01bc6ULL}, {0x3c7f400000000000ULL, 0x9a130b963a6c115cULL},
+  {0x4b9f100000000000ULL, 0xc097ce7bc90715b3ULL}, {0x1e86d40000000000ULL, 0xf0bdc21abb48db20ULL},
+  {0x1314448000000000ULL, 0x96769950b50d88f4ULL}, {0x17d955a000000000ULL, 0xbc143fa4e250eb31ULL},
+  {0x5dcfab0800000000ULL, 0xeb194f8e1ae525fdULL}, {0x5aa1cae500000000ULL, 0x92efd1b8d0cf37beULL},
+  {0xf14a3d9e40000000ULL, 0xb7abc627050305adULL}, {0x6d9ccd05d0000000ULL, 0xe596b7b0c643c719ULL},
+  {0xe4820023a2000000ULL, 0x8f7e32ce7bea5c6fULL}, {0xdda2802c8a800000ULL, 0xb35dbf821ae4f38bULL},
+  {0xd50b2037ad200000ULL, 0xe0352f62a19e306eULL}, {0x4526f422cc340000ULL, 0x8c213d9da502de45ULL},
+  {0x9670b12b7f410000ULL, 0xaf298d050e4395d6ULL}, {0x3c0cdd765f114000ULL, 0xdaf3f04651d47b4cULL},
+  {0xa5880a69fb6ac800ULL, 0x88d8762bf324cd0fULL}, {0x8eea0d047a457a00ULL, 0xab0e93b6efee0053ULL},
+  {0x72a4904598d6d880ULL, 0xd5d238a4abe98068ULL}, {0x47a6da2b7f864750ULL, 0x85a36366eb71f041ULL},
+  {0x999090b65f67d924ULL, 0xa70c3c40a64e6c51ULL}, {0xfff4b4e3f741cf6dULL, 0xd0cf4b50cfe20765ULL},
+  {0xbff8f10e7a8921a4ULL, 0x82818f1281ed449fULL}, {0xaff72d52192b6a0dULL, 0xa321f2d7226895c7ULL},
+  {0x9bf4f8a69f764490ULL, 0xcbea6f8ceb02bb39ULL}, {0x02f236d04753d5b4ULL, 0xfee50b7025c36a08ULL},
+  {0x01d762422c946590ULL, 0x9f4f2726179a2245ULL}, {0x424d3ad2b7b97ef5ULL, 0xc722f0ef9d80aad6ULL},
+  {0xd2e0898765a7deb2ULL, 0xf8ebad2b84e0d58bULL}, {0x63cc55f49f88eb2fULL, 0x9b934c3b330c8577ULL},
+  {0x3cbf6b71c76b25fbULL, 0xc2781f49ffcfa6d5ULL}, {0x8bef464e3945ef7aULL, 0xf316271c7fc3908aULL},
+  {0x97758bf0e3cbb5acULL, 0x97edd871cfda3a56ULL}, {0x3d52eeed1cbea317ULL, 0xbde94e8e43d0c8ecULL},
+  {0x4ca7aaa863ee4bddULL, 0xed63a231d4c4fb27ULL}, {0x8fe8caa93e74ef6aULL, 0x945e455f24fb1cf8ULL},
+  {0xb3e2fd538e122b44ULL, 0xb975d6b6ee39e436ULL}, {0x60dbbca87196b616ULL, 0xe7d34c64a9c85d44ULL},
+  {0xbc8955e946fe31cdULL, 0x90e40fbeea1d3a4aULL}, {0x6babab6398bdbe41ULL, 0xb51d13aea4a488ddULL},
+  {0xc696963c7eed2dd1ULL, 0xe264589a4dcdab14ULL}, {0xfc1e1de5cf543ca2ULL, 0x8d7eb76070a08aecULL},
+  {0x3b25a55f43294bcbULL, 0xb0de65388cc8ada8ULL}, {0x49ef0eb713f39ebeULL, 0xdd15fe86affad912ULL},
+  {0x6e3569326c784337ULL, 0x8a2dbf142dfcc7abULL}, {0x49c2c37f07965404ULL, 0xacb92ed9397bf996ULL},
+  {0xdc33745ec97be906ULL, 0xd7e77a8f87daf7fbULL}, {0x69a028bb3ded71a3ULL, 0x86f0ac99b4e8dafdULL},
+  {0xc40832ea0d68ce0cULL, 0xa8acd7c0222311bcULL}, {0xf50a3fa490c30190ULL, 0xd2d80db02aabd62bULL},
+  {0x792667c6da79e0faULL, 0x83c7088e1aab65dbULL}, {0x577001b891185938ULL, 0xa4b8cab1a1563f52ULL},
+  {0xed4c0226b55e6f86ULL, 0xcde6fd5e09abcf26ULL}, {0x544f8158315b05b4ULL, 0x80b05e5ac60b6178ULL},
+  {0x696361ae3db1c721ULL, 0xa0dc75f1778e39d6ULL}, {0x03bc3a19cd1e38e9ULL, 0xc913936dd571c84cULL},
+  {0x04ab48a04065c723ULL, 0xfb5878494ace3a5fULL}, {0x62eb0d64283f9c76ULL, 0x9d174b2dcec0e47bULL},
+  {0x3ba5d0bd324f8394ULL, 0xc45d1df942711d9aULL}, {0xca8f44ec7ee36479ULL, 0xf5746577930d6500ULL},
+  {0x7e998b13cf4e1ecbULL, 0x9968bf6abbe85f20ULL}, {0x9e3fedd8c321a67eULL, 0xbfc2ef456ae276e8ULL},
+  {0xc5cfe94ef3ea101eULL, 0xefb3ab16c59b14a2ULL}, {0xbba1f1d158724a12ULL, 0x95d04aee3b80ece5ULL},
+  {0x2a8a6e45ae8edc97ULL, 0xbb445da9ca61281fULL}, {0xf52d09d71a3293bdULL, 0xea1575143cf97226ULL},
+  {0x593c2626705f9c56ULL, 0x924d692ca61be758ULL}, {0x6f8b2fb00c77836cULL, 0xb6e0c377cfa2e12eULL},
+  {0x0b6dfb9c0f956447ULL, 0xe498f455c38b997aULL}, {0x4724bd4189bd5eacULL, 0x8edf98b59a373fecULL},
+  {0x58edec91ec2cb657ULL, 0xb2977ee300c50fe7ULL}, {0x2f2967b66737e3edULL, 0xdf3d5e9bc0f653e1ULL},
+  {0xbd79e0d20082ee74ULL, 0x8b865b215899f46cULL}, {0xecd8590680a3aa11ULL, 0xae67f1e9aec07187ULL},
+  {0xe80e6f4820cc9495ULL, 0xda01ee641a708de9ULL}, {0x3109058d147fdcddULL, 0x884134fe908658b2ULL},
+  {0xbd4b46f0599fd415ULL, 0xaa51823e34a7eedeULL}, {0x6c9e18ac7007c91aULL, 0xd4e5e2cdc1d1ea96ULL},
+  {0x03e2cf6bc604ddb0ULL, 0x850fadc09923329eULL}, {0x84db8346b786151cULL, 0xa6539930bf6bff45ULL},
+  {0xe612641865679a63ULL, 0xcfe87f7cef46ff16ULL}, {0x4fcb7e8f3f60c07eULL, 0x81f14fae158c5f6eULL},
+  {0xe3be5e330f38f09dULL, 0xa26da3999aef7749ULL}, {0x5cadf5bfd3072cc5ULL, 0xcb090c8001ab551cULL},
+  {0x73d9732fc7c8f7f6ULL, 0xfdcb4fa002162a63ULL}, {0x2867e7fddcdd9afaULL, 0x9e9f11c4014dda7eULL},
+  {0xb281e1fd541501b8ULL, 0xc646d63501a1511dULL}, {0x1f225a7ca91a4226ULL, 0xf7d88bc24209a565ULL},
+  {0x3375788de9b06958ULL, 0x9ae757596946075fULL}, {0x0052d6b1641c83aeULL, 0xc1a12d2fc3978937ULL},
+  {0xc0678c5dbd23a49aULL, 0xf209787bb47d6b84ULL}, {0xf840b7ba963646e0ULL, 0x9745eb4d50ce6332ULL},
+  {0xb650e5a93bc3d898ULL, 0xbd176620a501fbffULL}, {0xa3e51f138ab4cebeULL, 0xec5d3fa8ce427affULL},
+  {0xc66f336c36b10137ULL, 0x93ba47c980e98cdfULL}, {0xb80b0047445d4184ULL, 0xb8a8d9bbe123f017ULL},
+  {0xa60dc059157491e5ULL, 0xe6d3102ad96cec1dULL}, {0x87c89837ad68db2fULL, 0x9043ea1ac7e41392ULL},
+  {0x29babe4598c311fbULL, 0xb454e4a179dd1877ULL}, {0xf4296dd6fef3d67aULL, 0xe16a1dc9d8545e94ULL},
+  {0x1899e4a65f58660cULL, 0x8ce2529e2734bb1dULL}, {0x5ec05dcff72e7f8fULL, 0xb01ae745b101e9e4ULL},
+  {0x76707543f4fa1f73ULL, 0xdc21a1171d42645dULL}, {0x6a06494a791c53a8ULL, 0x899504ae72497ebaULL},
+  {0x0487db9d17636892ULL, 0xabfa45da0edbde69ULL}, {0x45a9d2845d3c42b6ULL, 0xd6f8d7509292d603ULL},
+  {0x0b8a2392ba45a9b2ULL, 0x865b86925b9bc5c2ULL}, {0x8e6cac7768d7141eULL, 0xa7f26836f282b732ULL},
+  {0x3207d795430cd926ULL, 0xd1ef0244af2364ffULL}, {0x7f44e6bd49e807b8ULL, 0x8335616aed761f1fULL},
+  {0x5f16206c9c6209a6ULL, 0xa402b9c5a8d3a6e7ULL}, {0x36dba887c37a8c0fULL, 0xcd036837130890a1ULL},
+  {0xc2494954da2c9789ULL, 0x802221226be55a64ULL}, {0xf2db9baa10b7bd6cULL, 0xa02aa96b06deb0fdULL},
+  {0x6f92829494e5acc7ULL, 0xc83553c5c8965d3dULL}, {0xcb772339ba1f17f9ULL, 0xfa42a8b73abbf48cULL},
+  {0xff2a760414536efbULL, 0x9c69a97284b578d7ULL}, {0xfef5138519684abaULL, 0xc38413cf25e2d70dULL},
+  {0x7eb258665fc25d69ULL, 0xf46518c2ef5b8cd1ULL}, {0xef2f773ffbd97a61ULL, 0x98bf2f79d5993802ULL},
+  {0xaafb550ffacfd8faULL, 0xbeeefb584aff8603ULL}, {0x95ba2a53f983cf38ULL, 0xeeaaba2e5dbf6784ULL},
+  {0xdd945a747bf26183ULL, 0x952ab45cfa97a0b2ULL}, {0x94f971119aeef9e4ULL, 0xba756174393d88dfULL},
+  {0x7a37cd5601aab85dULL, 0xe912b9d1478ceb17ULL}, {0xac62e055c10ab33aULL, 0x91abb422ccb812eeULL},
+  {0x577b986b314d6009ULL, 0xb616a12b7fe617aaULL}, {0xed5a7e85fda0b80bULL, 0xe39c49765fdf9d94ULL},
+  {0x14588f13be847307ULL, 0x8e41ade9fbebc27dULL}, {0x596eb2d8ae258fc8ULL, 0xb1d219647ae6b31cULL},
+  {0x6fca5f8ed9aef3bbULL, 0xde469fbd99a05fe3ULL}, {0x25de7bb9480d5854ULL, 0x8aec23d680043beeULL},
+  {0xaf561aa79a10ae6aULL, 0xada72ccc20054ae9ULL}, {0x1b2ba1518094da04ULL, 0xd910f7ff28069da4ULL},
+  {0x90fb44d2f05d0842ULL, 0x87aa9aff79042286ULL}, {0x353a1607ac744a53ULL, 0xa99541bf57452b28ULL},
+  {0x42889b8997915ce8ULL, 0xd3fa922f2d1675f2ULL}, {0x69956135febada11ULL, 0x847c9b5d7c2e09b7ULL},
+  {0x43fab9837e699095ULL, 0xa59bc234db398c25ULL}, {0x94f967e45e03f4bbULL, 0xcf02b2c21207ef2eULL},
+  {0x1d1be0eebac278f5ULL, 0x8161afb94b44f57dULL}, {0x6462d92a69731732ULL, 0xa1ba1ba79e1632dcULL},
+  {0x7d7b8f7503cfdcfeULL, 0xca28a291859bbf93ULL}, {0x5cda735244c3d43eULL, 0xfcb2cb35e702af78ULL},
+  {0x3a0888136afa64a7ULL, 0x9defbf01b061adabULL}, {0x088aaa1845b8fdd0ULL, 0xc56baec21c7a1916ULL},
+  {0x8aad549e57273d45ULL, 0xf6c69a72a3989f5bULL}, {0x36ac54e2f678864bULL, 0x9a3c2087a63f6399ULL},
+  {0x84576a1bb416a7ddULL, 0xc0cb28a98fcf3c7fULL}, {0x656d44a2a11c51d5ULL, 0xf0fdf2d3f3c30b9fULL},
+  {0x9f644ae5a4b1b325ULL, 0x969eb7c47859e743ULL}, {0x873d5d9f0dde1feeULL, 0xbc4665b596706114ULL},
+  {0xa90cb506d155a7eaULL, 0xeb57ff22fc0c7959ULL}, {0x09a7f12442d588f2ULL, 0x9316ff75dd87cbd8ULL},
+  {0x0c11ed6d538aeb2fULL, 0xb7dcbf5354e9beceULL}, {0x8f1668c8a86da5faULL, 0xe5d3ef282a242e81ULL},
+  {0xf96e017d694487bcULL, 0x8fa475791a569d10ULL}, {0x37c981dcc395a9acULL, 0xb38d92d760ec4455ULL},
+  {0x85bbe253f47b1417ULL, 0xe070f78d3927556aULL}, {0x93956d7478ccec8eULL, 0x8c469ab843b89562ULL},
+  {0x387ac8d1970027b2ULL, 0xaf58416654a6babbULL}, {0x06997b05fcc0319eULL, 0xdb2e51bfe9d0696aULL},
+  {0x441fece3bdf81f03ULL, 0x88fcf317f22241e2ULL}, {0xd527e81cad7626c3ULL, 0xab3c2fddeeaad25aULL},
+  {0x8a71e223d8d3b074ULL, 0xd60b3bd56a5586f1ULL}, {0xf6872d5667844e49ULL, 0x85c7056562757456ULL},
+  {0xb428f8ac016561dbULL, 0xa738c6bebb12d16cULL}, {0xe13336d701beba52ULL, 0xd106f86e69d785c7ULL},
+  {0xecc0024661173473ULL, 0x82a45b450226b39cULL}, {0x27f002d7f95d0190ULL, 0xa34d721642b06084ULL},
+  {0x31ec038df7b441f4ULL, 0xcc20ce9bd35c78a5ULL}, {0x7e67047175a15271ULL, 0xff290242c83396ceULL},
+  {0x0f0062c6e984d386ULL, 0x9f79a169bd203e41ULL}, {0x52c07b78a3e60868ULL, 0xc75809c42c684dd1ULL},
+  {0xa7709a56ccdf8a82ULL, 0xf92e0c3537826145ULL}, {0x88a66076400bb691ULL, 0x9bbcc7a142b17ccbULL},
+  {0x6acff893d00ea435ULL, 0xc2abf989935ddbfeULL}, {0x0583f6b8c4124d43ULL, 0xf356f7ebf83552feULL},
+  {0xc3727a337a8b704aULL, 0x98165af37b2153deULL}, {0x744f18c0592e4c5cULL, 0xbe1bf1b059e9a8d6ULL},
+  {0x1162def06f79df73ULL, 0xeda2ee1c7064130cULL}, {0x8addcb5645ac2ba8ULL, 0x9485d4d1c63e8be7ULL},
+  {0x6d953e2bd7173692ULL, 0xb9a74a0637ce2ee1ULL}, {0xc8fa8db6ccdd0437ULL, 0xe8111c87c5c1ba99ULL},
+  {0x1d9c9892400a22a2ULL, 0x910ab1d4db9914a0ULL}, {0x2503beb6d00cab4bULL, 0xb54d5e4a127f59c8ULL},
+  {0x2e44ae64840fd61dULL, 0xe2a0b5dc971f303aULL}, {0x5ceaecfed289e5d2ULL, 0x8da471a9de737e24ULL},
+  {0x7425a83e872c5f47ULL, 0xb10d8e1456105dadULL}, {0xd12f124e28f77719ULL, 0xdd50f1996b947518ULL},
+  {0x82bd6b70d99aaa6fULL, 0x8a5296ffe33cc92fULL}, {0x636cc64d1001550bULL, 0xace73cbfdc0bfb7bULL},
+  {0x3c47f7e05401aa4eULL, 0xd8210befd30efa5aULL}, {0x65acfaec34810a71ULL, 0x8714a775e3e95c78ULL},
+  {0x7f1839a741a14d0dULL, 0xa8d9d1535ce3b396ULL}, {0x1ede48111209a050ULL, 0xd31045a8341ca07cULL},
+  {0x934aed0aab460432ULL, 0x83ea2b892091e44dULL}, {0xf81da84d5617853fULL, 0xa4e4b66b68b65d60ULL},
+  {0x36251260ab9d668eULL, 0xce1de40642e3f4b9ULL}, {0xc1d72b7c6b426019ULL, 0x80d2ae83e9ce78f3ULL},
+  {0xb24cf65b8612f81fULL, 0xa1075a24e4421730ULL}, {0xdee033f26797b627ULL, 0xc94930ae1d529cfcULL},
+  {0x169840ef017da3b1ULL, 0xfb9b7cd9a4a7443cULL}, {0x8e1f289560ee864eULL, 0x9d412e0806e88aa5ULL},
+  {0xf1a6f2bab92a27e2ULL, 0xc491798a08a2ad4eULL}, {0xae10af696774b1dbULL, 0xf5b5d7ec8acb58a2ULL},
+  {0xacca6da1e0a8ef29ULL, 0x9991a6f3d6bf1765ULL}, {0x17fd090a58d32af3ULL, 0xbff610b0cc6edd3fULL},
+  {0xddfc4b4cef07f5b0ULL, 0xeff394dcff8a948eULL}, {0x4abdaf101564f98eULL, 0x95f83d0a1fb69cd9ULL},
+  {0x9d6d1ad41abe37f1ULL, 0xbb764c4ca7a4440fULL}, {0x84c86189216dc5edULL, 0xea53df5fd18d5513ULL},
+  {0x32fd3cf5b4e49bb4ULL, 0x92746b9be2f8552cULL}, {0x3fbc8c33221dc2a1ULL, 0xb7118682dbb66a77ULL},
+  {0x0fabaf3feaa5334aULL, 0xe4d5e82392a40515ULL}, {0x29cb4d87f2a7400eULL, 0x8f05b1163ba6832dULL},
+  {0x743e20e9ef511012ULL, 0xb2c71d5bca9023f8ULL}, {0x914da9246b255416ULL, 0xdf78e4b2bd342cf6ULL},
+  {0x1ad089b6c2f7548eULL, 0x8bab8eefb6409c1aULL}, {0xa184ac2473b529b1ULL, 0xae9672aba3d0c320ULL},
+  {0xc9e5d72d90a2741eULL, 0xda3c0f568cc4f3e8ULL}, {0x7e2fa67c7a658892ULL, 0x8865899617fb1871ULL},
+  {0xddbb901b98feeab7ULL, 0xaa7eebfb9df9de8dULL}, {0x552a74227f3ea565ULL, 0xd51ea6fa85785631ULL},
+  {0xd53a88958f87275fULL, 0x8533285c936b35deULL}, {0x8a892abaf368f137ULL, 0xa67ff273b8460356ULL},
+  {0x2d2b7569b0432d85ULL, 0xd01fef10a657842cULL}, {0x9c3b29620e29fc73ULL, 0x8213f56a67f6b29bULL},
+  {0x8349f3ba91b47b8fULL, 0xa298f2c501f45f42ULL}, {0x241c70a936219a73ULL, 0xcb3f2f7642717713ULL},
+  {0xed238cd383aa0110ULL, 0xfe0efb53d30dd4d7ULL}, {0xf4363804324a40aaULL, 0x9ec95d1463e8a506ULL},
+  {0xb143c6053edcd0d5ULL, 0xc67bb4597ce2ce48ULL}, {0xdd94b7868e94050aULL, 0xf81aa16fdc1b81daULL},
+  {0xca7cf2b4191c8326ULL, 0x9b10a4e5e9913128ULL}, {0xfd1c2f611f63a3f0ULL, 0xc1d4ce1f63f57d72ULL},
+  {0xbc633b39673c8cecULL, 0xf24a01a73cf2dccfULL}, {0xd5be0503e085d813ULL, 0x976e41088617ca01ULL},
+  {0x4b2d8644d8a74e18ULL, 0xbd49d14aa79dbc82ULL}, {0xddf8e7d60ed1219eULL, 0xec9c459d51852ba2ULL},
+  {0xcabb90e5c942b503ULL, 0x93e1ab8252f33b45ULL}, {0x3d6a751f3b936243ULL, 0xb8da1662e7b00a17ULL},
+  {0x0cc512670a783ad4ULL, 0xe7109bfba19c0c9dULL}, {0x27fb2b80668b24c5ULL, 0x906a617d450187e2ULL},
+  {0xb1f9f660802dedf6ULL, 0xb484f9dc9641e9daULL}, {0x5e7873f8a0396973ULL, 0xe1a63853bbd26451ULL},
+  {0xdb0b487b6423e1e8ULL, 0x8d07e33455637eb2ULL}, {0x91ce1a9a3d2cda62ULL, 0xb049dc016abc5e5fULL},
+  {0x7641a140cc7810fbULL, 0xdc5c5301c56b75f7ULL}, {0xa9e904c87fcb0a9dULL, 0x89b9b3e11b6329baULL},
+  {0x546345fa9fbdcd44ULL, 0xac2820d9623bf429ULL}, {0xa97c177947ad4095ULL, 0xd732290fbacaf133ULL},
+  {0x49ed8eabcccc485dULL, 0x867f59a9d4bed6c0ULL}, {0x5c68f256bfff5a74ULL, 0xa81f301449ee8c70ULL},
+  {0x73832eec6fff3111ULL, 0xd226fc195c6a2f8cULL}, {0xc831fd53c5ff7eabULL, 0x83585d8fd9c25db7ULL},
+  {0xba3e7ca8b77f5e55ULL, 0xa42e74f3d032f525ULL}, {0x28ce1bd2e55f35ebULL, 0xcd3a1230c43fb26fULL},
+  {0x7980d163cf5b81b3ULL, 0x80444b5e7aa7cf85ULL}, {0xd7e105bcc332621fULL, 0xa0555e361951c366ULL},
+  {0x8dd9472bf3fefaa7ULL, 0xc86ab5c39fa63440ULL}, {0xb14f98f6f0feb951ULL, 0xfa856334878fc150ULL},
+  {0x6ed1bf9a569f33d3ULL, 0x9c935e00d4b9d8d2ULL}, {0x0a862f80ec4700c8ULL, 0xc3b8358109e84f07ULL},
+  {0xcd27bb612758c0faULL, 0xf4a642e14c6262c8ULL}, {0x8038d51cb897789cULL, 0x98e7e9cccfbd7dbdULL},
+  {0xe0470a63e6bd56c3ULL, 0xbf21e44003acdd2cULL}, {0x1858ccfce06cac74ULL, 0xeeea5d5004981478ULL},
+  {0x0f37801e0c43ebc8ULL, 0x95527a5202df0ccbULL}, {0xd30560258f54e6baULL, 0xbaa718e68396cffdULL},
+  {0x47c6b82ef32a2069ULL, 0xe950df20247c83fdULL}, {0x4cdc331d57fa5441ULL, 0x91d28b7416cdd27eULL},
+  {0xe0133fe4adf8e952ULL, 0xb6472e511c81471dULL}, {0x58180fddd97723a6ULL, 0xe3d8f9e563a198e5ULL},
+  {0x570f09eaa7ea7648ULL, 0x8e679c2f5e44ff8fULL}
+};
+
+static const double JSON_POW10_EXACT[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Every byte of _w is an ASCII digit
+static char json_swar_isEightDigits(uint64_t _w) {
+  return (((_w + 0x4646464646464646ULL) | (_w - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
+}
 
-  json_string_ltrim(_enc);
+// Eight ASCII digits, first digit in the lowest byte, to their value
+static uint32_t json_swar_eightDigits(uint64_t _w) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+  _w -= 0x3030303030303030ULL;
+  _w = (_w * 10) + (_w >> 8);
+  _w = (((_w & mask) * mul1) + (((_w >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)_w;
+}
 
-  if (_enc->current == NULL) {
-    return NULL;
+static size_t json_parse_digits(const char* _str, size_t _len, size_t _pos, uint64_t* _mantissa) {
+  uint64_t m = *_mantissa;
+  while (_len - _pos >= 8) {
+    uint64_t w = json_swar_load(_str + _pos);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    if (json_swar_isEightDigits(w) == 0) {
+      break;
+    }
+    m = m * 100000000 + json_swar_eightDigits(w);
+    _pos += 8;
+  }
+
+  while (_pos < _len && json_is_digit(_str[_pos])) {
+    m = m * 10 + (uint64_t)(_str[_pos] - '0');
+    _pos++;
   }
 
+  *_mantissa = m;
+  return _pos;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static char json_scan_number(const char* _str, size_t _len, JsonNumberText* _n) {
   size_t pos = 0;
-  char negative = _enc->current[0] == '-' ? 1 : 0;
-  if (negative == 1) {
+  _n->mantissa = 0;
+  _n->exponent = 0;
+  _n->negative = 0;
+  _n->truncated = 0;
+  _n->integer = 1;
+
+  if (pos < _len && _str[pos] == '-') {
+    _n->negative = 1;
     pos++;
   }
 
-  if (json_is_digit(_enc->current[pos]) == 0) {
-    return NULL;
+  size_t start = pos;
+  if (pos >= _len || json_is_digit(_str[pos]) == 0) {
+    return 0;
   }
 
-  double value = 0;
-  char fraction = 0;
-  while (_enc->length > pos) {
-    if (json_is_digit(_enc->current[pos]) == 1) {
-      value = value*10 + _enc->current[pos] - '0';
-      if (fraction) {
-	fraction++;
-      }
+  if (_str[pos] == '0') {
+    pos++;
+    if (pos < _len && json_is_digit(_str[pos])) {
+      return 0;
     }
-    else if (_enc->current[pos] == '.') {
-      if (fraction != 0) {
-	return NULL;
-      }
+  }
+  else {
+    pos = json_parse_digits(_str, _len, pos, &_n->mantissa);
+  }
+  size_t digits = pos - start;
 
-      fraction++;
-    }
-    else {
-      break;
+  if (pos < _len && _str[pos] == '.') {
+    pos++;
+    size_t fraction = pos;
+    pos = json_parse_digits(_str, _len, pos, &_n->mantissa);
+    if (pos == fraction) {
+      return 0;
     }
+    digits += pos - fraction;
+    _n->exponent = -(int64_t)(pos - fraction);
+    _n->integer = 0;
+  }
 
+  if (pos < _len && (_str[pos] == 'e' || _str[pos] == 'E')) {
     pos++;
-  }
+    _n->integer = 0;
+    char negative = 0;
+    if (pos < _len && (_str[pos] == '+' || _str[pos] == '-')) {
+      negative = _str[pos] == '-';
+      pos++;
+    }
 
-  json_move_stream(_enc, pos);
+    if (pos >= _len || json_is_digit(_str[pos]) == 0) {
+      return 0;
+    }
 
-  if (fraction--) {
-    while(fraction--) {
-      value /= 10;
+    // Anything this large is zero or infinity anyway
+    int64_t exp = 0;
+    while (pos < _len && json_is_digit(_str[pos])) {
+      if (exp < 100000) {
+	exp = exp * 10 + (_str[pos] - '0');
+      }
+      pos++;
     }
+    _n->exponent += negative ? -exp : exp;
   }
 
-  if (negative) {
-    value *= -1.0;
+  // Leading zeros of 0.000123 don't count against the 19 digits
+  if (digits > 19) {
+    size_t zeros = 0;
+    for (size_t i = start; i < pos && (_str[i] == '0' || _str[i] == '.'); i++) {
+      zeros += _str[i] == '0';
+    }
+    _n->truncated = digits - zeros > 19;
+
+    // 20 digit integers up to 2^64 - 1 wrap back to their exact value
+    if (_n->integer && digits == 20 && memcmp(_str + start, "18446744073709551615", 20) <= 0) {
+      _n->truncated = 0;
+    }
   }
 
-  JsonNumber* num = malloc(sizeof(JsonNumber));
-  num->value = value;
-  return num;
+  _n->length = pos;
+  return 1;
 }
 
-// false or true
-static const char TRUE_STR[] = "true";
-static const char FALSE_STR[] = "false";
-static JsonBool* json_decode_bool(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
-    return NULL;
-  }
+static double json_double_fromBits(uint64_t _bits) {
+  double d;
+  memcpy(&d, &_bits, sizeof(d));
+  return d;
+}
 
-  json_string_ltrim(_enc);
+static uint64_t json_mul128(uint64_t _a, uint64_t _b, uint64_t* _lo) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)_a * _b;
+  *_lo = (uint64_t)r;
+  return (uint64_t)(r >> 64);
+#else
+  const uint64_t M32 = 0xFFFFFFFFu;
+  uint64_t a = _a >> 32, b = _a & M32;
+  uint64_t c = _b >> 32, d = _b & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t mid = (bd >> 32) + (ad & M32) + (bc & M32);
+  *_lo = (mid << 32) | (bd & M32);
+  return ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+#endif
+}
 
-  if (_enc->current == NULL) {
-    return NULL;
+static int json_clz64(uint64_t _x) {
+#if defined(__GNUC__)
+  return __builtin_clzll(_x);
+#else
+  int n = 0;
+  while ((_x & ((uint64_t)1 << 63)) == 0) {
+    _x <<= 1;
+    n++;
   }
+  return n;
+#endif
+}
 
-  char type = _enc->current[0];
-  if (type != 't' && type != 'f') {
-    return NULL;
+// Eisel-Lemire, 0 when the product is too close to a rounding boundary
+static char json_eisel_lemire(uint64_t _m, int64_t _exp10, unsigned char _negative, double* _out) {
+  uint64_t sign = _negative ? (uint64_t)1 << 63 : 0;
+
+  // Even 2^64 * 10^-343 rounds to zero, 10^309 is past the largest double
+  if (_exp10 < JSON_POW10_MIN) {
+    *_out = json_double_fromBits(sign);
+    return 1;
+  }
+  if (_exp10 > JSON_POW10_MAX) {
+    *_out = json_double_fromBits(sign | 0x7FF0000000000000ULL);
+    return 1;
   }
 
-  if (type == 't') {
-    if (_enc->length < 4) {
-      return NULL;
+  int clz = json_clz64(_m);
+  _m <<= clz;
+  uint64_t exp2 = (uint64_t)(((217706 * _exp10) >> 16) + 64 + 1023) - (uint64_t)clz;
+
+  const uint64_t* pow10 = JSON_POW10_128[_exp10 - JSON_POW10_MIN];
+  uint64_t lo;
+  uint64_t hi = json_mul128(_m, pow10[1], &lo);
+
+  // The truncated power may have cost a carry into the bits we keep
+  if ((hi & 0x1FF) == 0x1FF && lo + _m < _m) {
+    uint64_t yLo;
+    uint64_t yHi = json_mul128(_m, pow10[0], &yLo);
+    uint64_t mergedHi = hi;
+    uint64_t mergedLo = lo + yHi;
+    if (mergedLo < lo) {
+      mergedHi++;
     }
-  }
-  else if(_enc->length < 5) {
-    return NULL;
+    if ((mergedHi & 0x1FF) == 0x1FF && mergedLo + 1 == 0 && yLo + _m < _m) {
+      return 0;
+    }
+    hi = mergedHi;
+    lo = mergedLo;
   }
 
-  const char* B = type == 't' ? TRUE_STR : FALSE_STR;
-  size_t pos = type == 't' ? 4 : 5;
-  size_t end = pos;
-  while (pos--) {
-    if (_enc->current[pos] != B[pos]) {
-      return NULL;
-    }
+  uint64_t msb = hi >> 63;
+  uint64_t mantissa = hi >> (msb + 9);
+  exp2 -= 1 ^ msb;
+
+  // Exactly half way, ties to even needs the full value
+  if (lo == 0 && (hi & 0x1FF) == 0 && (mantissa & 3) == 1) {
+    return 0;
   }
 
-  JsonBool* bol = malloc(sizeof(JsonBool));
-  bol->value = type == 't' ? 1 : 0;
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >> 53) {
+    mantissa >>= 1;
+    exp2++;
+  }
 
-  json_move_stream(_enc, end);
+  // Subnormal or overflow, leave it to the exact path
+  if (exp2 - 1 >= 0x7FF - 1) {
+    return 0;
+  }
 
-  return bol;
+  *_out = json_double_fromBits(sign | (exp2 << 52) | (mantissa & 0x000FFFFFFFFFFFFFULL));
+  return 1;
 }
 
-// null
-static const char NULL_STR[] = "null";
-static JsonNull* json_decode_null(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+// Exact fallback: the digits as a big decimal 0.d[0]d[1]... * 10^point,
+// scaled by powers of two until the mantissa bits can be read off.
+// Needs no locale and no allocation.
+#define JSON_DECIMAL_DIGITS 800
+#define JSON_DECIMAL_SHIFT 60
+
+typedef struct {
+  unsigned char digits[JSON_DECIMAL_DIGITS];
+  int count;
+  int point;
+  int limit; // Digits kept, fewer only where a close value will do
+  unsigned char truncated; // Nonzero digits were dropped past the limit
+} JsonDecimal;
+
+static void json_decimal_trim(JsonDecimal* _dec) {
+  while (_dec->count > 0 && _dec->digits[_dec->count - 1] == 0) {
+    _dec->count--;
+  }
+  if (_dec->count == 0) {
+    _dec->point = 0;
   }
+}
 
-  json_string_ltrim(_enc);
+// Reads text already validated by json_scan_number
+static void json_decimal_parse(JsonDecimal* _dec, const char* _str, size_t _length) {
+  size_t pos = 0;
+  char dot = 0;
+  _dec->count = 0;
+  _dec->point = 0;
+  _dec->limit = JSON_DECIMAL_DIGITS;
+  _dec->truncated = 0;
 
-  if (_enc->current == NULL) {
-    return NULL;
+  if (pos < _length && _str[pos] == '-') {
+    pos++;
   }
-
-  if (_enc->current[0] != 'n' || _enc->length < 4) {
-    return NULL;
+  for (; pos < _length; pos++) {
+    char c = _str[pos];
+    if (c == '.') {
+      dot = 1;
+      _dec->point = _dec->count;
+      continue;
+    }
+    if (c < '0' || c > '9') {
+      break;
+    }
+    if (c == '0' && _dec->count == 0) {
+      // Leading zeros only move the point
+      _dec->point--;
+      continue;
+    }
+    if (_dec->count < JSON_DECIMAL_DIGITS) {
+      _dec->digits[_dec->count++] = (unsigned char)(c - '0');
+    }
+    else if (c != '0') {
+      _dec->truncated = 1;
+    }
+  }
+  if (dot == 0) {
+    _dec->point = _dec->count;
   }
 
-  size_t pos = 4;
-  while (pos--) {
-    if (_enc->current[pos] != NULL_STR[pos]) {
-      return NULL;
+  if (pos < _length && (_str[pos] == 'e' || _str[pos] == 'E')) {
+    int sign = 1, e = 0;
+    pos++;
+    if (_str[pos] == '-' || _str[pos] == '+') {
+      sign = _str[pos] == '-' ? -1 : 1;
+      pos++;
+    }
+    for (; pos < _length; pos++) {
+      // Anything past 10000 is zero or infinity anyway
+      if (e < 10000) {
+	e = e * 10 + (_str[pos] - '0');
+      }
     }
+    _dec->point += sign * e;
   }
+  json_decimal_trim(_dec);
+}
 
-  json_move_stream(_enc, 4);
+static void json_decimal_shiftLeft(JsonDecimal* _dec, int _k) {
+  // 2^60 adds at most 19 digits, built from the right end
+  unsigned char out[JSON_DECIMAL_DIGITS + 19];
+  int w = _dec->count + 18;
+  uint64_t n = 0;
+  for (int r = _dec->count - 1; r >= 0; r--) {
+    n += (uint64_t)_dec->digits[r] << _k;
+    uint64_t q = n / 10;
+    out[w--] = (unsigned char)(n - 10 * q);
+    n = q;
+  }
+  while (n > 0) {
+    uint64_t q = n / 10;
+    out[w--] = (unsigned char)(n - 10 * q);
+    n = q;
+  }
 
-  JsonNull* nul = malloc(sizeof(JsonNull));
-  nul->value = 0;
-  return nul;
+  int total = _dec->count + 18 - w;
+  int keep = total < _dec->limit ? total : _dec->limit;
+  for (int i = keep; i < total; i++) {
+    if (out[w + 1 + i] != 0) {
+      _dec->truncated = 1;
+    }
+  }
+  memcpy(_dec->digits, out + w + 1, (size_t)keep);
+  _dec->point += total - _dec->count;
+  _dec->count = keep;
+  json_decimal_trim(_dec);
 }
 
-// Object
-static void json_free_objectAttribute(JsonObjectAttribute* _attr) {
-  if (_attr == NULL) {
-    return;
+static void json_decimal_shiftRight(JsonDecimal* _dec, int _k) {
+  const uint64_t mask = ((uint64_t)1 << _k) - 1;
+  int r = 0, w = 0;
+  uint64_t n = 0;
+
+  // Enough leading digits for the first quotient digit
+  for (; (n >> _k) == 0; r++) {
+    if (r >= _dec->count) {
+      if (n == 0) {
+	_dec->count = 0;
+	_dec->point = 0;
+	return;
+      }
+      while ((n >> _k) == 0) {
+	n *= 10;
+	r++;
+      }
+      break;
+    }
+    n = n * 10 + _dec->digits[r];
   }
+  _dec->point -= r - 1;
 
-  json_free_string(_attr->name);
-  json_free(_attr->data);
-  free(_attr);
+  for (; r < _dec->count; r++) {
+    unsigned char c = _dec->digits[r];
+    _dec->digits[w++] = (unsigned char)(n >> _k);
+    n = (n & mask) * 10 + c;
+  }
+  while (n > 0) {
+    if (w >= _dec->limit) {
+      // What is left is nonzero
+      _dec->truncated = 1;
+      break;
+    }
+    _dec->digits[w++] = (unsigned char)(n >> _k);
+    n = (n & mask) * 10;
+  }
+  _dec->count = w;
+  json_decimal_trim(_dec);
 }
 
-static JsonObjectAttribute* json_decode_objectAttribute(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+static void json_decimal_shift(JsonDecimal* _dec, int _k) {
+  if (_dec->count == 0) {
+    return;
   }
+  while (_k > JSON_DECIMAL_SHIFT) {
+    json_decimal_shiftLeft(_dec, JSON_DECIMAL_SHIFT);
+    _k -= JSON_DECIMAL_SHIFT;
+  }
+  while (_k < -JSON_DECIMAL_SHIFT) {
+    json_decimal_shiftRight(_dec, JSON_DECIMAL_SHIFT);
+    _k += JSON_DECIMAL_SHIFT;
+  }
+  if (_k > 0) {
+    json_decimal_shiftLeft(_dec, _k);
+  }
+  else if (_k < 0) {
+    json_decimal_shiftRight(_dec, -_k);
+  }
+}
 
-  json_string_ltrim(_enc);
-
-  if (_enc->current[0] != JSON_STRING) {
-    return NULL;
+// Integer part, rounded half to even with the dropped digits as sticky bits
+static uint64_t json_decimal_round(const JsonDecimal* _dec) {
+  uint64_t n = 0;
+  int i = 0;
+  for (; i < _dec->point && i < _dec->count; i++) {
+    n = n * 10 + _dec->digits[i];
+  }
+  for (; i < _dec->point; i++) {
+    n *= 10;
   }
 
-  // Get key
-  JsonObjectAttribute* attr = malloc(sizeof(JsonObjectAttribute));
-  attr->next = NULL;
-  attr->name = json_decode_string(_enc);
-  if (attr->name == NULL) {
-    goto clean;
+  char up = 0;
+  if (_dec->point >= 0 && _dec->point < _dec->count) {
+    unsigned char next = _dec->digits[_dec->point];
+    if (next == 5 && _dec->point + 1 == _dec->count && _dec->truncated == 0) {
+      up = n & 1;
+    }
+    else {
+      up = next >= 5;
+    }
   }
+  return n + (uint64_t)up;
+}
 
-  // Search for :
-  ssize_t colon_pos = json_string_indexOf(':', _enc->current, _enc->length, 0);
-  if (colon_pos < 0) {
-    goto clean;
+static double json_decimal_value(const char* _str, size_t _length, unsigned char _negative) {
+  // Binary exponents covered by one shift for a given decimal point
+  static const unsigned char POW2_FOR_POINT[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+  const int count = (int)(sizeof(POW2_FOR_POINT) / sizeof(POW2_FOR_POINT[0]));
+  uint64_t sign = _negative ? (uint64_t)1 << 63 : 0;
+  JsonDecimal dec;
+  json_decimal_parse(&dec, _str, _length);
+
+  if (dec.count == 0 || dec.point < -330) {
+    return json_double_fromBits(sign);
+  }
+  if (dec.point > 310) {
+    return json_double_fromBits(sign | 0x7FF0000000000000ULL);
   }
 
-  json_move_stream(_enc, colon_pos + 1);
+  // Scale into [1/2, 1) and count the powers of two taken out
+  int exp2 = 0;
+  while (dec.point > 0) {
+    int k = dec.point >= count ? 27 : POW2_FOR_POINT[dec.point];
+    json_decimal_shift(&dec, -k);
+    exp2 += k;
+  }
+  while (dec.point < 0 || (dec.point == 0 && dec.digits[0] < 5)) {
+    int k = -dec.point >= count ? 27 : POW2_FOR_POINT[-dec.point];
+    json_decimal_shift(&dec, k);
+    exp2 -= k;
+  }
 
-  // Get Value
-  attr->data = json_decode_value(_enc);
-  if (attr->data == NULL) {
-    goto clean;
+  // Now [1, 2) times 2^exp2, subnormals give up mantissa bits
+  exp2--;
+  if (exp2 < -1022) {
+    json_decimal_shift(&dec, exp2 + 1022);
+    exp2 = -1022;
+  }
+  if (exp2 > 1023) {
+    return json_double_fromBits(sign | 0x7FF0000000000000ULL);
   }
 
-  return attr;
+  json_decimal_shift(&dec, 53);
+  uint64_t mantissa = json_decimal_round(&dec);
+  if (mantissa == (uint64_t)1 << 53) {
+    mantissa >>= 1;
+    exp2++;
+    if (exp2 > 1023) {
+      return json_double_fromBits(sign | 0x7FF0000000000000ULL);
+    }
+  }
 
- clean:
-  json_free_objectAttribute(attr);
-  return NULL;
+  uint64_t biased = (mantissa >> 52) ? (uint64_t)(exp2 + 1023) : 0;
+  return json_double_fromBits(sign | (biased << 52) | (mantissa & 0x000FFFFFFFFFFFFFULL));
 }
 
-void json_add_objectAttribute(JsonObject* _obj, JsonObjectAttribute* _attr) {
-  if (_obj->first == NULL) {
-    _obj->first = _attr;
-  }
-  else {
-    _obj->last->next = _attr;
+// Correctly rounded value of the text scanned into _n
+static double json_number_value(const char* _str, const JsonNumberText* _n) {
+  double d;
+  if (_n->truncated == 0) {
+    if (_n->mantissa == 0) {
+      return _n->negative ? -0.0 : 0.0;
+    }
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+    // Both operands are exact doubles, one rounding gives the exact result
+    if (_n->mantissa <= ((uint64_t)1 << 53) && _n->exponent >= -22 && _n->exponent <= 22) {
+      d = (double)_n->mantissa;
+      if (_n->exponent < 0) {
+	d /= JSON_POW10_EXACT[-_n->exponent];
+      }
+      else {
+	d *= JSON_POW10_EXACT[_n->exponent];
+      }
+      return _n->negative ? -d : d;
+    }
+#endif
+
+    if (json_eisel_lemire(_n->mantissa, _n->exponent, _n->negative, &d)) {
+      return d;
+    }
   }
 
-  _obj->last = _attr;
-  _obj->length++;
+  return json_decimal_value(_str, _n->length, _n->negative);
 }
 
-
-static void json_free_object(JsonObject* _obj) {
-  if (_obj == NULL) {
-    return;
+// Scalars are written straight into the value
+static char json_decode_number(JsonStream* _enc, JsonValue* _v) {
+  if (_enc == NULL || _enc->length == 0) {
+    return 0;
   }
 
-  for (size_t i = 0; i < _obj->length; i++) {
-    JsonObjectDataNode* node = _obj->object[i];
-    JsonObjectDataNode* node2 = NULL;
-    if (node != NULL) {
-      node2 = node->next;
-      free(node);
-    }
+  json_string_ltrim(_enc);
 
-    while (node2 != NULL) {
-      node = node2->next;
-      free(node2);
-      node2 = node;
-    }
+  if (_enc->current == NULL) {
+    return 0;
   }
 
-  if (_obj->length) {
-    free(_obj->object);
+  JsonNumberText n;
+  if (json_scan_number(_enc->current, _enc->length, &n) == 0) {
+    return 0;
   }
 
-  JsonObjectAttribute* attr = _obj->first;
-  JsonObjectAttribute* attr2;
-  while (attr) {
-    attr2 = attr;
-    attr = attr->next;
-    json_free_objectAttribute(attr2);
+  // Integers keep every digit when they fit, -0 stays a double
+  _v->flags = 0;
+  if (n.integer && n.truncated == 0 && n.mantissa != 0) {
+    if (n.negative == 0 && n.mantissa <= INT64_MAX) {
+      _v->flags = JSON_INT64;
+      _v->integer = (int64_t)n.mantissa;
+    }
+    else if (n.negative == 0) {
+      _v->flags = JSON_UINT64;
+      _v->uinteger = n.mantissa;
+    }
+    else if (n.mantissa <= (uint64_t)INT64_MAX + 1) {
+      _v->flags = JSON_INT64;
+      _v->integer = (int64_t)(0 - n.mantissa);
+    }
+  }
+  else if (n.integer && n.truncated == 0 && n.negative == 0) {
+    _v->flags = JSON_INT64;
+    _v->integer = 0;
   }
 
-  free(_obj);
+  if (_v->flags == 0) {
+    _v->number = json_number_value(_enc->current, &n);
+  }
+  json_move_stream(_enc, n.length);
+  return 1;
 }
 
-static JsonObject* json_decode_object(JsonStream* _enc) {
+// false or true
+static const char TRUE_STR[] = "true";
+static const char FALSE_STR[] = "false";
+static char json_decode_bool(JsonStream* _enc, JsonValue* _v) {
   if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+    return 0;
   }
 
   json_string_ltrim(_enc);
 
   if (_enc->current == NULL) {
-    return NULL;
+    return 0;
   }
 
-  if (_enc->current[0] != JSON_OBJECT) {
-    return NULL;
+  char type = json_stream_peek(_enc);
+  if (type != 't' && type != 'f') {
+    return 0;
   }
 
-  json_move_stream(_enc, 1);
-  json_string_ltrim(_enc);
-
-  JsonObject* obj = malloc(sizeof(JsonObject));
-  obj->first = NULL;
-  obj->last = NULL;
-  obj->object = NULL;
-  obj->length = 0;
-
-  while (_enc->current[0] != JSON_OBJECT_END) {
-    JsonObjectAttribute* attr = json_decode_objectAttribute(_enc);
-    if (attr == NULL) {
-      goto clean;
+  if (type == 't') {
+    if (_enc->length < 4) {
+      return 0;
     }
-    json_add_objectAttribute(obj, attr);
+  }
+  else if(_enc->length < 5) {
+    return 0;
+  }
 
-    json_string_ltrim(_enc);
-    if (_enc->current[0] == ',') {
-      json_move_stream(_enc, 1);
-    }
-    else if (_enc->current[0] != JSON_OBJECT_END) {
-      goto clean;
+  const char* B = type == 't' ? TRUE_STR : FALSE_STR;
+  size_t pos = type == 't' ? 4 : 5;
+  size_t end = pos;
+  while (pos--) {
+    if (_enc->current[pos] != B[pos]) {
+      return 0;
     }
   }
 
-  json_move_stream(_enc, 1);
+  _v->boolean = type == 't' ? 1 : 0;
 
-  // Generate the hash map
-  if (obj->length) {
-    obj->object = malloc(sizeof(JsonObjectDataNode*) * obj->length);
-    JsonObjectAttribute* node = obj->first;
-    size_t i;
+  json_move_stream(_enc, end);
 
-    // Init array without using memset
-    for (i = 0; i < obj->length; i++) {
-      obj->object[i] = NULL;
-    }
+  return 1;
+}
 
-    JsonObjectDataNode* node2;
-    JsonObjectDataNode* node3;
-    while (node) {
-      i = json_string_hash(node->name->value, node->name->length) % obj->length;
+// null
+static const char NULL_STR[] = "null";
+static char json_decode_null(JsonStream* _enc, JsonValue* _v) {
+  if (_enc == NULL || _enc->length == 0) {
+    return 0;
+  }
 
-      node3 = malloc(sizeof(JsonObjectDataNode));
-      node3->attribute = node;
-      node3->next = NULL;
+  json_string_ltrim(_enc);
 
+  if (_enc->current == NULL) {
+    return 0;
+  }
 
-      node2 = obj->object[i];
-      if (node2 == NULL) {
-	obj->object[i] = node3;
-      }
-      else {
-	while (node2->next) {
-	  node2 = node2->next;
-	}
-	node2->next = node3;
-      }
+  if (json_stream_peek(_enc) != 'n' || _enc->length < 4) {
+    return 0;
+  }
 
-      node = node->next;
+  size_t pos = 4;
+  while (pos--) {
+    if (_enc->current[pos] != NULL_STR[pos]) {
+      return 0;
     }
   }
 
-  return obj;
+  json_move_stream(_enc, 4);
 
- clean:
-  json_free_object(obj);
-  return NULL;
+  _v->data = NULL;
+  return 1;
 }
 
-static JsonObjectAttribute* json_get_objectAttribute(const JsonObject* _obj, const char* _name, size_t _len) {
-  if (_obj == NULL) {
-    return NULL;
-  }
+/*************
+ ** SCRATCH **
+ *************/
 
-  if (_len < 1) {
-    return NULL;
+// Children of the containers being decoded pile up on the stream scratch
+// stack. A container that closes moves its run into one block of the exact
+// size and pops it, so nested containers never fight over the space.
+static char json_scratch_push(JsonStream* _enc, const void* _item, size_t _size) {
+  if (_enc->scratchLength + _size > _enc->scratchCapacity) {
+    size_t capacity = _enc->scratchCapacity ? _enc->scratchCapacity * 2 : 1024;
+    while (capacity < _enc->scratchLength + _size) {
+      capacity *= 2;
+    }
+
+    char* scratch = realloc(_enc->scratch, capacity);
+    if (scratch == NULL) {
+      return 0;
+    }
+    _enc->scratch = scratch;
+    _enc->scratchCapacity = capacity;
   }
 
-  if (_obj->length == 0) {
+  memcpy(_enc->scratch + _enc->scratchLength, _item, _size);
+  _enc->scratchLength += _size;
+  return 1;
+}
+
+// Move everything above _base out of the scratch, NULL when there is nothing
+static void* json_scratch_pop(JsonStream* _enc, size_t _base) {
+  size_t size = _enc->scratchLength - _base;
+  if (size == 0) {
     return NULL;
   }
 
-  size_t i = json_string_hash(_name, _len) % _obj->length;
-  JsonObjectDataNode* node = _obj->object[i];
-  while (node) {
-    if (json_equal_strings(node->attribute->name->value, node->attribute->name->length, _name, _len) == 1) {
-      return node->attribute;
-    }
-    node = node->next;
+  void* block = json_alloc(_enc, size);
+  if (block != NULL) {
+    memcpy(block, _enc->scratch + _base, size);
   }
+  _enc->scratchLength = _base;
+  return block;
+}
 
-  return NULL;
+static void json_scratch_free(JsonStream* _enc) {
+  free(_enc->scratch);
+  _enc->scratch = NULL;
+  _enc->scratchLength = 0;
+  _enc->scratchCapacity = 0;
 }
 
-// Array
-static void json_free_arrayItem(JsonArrayItem* _item) {
-  if (_item == NULL) {
+static void json_free_value(JsonValue* _v);
+
+// Object
+static void json_free_objectAttribute(JsonObjectAttribute* _attr) {
+  if (_attr == NULL) {
     return;
   }
 
-  json_free(_item->data);
-  free(_item);
+  free(_attr->name.value);
+  json_free_value(&_attr->value);
 }
 
-static JsonArrayItem* json_decode_arrayItem(JsonStream* _enc) {
+static char json_decode_objectAttribute(JsonStream* _enc, JsonObjectAttribute* _attr) {
   if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+    return 0;
   }
 
   json_string_ltrim(_enc);
 
-  JsonArrayItem*  item = malloc(sizeof(JsonArrayItem));
-  item->next = NULL;
+  if (json_stream_peek(_enc) != JSON_STRING) {
+    return 0;
+  }
+
+  // Get key
+  _attr->name.value = NULL;
+  _attr->value.type = JSON_NULL;
+  _attr->value.data = NULL;
+  if (json_decode_stringInto(_enc, &_attr->name) == 0) {
+    return 0;
+  }
+
+  // Search for :
+  ssize_t colon_pos = json_string_indexOf(':', _enc->current, _enc->length, _enc->padded);
+  if (colon_pos < 0) {
+    goto clean;
+  }
+
+  json_move_stream(_enc, colon_pos + 1);
 
   // Get Value
-  item->data = json_decode_value(_enc);
-  if (item->data == NULL) {
+  if (json_decode_value(_enc, &_attr->value) == 0) {
     goto clean;
   }
 
-  return item;
+  return 1;
 
  clean:
-  json_free_arrayItem(item);
-  return NULL;
-}
-
-void json_add_arrayItem(JsonArray* _arr, JsonArrayItem* _item) {
-  if (_arr->first == NULL) {
-    _arr->first = _item;
-  }
-  else {
-    _arr->last->next = _item;
+  if (_enc->arena == NULL) {
+    json_free_objectAttribute(_attr);
   }
-
-  _arr->last = _item;
-  _arr->length++;
+  return 0;
 }
 
-static void json_free_array(JsonArray* _arr) {
-  if (_arr == NULL) {
+static void json_free_object(JsonObject* _obj) {
+  if (_obj == NULL) {
     return;
   }
 
-  if (_arr->array != NULL) {
-    free(_arr->array);
+  // The index is only built on the first lookup
+  if (_obj->index != NULL) {
+    free(_obj->index);
   }
 
-  JsonArrayItem* item = _arr->first;
-  JsonArrayItem* item2;
-  while (item) {
-    item2 = item;
-    item = item->next;
-    json_free_arrayItem(item2);
+  for (size_t i = 0; i < _obj->length; i++) {
+    json_free_objectAttribute(&_obj->attributes[i]);
   }
 
-  free(_arr);
+  free(_obj->attributes);
+  free(_obj);
 }
 
-static JsonArray* json_decode_array(JsonStream* _enc) {
-  if (_enc == NULL || _enc->length == 0) {
-    return NULL;
-  }
-
-  json_string_ltrim(_enc);
+// Close an object whose attributes sit on the scratch from _base up
+static JsonObject* json_new_object(JsonStream* _enc, size_t _base) {
+  JsonObject* obj = json_alloc(_enc, sizeof(JsonObject));
+  obj->length = (_enc->scratchLength - _base) / sizeof(JsonObjectAttribute);
+  obj->attributes = json_scratch_pop(_enc, _base);
+  obj->index = NULL;
+  obj->arena = _enc->arena;
+  return obj;
+}
 
-  if (_enc->current == NULL) {
-    return NULL;
+// A spare table left by json_arena_reset, NULL unless the next one is big
+// enough. Spares are only added while no one reads the arena, so taking the
+// head with a CAS can't see it come back.
+static JsonObjectIndex* json_arena_spareIndex(JsonArena* _arena, size_t _capacity) {
+  void* head = json_atomic_loadPtr((void* volatile*)&_arena->spare);
+  while (head != NULL && ((JsonObjectIndex*)head)->mask + 1 >= _capacity) {
+    if (json_atomic_tryCasPtr((void* volatile*)&_arena->spare, &head, ((JsonObjectIndex*)head)->next)) {
+      return head;
+    }
   }
+  return NULL;
+}
 
-  if (_enc->current[0] != JSON_ARRAY) {
-    return NULL;
+// Power of two, at most 3/4 full
+static size_t json_objectIndex_capacity(size_t _length) {
+  size_t capacity = 4;
+  while (capacity - capacity / 4 < _length) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+// Hash every key of _obj with _seed into a table of index->mask + 1 slots
+static void json_fill_objectIndex(JsonObjectIndex* _index, const JsonObject* _obj, uint64_t _seed) {
+  size_t i;
+  _index->seed = _seed;
+
+  // Init array without using memset
+  for (i = 0; i <= _index->mask; i++) {
+    _index->slots[i].attribute = NULL;
+    _index->slots[i].hash = 0;
+  }
+
+  // Robin Hood: an entry further from its home slot takes the place of a
+  // closer one. Entries with the same hash share a home slot, on a tie the
+  // one earlier in the object goes first so a duplicate key still finds
+  // its first occurrence.
+  for (size_t n = 0; n < _obj->length; n++) {
+    JsonObjectSlot slot;
+    slot.attribute = &_obj->attributes[n];
+    slot.hash = json_string_hashKeyed(slot.attribute->name.value, slot.attribute->name.length, _seed);
+
+    i = slot.hash & _index->mask;
+    size_t dist = 0;
+    while (_index->slots[i].attribute != NULL) {
+      size_t other = (i - (_index->slots[i].hash & _index->mask)) & _index->mask;
+      if (other < dist || (other == dist && slot.hash == _index->slots[i].hash && slot.attribute < _index->slots[i].attribute)) {
+	JsonObjectSlot tmp = _index->slots[i];
+	_index->slots[i] = slot;
+	slot = tmp;
+	dist = other;
+      }
+
+      i = (i + 1) & _index->mask;
+      dist++;
+    }
+    _index->slots[i] = slot;
+  }
+}
+
+static JsonObjectIndex* json_new_objectIndex(const JsonObject* _obj, JsonArena* _arena) {
+  size_t capacity = json_objectIndex_capacity(_obj->length);
+
+  JsonObjectIndex* index = _arena ? json_arena_spareIndex(_arena, capacity) : NULL;
+  if (index != NULL) {
+    capacity = index->mask + 1;
+  }
+  else {
+    index = malloc(sizeof(JsonObjectIndex) + sizeof(JsonObjectSlot) * capacity);
+  }
+  if (index == NULL) {
+    return NULL;
+  }
+  index->next = NULL;
+  index->mask = capacity - 1;
+  json_fill_objectIndex(index, _obj, json_hash_seed());
+  return index;
+}
+
+// Build the hash map on the first lookup. Lookups may race on a shared
+// tree, the first index published wins and the others are dropped.
+static JsonObjectIndex* json_index_object(const JsonObject* _obj) {
+  JsonObject* obj = (JsonObject*)_obj;
+  JsonObjectIndex* index = json_atomic_loadPtr((void* volatile*)&obj->index);
+  if (index != NULL) {
+    return index;
+  }
+
+  JsonArena* arena = obj->arena;
+  while (arena != NULL && arena->parent != NULL) {
+    arena = arena->parent;
+  }
+
+  JsonObjectIndex* fresh = json_new_objectIndex(_obj, arena);
+  if (fresh == NULL) {
+    return NULL;
+  }
+
+  index = json_atomic_casPtr((void* volatile*)&obj->index, NULL, fresh);
+  if (index != fresh) {
+    free(fresh);
+    return index;
+  }
+
+  // Arena nodes are never freed one by one, hand the index to the arena
+  if (arena != NULL) {
+    JsonObjectIndex* head = json_atomic_loadPtr((void* volatile*)&arena->indexes);
+    for (;;) {
+      fresh->next = head;
+      JsonObjectIndex* seen = json_atomic_casPtr((void* volatile*)&arena->indexes, head, fresh);
+      if (seen == fresh) {
+	break;
+      }
+      head = seen;
+    }
+  }
+
+  return fresh;
+}
+
+// Drop the children of a container that failed half way
+static void json_scratch_drop(JsonStream* _enc, size_t _base, char _type) {
+  if (_enc->arena == NULL) {
+    size_t size = _type == JSON_OBJECT ? sizeof(JsonObjectAttribute) : sizeof(JsonValue);
+    for (size_t i = _base; i < _enc->scratchLength; i += size) {
+      if (_type == JSON_OBJECT) {
+	json_free_objectAttribute((JsonObjectAttribute*)(_enc->scratch + i));
+      }
+      else {
+	json_free_value((JsonValue*)(_enc->scratch + i));
+      }
+    }
+  }
+
+  _enc->scratchLength = _base;
+}
+
+static JsonObject* json_decode_object(JsonStream* _enc) {
+  if (_enc == NULL || _enc->length == 0) {
+    return NULL;
+  }
+
+  json_string_ltrim(_enc);
+
+  if (_enc->current == NULL) {
+    return NULL;
+  }
+
+  if (json_stream_peek(_enc) != JSON_OBJECT) {
+    return NULL;
   }
 
   json_move_stream(_enc, 1);
   json_string_ltrim(_enc);
 
-  JsonArray* arr = malloc(sizeof(JsonArray));
-  arr->first = NULL;
-  arr->last = NULL;
-  arr->array = NULL;
-  arr->length = 0;
+  size_t base = _enc->scratchLength;
 
-  while (_enc->current[0] != JSON_ARRAY_END) {
-    JsonArrayItem* item = json_decode_arrayItem(_enc);
-    if (item == NULL) {
+  while (json_stream_peek(_enc) != JSON_OBJECT_END) {
+    JsonObjectAttribute attr;
+    if (json_decode_objectAttribute(_enc, &attr) == 0) {
+      goto clean;
+    }
+    if (json_scratch_push(_enc, &attr, sizeof(attr)) == 0) {
+      if (_enc->arena == NULL) {
+	json_free_objectAttribute(&attr);
+      }
       goto clean;
     }
-    json_add_arrayItem(arr, item);
 
     json_string_ltrim(_enc);
-    if (_enc->current[0] == ',') {
+    if (json_stream_peek(_enc) == ',') {
       json_move_stream(_enc, 1);
     }
-    else if (_enc->current[0] != JSON_ARRAY_END) {
+    else if (json_stream_peek(_enc) != JSON_OBJECT_END) {
       goto clean;
     }
   }
 
   json_move_stream(_enc, 1);
 
-  // Create the array
-  if (arr->length) {
-    arr->array = malloc(sizeof(JsonArrayItem*) * arr->length);
-    JsonArrayItem* node = arr->first;
-    size_t i = 0;
-    while (node) {
-      arr->array[i++] = node;
-      node = node->next;
+  return json_new_object(_enc, base);
+
+ clean:
+  json_scratch_drop(_enc, base, JSON_OBJECT);
+  return NULL;
+}
+
+// Small objects are scanned, checking length and first byte before the key
+static JsonObjectAttribute* json_scan_objectAttribute(const JsonObject* _obj, const char* _name, size_t _len) {
+  for (size_t i = 0; i < _obj->length; i++) {
+    const JsonString* name = &_obj->attributes[i].name;
+    if (name->length == _len && name->value[0] == _name[0]
+	&& json_equal_strings(name->value, name->length, _name, _len) == 1) {
+      return &_obj->attributes[i];
+    }
+  }
+
+  return NULL;
+}
+
+// _hash is json_string_hash(_name, _len), compiled paths keep it around
+static JsonObjectAttribute* json_get_objectAttributeHashed(const JsonObject* _obj, const char* _name, size_t _len, size_t _hash) {
+  if (_obj == NULL) {
+    return NULL;
+  }
+
+  if (_len < 1) {
+    return NULL;
+  }
+
+  if (_obj->length < JSON_OBJECT_INDEX_MIN) {
+    return json_scan_objectAttribute(_obj, _name, _len);
+  }
+
+  JsonObjectIndex* index = json_index_object(_obj);
+  if (index == NULL) {
+    return NULL;
+  }
+
+  // Snapshot tables carry their own key
+  if (index->seed != json_hash_seed()) {
+    _hash = json_string_hashKeyed(_name, _len, index->seed);
+  }
+
+  size_t i = _hash & index->mask;
+  for (size_t dist = 0; ; dist++) {
+    const JsonObjectSlot* slot = &index->slots[i];
+    if (slot->attribute == NULL) {
+      return NULL;
+    }
+
+    // Past the point where the key would have displaced this entry
+    if (((i - (slot->hash & index->mask)) & index->mask) < dist) {
+      return NULL;
+    }
+
+    if (slot->hash == _hash
+	&& json_equal_strings(slot->attribute->name.value, slot->attribute->name.length, _name, _len) == 1) {
+      return slot->attribute;
     }
+
+    i = (i + 1) & index->mask;
+  }
+}
+
+static JsonObjectAttribute* json_get_objectAttribute(const JsonObject* _obj, const char* _name, size_t _len) {
+  // Only objects big enough to be indexed need the key hashed
+  size_t hash = 0;
+  if (_obj != NULL && _obj->length >= JSON_OBJECT_INDEX_MIN) {
+    hash = json_string_hash(_name, _len);
   }
 
+  return json_get_objectAttributeHashed(_obj, _name, _len, hash);
+}
+
+
+// Array
+static void json_free_array(JsonArray* _arr) {
+  if (_arr == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < _arr->length; i++) {
+    json_free_value(&_arr->items[i]);
+  }
+
+  free(_arr->items);
+  free(_arr);
+}
+
+// Close an array whose items sit on the scratch from _base up
+static JsonArray* json_new_array(JsonStream* _enc, size_t _base) {
+  JsonArray* arr = json_alloc(_enc, sizeof(JsonArray));
+  arr->length = (_enc->scratchLength - _base) / sizeof(JsonValue);
+  arr->items = json_scratch_pop(_enc, _base);
   return arr;
+}
+
+static JsonArray* json_decode_array(JsonStream* _enc) {
+  if (_enc == NULL || _enc->length == 0) {
+    return NULL;
+  }
+
+  json_string_ltrim(_enc);
+
+  if (_enc->current == NULL) {
+    return NULL;
+  }
+
+  if (json_stream_peek(_enc) != JSON_ARRAY) {
+    return NULL;
+  }
+
+  json_move_stream(_enc, 1);
+  json_string_ltrim(_enc);
+
+  size_t base = _enc->scratchLength;
+
+  while (json_stream_peek(_enc) != JSON_ARRAY_END) {
+    JsonValue item;
+    if (json_decode_value(_enc, &item) == 0) {
+      goto clean;
+    }
+    if (json_scratch_push(_enc, &item, sizeof(item)) == 0) {
+      if (_enc->arena == NULL) {
+	json_free_value(&item);
+      }
+      goto clean;
+    }
+
+    json_string_ltrim(_enc);
+    if (json_stream_peek(_enc) == ',') {
+      json_move_stream(_enc, 1);
+    }
+    else if (json_stream_peek(_enc) != JSON_ARRAY_END) {
+      goto clean;
+    }
+  }
+
+  json_move_stream(_enc, 1);
+
+  return json_new_array(_enc, base);
 
  clean:
-  json_free_array(arr);
+  json_scratch_drop(_enc, base, JSON_ARRAY);
   return NULL;
 }
 
-static JsonArrayItem* json_get_arrayItem(const JsonArray* _arr, size_t _index) {
+static JsonValue* json_get_arrayItem(const JsonArray* _arr, size_t _index) {
   if (_arr == NULL) {
     return NULL;
   }
@@ -690,49 +2185,51 @@ static JsonArrayItem* json_get_arrayItem(const JsonArray* _arr, size_t _index) {
     return NULL;
   }
 
-  return _arr->array[_index];
+  return &_arr->items[_index];
 }
 
-void json_free(JsonValue* _data) {
-  if (_data == NULL) {
-    return;
-  }
-
-  switch(_data->type) {
+// Release what the value owns, not the value itself
+static void json_free_value(JsonValue* _v) {
+  switch(_v->type) {
   case JSON_OBJECT:
-    json_free_object(_data->data);
+    json_free_object(_v->data);
     break;
   case JSON_ARRAY:
-    json_free_array(_data->data);
+    json_free_array(_v->data);
     break;
   case JSON_STRING:
-    json_free_string(_data->data);
+    json_free_string(_v->data);
     break;
-  case JSON_NUMBER:
-  case JSON_BOOL:
-  case JSON_NULL:
   case JSON_ERROR:
-    free(_data->data);
+    free(_v->data);
     break;
   }
+}
+
+void json_free(JsonValue* _data) {
+  if (_data == NULL) {
+    return;
+  }
 
+  json_free_value(_data);
   free(_data);
 }
 
-static JsonValue* json_decode_value(JsonStream* _enc) {
+static char json_decode_value(JsonStream* _enc, JsonValue* _v) {
   if (_enc == NULL || _enc->length == 0) {
-    return NULL;
+    return 0;
   }
 
   json_string_ltrim(_enc);
 
   if (_enc->current == NULL) {
-    return NULL;
+    return 0;
   }
 
-  JsonValue* data = malloc(sizeof(JsonValue));
+  JsonValue* data = _v;
   data->type = -1;
   data->data = NULL;
+  char ok = 0;
 
   size_t pos = 0;
   while(pos < _enc->length && data->type < 0) {
@@ -754,367 +2251,4328 @@ static JsonValue* json_decode_value(JsonStream* _enc) {
   }
 
   switch(data->type) {
-  case JSON_OBJECT: data->data = json_decode_object(_enc); break;
-  case JSON_ARRAY: data->data = json_decode_array(_enc); break;
-  case JSON_NUMBER: data->data = json_decode_number(_enc); break;
-  case JSON_STRING: data->data = json_decode_string(_enc); break;
-  case JSON_BOOL: data->data = json_decode_bool(_enc); break;
-  case JSON_NULL: data->data = json_decode_null(_enc); break;
+  case JSON_OBJECT: ok = (data->data = json_decode_object(_enc)) != NULL; break;
+  case JSON_ARRAY: ok = (data->data = json_decode_array(_enc)) != NULL; break;
+  case JSON_NUMBER: ok = json_decode_number(_enc, data); break;
+  case JSON_STRING: ok = (data->data = json_decode_string(_enc)) != NULL; break;
+  case JSON_BOOL: ok = json_decode_bool(_enc, data); break;
+  case JSON_NULL: ok = json_decode_null(_enc, data); break;
   default: goto clean;
   }
 
  clean:
-  if (data->data == NULL) {
-    json_free(data);
-    return NULL;
+  if (ok == 0) {
+    data->type = JSON_NULL;
+    data->data = NULL;
   }
 
-  return data;
+  return ok;
 }
 
-JsonValue* json_decode(const char* _json)
-{
-  size_t len = json_string_length(_json);
-
-  if (len < 1) {
-    return NULL;
-  }
-
+// On failure the stream is kept as the error data. The scratch stack is
+// left to the caller so it can be reused for the next document.
+static JsonValue* json_decode_rootValue(JsonStream* _enc) {
   JsonValue* data = NULL;
-  JsonStream* enc = json_stream(_json, len);
 
-  json_string_ltrim(enc);
+  json_string_ltrim(_enc);
 
-  if (enc->current[0] != JSON_OBJECT && enc->current[0] != JSON_ARRAY) {
+  if (json_stream_peek(_enc) != JSON_OBJECT && json_stream_peek(_enc) != JSON_ARRAY) {
     goto clean;
   }
 
-  data = json_decode_value(enc);
-
-  if (data == NULL) {
+  data = json_alloc(_enc, sizeof(JsonValue));
+  if (json_decode_value(_enc, data) == 0) {
+    if (_enc->arena == NULL) {
+      free(data);
+    }
     goto clean;
   }
 
-  free(enc);
   return data;
 
  clean:
-  json_free(data);
-
-  data = malloc(sizeof(JsonValue));
+  data = json_alloc(_enc, sizeof(JsonValue));
   data->type = JSON_ERROR;
-  data->data = enc;
+  data->data = _enc;
   return data;
 }
 
-JsonError json_get_errorMsg(JsonValue* _e) {
-  JsonError e = {0};
-  size_t len = sizeof(e.msg) - 1;
+static JsonValue* json_decode_root(JsonStream* _enc) {
+  JsonValue* data = json_decode_rootValue(_enc);
 
-  if (_e == NULL) {
-    json_string_cat(e.msg, len, "ERROR: No Json error data passed");
-    return e;
+  json_scratch_free(_enc);
+  if (data->type != JSON_ERROR && _enc->arena == NULL) {
+    free(_enc);
   }
+  return data;
+}
 
-  if (_e->type != JSON_ERROR) {
-    json_string_cat(e.msg, len, "ERROR: Not a valid Json error data passed");
-    return e;
+JsonValue* json_decode(const char* _json)
+{
+  size_t len = json_string_length(_json);
+
+  if (len < 1) {
+    return NULL;
   }
 
-  JsonStream* s = (JsonStream*)_e->data;
-  snprintf(e.msg, len, "ERROR: Invalid syntax at offset( %ld ): %s", s->position, s->current);
-  return e;
+  return json_decode_root(json_stream(_json, len, NULL));
 }
 
-// 0.name
-// obj.name
-const JsonValue* json_get(const JsonValue* _v, const char* _path) {
-  if (_v == NULL) {
+static JsonDocument* json_decode_documentStream(const char* _json, size_t _len, char* _insitu)
+{
+  JsonDocument* doc = malloc(sizeof(JsonDocument));
+  json_arena_init(&doc->arena, _len * 2);
+
+  doc->buffer = NULL;
+  doc->bufferLength = 0;
+
+  JsonStream* enc = json_stream(_json, _len, &doc->arena);
+  enc->insitu = _insitu;
+  doc->root = json_decode_root(enc);
+  return doc;
+}
+
+JsonValue* json_decode_n(const char* _json, size_t _len)
+{
+  if (_json == NULL || _len < 1) {
     return NULL;
   }
 
-  size_t len = json_string_length(_path);
+  return json_decode_root(json_stream(_json, _len, NULL));
+}
+
+JsonValue* json_decode_padded(const char* _json, size_t _len)
+{
+  if (_json == NULL || _len < 1) {
+    return NULL;
+  }
+
+  JsonStream* enc = json_stream(_json, _len, NULL);
+  enc->padded = 1;
+  return json_decode_root(enc);
+}
+
+JsonDocument* json_decode_document(const char* _json)
+{
+  size_t len = json_string_length(_json);
+
   if (len < 1) {
     return NULL;
   }
 
-  const JsonValue* v = NULL;
-  JsonObject* obj = NULL;
-  JsonArray* arr = NULL;
-  JsonObjectAttribute* objA = NULL;
-  JsonArrayItem* arrI = NULL;
+  return json_decode_documentStream(_json, len, NULL);
+}
 
-  char type = json_is_digit(_path[0]) ? JSON_ARRAY : JSON_OBJECT;
+JsonDocument* json_decode_insitu(char* _json)
+{
+  size_t len = json_string_length(_json);
 
-  ssize_t end = json_string_indexOf('.', _path, len, 0);
-  char last = 0;
-  if (end < 0) {
-    last = 1;
-    end = len;
+  if (len < 1) {
+    return NULL;
   }
 
-  char* sub = json_substring(_path, end);
-  char* name = sub;
+  return json_decode_documentStream(_json, len, _json);
+}
 
-  if (type != _v->type) {
-    goto clean;
+// The buffer is padded and owned by the document
+static JsonDocument* json_decode_fileBuffer(char* _buffer, size_t _len, size_t _bufferLength)
+{
+  JsonDocument* doc = malloc(sizeof(JsonDocument));
+  json_arena_init(&doc->arena, _len);
+  doc->buffer = _buffer;
+  doc->bufferLength = _bufferLength;
+
+  JsonStream* enc = json_stream(_buffer, _len, &doc->arena);
+  enc->borrowed = 1;
+  enc->padded = 1;
+  doc->root = json_decode_root(enc);
+  return doc;
+}
+
+#if defined(_WIN32)
+// No mmap, the document owns a heap copy of the file instead
+JsonDocument* json_decode_file(const char* _path)
+{
+  FILE* f = fopen(_path, "rb");
+  if (f == NULL) {
+    return NULL;
   }
 
-  switch (_v->type) {
-  case JSON_OBJECT:
-    obj = (JsonObject*)_v->data;
-    name++;
-    objA = json_get_objectAttribute(obj, name, end - 2);
-    if (objA == NULL) {
-      goto clean;
-    }
-    v = objA->data;
-    break;
+  char* buffer = NULL;
+  long len = -1;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    len = ftell(f);
+  }
+  if (len > 0 && fseek(f, 0, SEEK_SET) == 0) {
+    buffer = malloc(len + JSON_PADDING);
+  }
+  if (buffer == NULL || fread(buffer, 1, len, f) != (size_t)len) {
+    free(buffer);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
 
+  return json_decode_fileBuffer(buffer, len, len + JSON_PADDING);
+}
+#else
+JsonDocument* json_decode_file(const char* _path)
+{
+  int fd = open(_path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 1) {
+    close(fd);
+    return NULL;
+  }
+
+  // Reserve an extra page so the end of the file is followed by readable
+  // zeros, then map the file over the start of it. Nothing is written to
+  // the file pages, they stay shared with the page cache.
+  size_t len = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t mapLength = (len + JSON_PADDING + page - 1) / page * page;
+
+  char* buffer = mmap(NULL, mapLength, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buffer == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  if (mmap(buffer, len, PROT_READ, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(buffer, mapLength);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+
+  madvise(buffer, len, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+  // Only honoured where the kernel collapses read only file pages
+  madvise(buffer, len, MADV_HUGEPAGE);
+#endif
+
+  return json_decode_fileBuffer(buffer, len, mapLength);
+}
+#endif
+
+void json_free_document(JsonDocument* _doc) {
+  if (_doc == NULL) {
+    return;
+  }
+
+  json_arena_free(&_doc->arena);
+
+  if (_doc->buffer != NULL) {
+#if defined(_WIN32)
+    free(_doc->buffer);
+#else
+    munmap(_doc->buffer, _doc->bufferLength);
+#endif
+  }
+
+  free(_doc);
+}
+
+/*************
+ ** THREADS **
+ *************/
+
+// Less input than this per worker isn't worth a thread
+#define JSON_THREAD_MIN_SHARE (1 << 16)
+
+#if defined(_WIN32)
+typedef HANDLE JsonThread;
+#else
+typedef pthread_t JsonThread;
+#endif
+
+typedef struct {
+  void (*run)(void* _task);
+  void* task;
+  JsonThread thread;
+  unsigned char started;
+} JsonJob;
+
+#if defined(_WIN32)
+static DWORD WINAPI json_job_thread(LPVOID _job) {
+  JsonJob* job = (JsonJob*)_job;
+  job->run(job->task);
+  return 0;
+}
+#else
+static void* json_job_thread(void* _job) {
+  JsonJob* job = (JsonJob*)_job;
+  job->run(job->task);
+  return NULL;
+}
+#endif
+
+// Run _run over the _count tasks of _size bytes each and wait for all of
+// them. The first task runs on the calling thread, a task whose thread
+// can't be started runs there too once the others are going.
+static void json_thread_runAll(void* _tasks, size_t _size, size_t _count, void (*_run)(void* _task)) {
+  JsonJob* jobs = _count > 1 ? malloc(_count * sizeof(JsonJob)) : NULL;
+
+  for (size_t i = 1; jobs != NULL && i < _count; i++) {
+    jobs[i].run = _run;
+    jobs[i].task = (char*)_tasks + i * _size;
+#if defined(_WIN32)
+    jobs[i].thread = CreateThread(NULL, 0, json_job_thread, &jobs[i], 0, NULL);
+    jobs[i].started = jobs[i].thread != NULL;
+#else
+    jobs[i].started = pthread_create(&jobs[i].thread, NULL, json_job_thread, &jobs[i]) == 0;
+#endif
+  }
+
+  _run(_tasks);
+
+  for (size_t i = 1; i < _count; i++) {
+    if (jobs != NULL && jobs[i].started) {
+#if defined(_WIN32)
+      WaitForSingleObject(jobs[i].thread, INFINITE);
+      CloseHandle(jobs[i].thread);
+#else
+      pthread_join(jobs[i].thread, NULL);
+#endif
+    }
+    else {
+      _run((char*)_tasks + i * _size);
+    }
+  }
+  free(jobs);
+}
+
+// Workers kept from one round to the next. A round hands task i to worker
+// i, the caller goes on with its own work until json_pool_wait. Tasks of
+// workers that could not be started run in json_pool_wait.
+typedef struct JsonPool JsonPool;
+
+typedef struct {
+  JsonPool* pool;
+  size_t index;
+  JsonThread thread;
+  unsigned char started;
+} JsonPoolWorker;
+
+struct JsonPool {
+#if defined(_WIN32)
+  SRWLOCK lock;
+  CONDITION_VARIABLE wake; // A round started or the pool stops
+  CONDITION_VARIABLE done; // The last worker of a round finished
+#else
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t done;
+#endif
+  JsonPoolWorker* workers; // NULL when out of memory, every task runs in json_pool_wait
+  size_t count;
+  void (*run)(void* _task);
+  char* tasks;
+  size_t size;
+  size_t round; // Rounds started so far
+  size_t pending; // Started workers still busy with this round
+  unsigned char stop;
+};
+
+static void json_pool_lock(JsonPool* _pool) {
+#if defined(_WIN32)
+  AcquireSRWLockExclusive(&_pool->lock);
+#else
+  pthread_mutex_lock(&_pool->lock);
+#endif
+}
+
+static void json_pool_unlock(JsonPool* _pool) {
+#if defined(_WIN32)
+  ReleaseSRWLockExclusive(&_pool->lock);
+#else
+  pthread_mutex_unlock(&_pool->lock);
+#endif
+}
+
+#if defined(_WIN32)
+#define json_pool_sleep(_pool, _cond) SleepConditionVariableSRW(&(_pool)->_cond, &(_pool)->lock, INFINITE, 0)
+#define json_pool_signal(_pool, _cond) WakeAllConditionVariable(&(_pool)->_cond)
+#else
+#define json_pool_sleep(_pool, _cond) pthread_cond_wait(&(_pool)->_cond, &(_pool)->lock)
+#define json_pool_signal(_pool, _cond) pthread_cond_broadcast(&(_pool)->_cond)
+#endif
+
+static void json_pool_loop(JsonPoolWorker* _worker) {
+  JsonPool* pool = _worker->pool;
+  size_t seen = 0;
+
+  json_pool_lock(pool);
+  for (;;) {
+    while (pool->round == seen && pool->stop == 0) {
+      json_pool_sleep(pool, wake);
+    }
+    if (pool->stop) {
+      break;
+    }
+    seen = pool->round;
+    void* task = pool->tasks + _worker->index * pool->size;
+    void (*run)(void* _task) = pool->run;
+    json_pool_unlock(pool);
+
+    run(task);
+
+    json_pool_lock(pool);
+    if (--pool->pending == 0) {
+      json_pool_signal(pool, done);
+    }
+  }
+  json_pool_unlock(pool);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI json_pool_thread(LPVOID _worker) {
+  json_pool_loop((JsonPoolWorker*)_worker);
+  return 0;
+}
+#else
+static void* json_pool_thread(void* _worker) {
+  json_pool_loop((JsonPoolWorker*)_worker);
+  return NULL;
+}
+#endif
+
+static void json_pool_init(JsonPool* _pool, size_t _count) {
+#if defined(_WIN32)
+  InitializeSRWLock(&_pool->lock);
+  InitializeConditionVariable(&_pool->wake);
+  InitializeConditionVariable(&_pool->done);
+#else
+  pthread_mutex_init(&_pool->lock, NULL);
+  pthread_cond_init(&_pool->wake, NULL);
+  pthread_cond_init(&_pool->done, NULL);
+#endif
+  _pool->count = _count;
+  _pool->run = NULL;
+  _pool->tasks = NULL;
+  _pool->size = 0;
+  _pool->round = 0;
+  _pool->pending = 0;
+  _pool->stop = 0;
+  _pool->workers = malloc(_count * sizeof(JsonPoolWorker));
+
+  for (size_t i = 0; _pool->workers != NULL && i < _count; i++) {
+    JsonPoolWorker* w = &_pool->workers[i];
+    w->pool = _pool;
+    w->index = i;
+#if defined(_WIN32)
+    w->thread = CreateThread(NULL, 0, json_pool_thread, w, 0, NULL);
+    w->started = w->thread != NULL;
+#else
+    w->started = pthread_create(&w->thread, NULL, json_pool_thread, w) == 0;
+#endif
+  }
+}
+
+// Start a round of _run over the pool's count of tasks, _size bytes each
+static void json_pool_start(JsonPool* _pool, void* _tasks, size_t _size, void (*_run)(void* _task)) {
+  size_t started = 0;
+  for (size_t i = 0; _pool->workers != NULL && i < _pool->count; i++) {
+    started += _pool->workers[i].started;
+  }
+
+  json_pool_lock(_pool);
+  _pool->run = _run;
+  _pool->tasks = (char*)_tasks;
+  _pool->size = _size;
+  _pool->pending = started;
+  _pool->round++;
+  json_pool_signal(_pool, wake);
+  json_pool_unlock(_pool);
+}
+
+// Wait for the round started last
+static void json_pool_wait(JsonPool* _pool) {
+  for (size_t i = 0; i < _pool->count; i++) {
+    if (_pool->workers == NULL || _pool->workers[i].started == 0) {
+      _pool->run(_pool->tasks + i * _pool->size);
+    }
+  }
+
+  json_pool_lock(_pool);
+  while (_pool->pending > 0) {
+    json_pool_sleep(_pool, done);
+  }
+  json_pool_unlock(_pool);
+}
+
+static void json_pool_free(JsonPool* _pool) {
+  json_pool_lock(_pool);
+  _pool->stop = 1;
+  json_pool_signal(_pool, wake);
+  json_pool_unlock(_pool);
+
+  for (size_t i = 0; _pool->workers != NULL && i < _pool->count; i++) {
+    if (_pool->workers[i].started) {
+#if defined(_WIN32)
+      WaitForSingleObject(_pool->workers[i].thread, INFINITE);
+      CloseHandle(_pool->workers[i].thread);
+#else
+      pthread_join(_pool->workers[i].thread, NULL);
+#endif
+    }
+  }
+  free(_pool->workers);
+#if !defined(_WIN32)
+  pthread_cond_destroy(&_pool->done);
+  pthread_cond_destroy(&_pool->wake);
+  pthread_mutex_destroy(&_pool->lock);
+#endif
+}
+
+static void json_thread_yield() {
+#if defined(_WIN32)
+  SwitchToThread();
+#else
+  sched_yield();
+#endif
+}
+
+// Workers for _len bytes of input, _threads or one per core when 0
+static size_t json_thread_count(size_t _threads, size_t _len) {
+  if (_threads == 0) {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    _threads = info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    _threads = cores > 0 ? (size_t)cores : 1;
+#endif
+  }
+
+  size_t most = _len / JSON_THREAD_MIN_SHARE + 1;
+  return _threads < most ? _threads : most;
+}
+
+/************
+ ** NDJSON **
+ ************/
+
+// Bytes of lines each worker takes per round of json_decode_ndjsonEach
+#define JSON_LINES_WINDOW (1 << 20)
+
+// A worker decodes a run of whole lines into its own arena. The arena and
+// the scratch stack are kept from one round to the next.
+typedef struct {
+  const char* start;
+  size_t length;
+  const char* end; // End of the whole input, lines far enough from it are decoded padded
+  JsonArena* arena; // Objects keep a pointer to it, so it outlives the worker
+  JsonValue** records;
+  size_t count;
+  size_t capacity;
+  char* scratch;
+  size_t scratchCapacity;
+  unsigned char failed; // Out of memory
+} JsonLineWorker;
+
+static void json_lines_decode(JsonLineWorker* _w, const char* _line, size_t _len) {
+  // Blank lines are not records
+  size_t i = 0;
+  while (i < _len && json_is_space(_line[i])) {
+    i++;
+  }
+  if (i == _len) {
+    return;
+  }
+
+  if (_w->count == _w->capacity) {
+    size_t capacity = _w->capacity ? _w->capacity * 2 : 256;
+    JsonValue** records = realloc(_w->records, capacity * sizeof(JsonValue*));
+    if (records == NULL) {
+      _w->failed = 1;
+      return;
+    }
+    _w->records = records;
+    _w->capacity = capacity;
+  }
+
+  JsonStream enc;
+  json_stream_init(&enc, _line, _len, _w->arena);
+  enc.padded = (size_t)(_w->end - (_line + _len)) >= JSON_PADDING;
+  enc.scratch = _w->scratch;
+  enc.scratchCapacity = _w->scratchCapacity;
+
+  JsonValue* root = json_decode_rootValue(&enc);
+  _w->scratch = enc.scratch;
+  _w->scratchCapacity = enc.scratchCapacity;
+
+  // The stream lives on the stack, errors keep a copy of it
+  if (root->type == JSON_ERROR) {
+    JsonStream* kept = json_arena_alloc(_w->arena, sizeof(JsonStream));
+    if (kept == NULL) {
+      _w->failed = 1;
+      return;
+    }
+    *kept = enc;
+    kept->scratch = NULL;
+    kept->scratchLength = 0;
+    kept->scratchCapacity = 0;
+    root->data = kept;
+  }
+
+  _w->records[_w->count++] = root;
+}
+
+static void json_lines_run(void* _task) {
+  JsonLineWorker* w = (JsonLineWorker*)_task;
+  const char* line = w->start;
+  const char* end = w->start + w->length;
+
+  while (line < end && w->failed == 0) {
+    const char* newline = memchr(line, '\n', end - line);
+    const char* lineEnd = newline ? newline : end;
+    json_lines_decode(w, line, lineEnd - line);
+    line = newline ? newline + 1 : end;
+  }
+}
+
+static char json_lines_ok(const JsonLineWorker* _workers, size_t _count) {
+  for (size_t i = 0; i < _count; i++) {
+    if (_workers[i].failed) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static char json_lines_runAll(JsonLineWorker* _workers, size_t _count) {
+  json_thread_runAll(_workers, sizeof(JsonLineWorker), _count, json_lines_run);
+  return json_lines_ok(_workers, _count);
+}
+
+// End of the next round's lines from _start, a window per worker
+static const char* json_lines_window(const char* _start, const char* _end, size_t _count) {
+  if ((size_t)(_end - _start) <= _count * JSON_LINES_WINDOW) {
+    return _end;
+  }
+  const char* newline = memchr(_start + _count * JSON_LINES_WINDOW, '\n', _end - _start - _count * JSON_LINES_WINDOW);
+  return newline ? newline + 1 : _end;
+}
+
+// Cut the input into _count runs of whole lines of about the same size
+static void json_lines_split(JsonLineWorker* _workers, size_t _count, const char* _json, size_t _len) {
+  const char* start = _json;
+  const char* end = _json + _len;
+
+  for (size_t i = 0; i < _count; i++) {
+    const char* cut = end;
+    if (i + 1 < _count) {
+      cut = start + (end - start) / (_count - i);
+      const char* newline = cut < end ? memchr(cut, '\n', end - cut) : NULL;
+      cut = newline ? newline + 1 : end;
+    }
+
+    _workers[i].start = start;
+    _workers[i].length = cut - start;
+    _workers[i].count = 0;
+    start = cut;
+  }
+}
+
+static JsonLineWorker* json_lines_new(size_t _count, const char* _end, JsonArena* _arenas, size_t _blockSize) {
+  JsonLineWorker* workers = malloc(_count * sizeof(JsonLineWorker));
+  if (workers == NULL) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < _count; i++) {
+    JsonLineWorker* w = &workers[i];
+    w->start = NULL;
+    w->length = 0;
+    w->end = _end;
+    w->arena = &_arenas[i];
+    json_arena_init(w->arena, _blockSize);
+    w->records = NULL;
+    w->count = 0;
+    w->capacity = 0;
+    w->scratch = NULL;
+    w->scratchCapacity = 0;
+    w->failed = 0;
+  }
+  return workers;
+}
+
+static void json_lines_free(JsonLineWorker* _workers, size_t _count) {
+  for (size_t i = 0; i < _count; i++) {
+    free(_workers[i].records);
+    free(_workers[i].scratch);
+  }
+  free(_workers);
+}
+
+JsonBatch* json_decode_ndjson(const char* _json, size_t _len, size_t _threads)
+{
+  if (_json == NULL) {
+    return NULL;
+  }
+
+  size_t count = json_thread_count(_threads, _len);
+  JsonBatch* batch = malloc(sizeof(JsonBatch));
+  if (batch == NULL) {
+    return NULL;
+  }
+  batch->records = NULL;
+  batch->length = 0;
+  batch->arenaCount = 0;
+
+  // The batch owns the worker arenas from the start
+  batch->arenas = malloc(count * sizeof(JsonArena));
+  JsonLineWorker* workers = NULL;
+  if (batch->arenas != NULL) {
+    workers = json_lines_new(count, _json + _len, batch->arenas, _len / count);
+  }
+  if (workers == NULL) {
+    json_free_batch(batch);
+    return NULL;
+  }
+  batch->arenaCount = count;
+
+  json_lines_split(workers, count, _json, _len);
+  if (json_lines_runAll(workers, count) == 0) {
+    goto clean;
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += workers[i].count;
+  }
+
+  batch->records = malloc((total ? total : 1) * sizeof(JsonValue*));
+  if (batch->records == NULL) {
+    goto clean;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    memcpy(batch->records + batch->length, workers[i].records, workers[i].count * sizeof(JsonValue*));
+    batch->length += workers[i].count;
+  }
+
+  json_lines_free(workers, count);
+  return batch;
+
+ clean:
+  json_lines_free(workers, count);
+  json_free_batch(batch);
+  return NULL;
+}
+
+char json_decode_ndjsonEach(const char* _json, size_t _len, size_t _threads, JsonRecordCallback _callback, void* _data)
+{
+  if (_json == NULL || _callback == NULL) {
+    return 0;
+  }
+
+  // Two sets of workers, the pool decodes the next window of lines into one
+  // while the records of the other are handed over
+  size_t count = json_thread_count(_threads, _len);
+  const char* end = _json + _len;
+  JsonArena* arenas = malloc(2 * count * sizeof(JsonArena));
+  JsonLineWorker* sets[2] = {NULL, NULL};
+  if (arenas != NULL) {
+    sets[0] = json_lines_new(count, end, arenas, JSON_LINES_WINDOW);
+    sets[1] = json_lines_new(count, end, arenas + count, JSON_LINES_WINDOW);
+  }
+  if (sets[0] == NULL || sets[1] == NULL) {
+    free(sets[0]);
+    free(sets[1]);
+    free(arenas);
+    return 0;
+  }
+
+  JsonPool pool;
+  json_pool_init(&pool, count);
+
+  const char* start = _json;
+  const char* cut = json_lines_window(start, end, count);
+  json_lines_split(sets[0], count, start, cut - start);
+  json_pool_start(&pool, sets[0], sizeof(JsonLineWorker), json_lines_run);
+  start = cut;
+
+  size_t index = 0;
+  char ok = 1;
+  for (size_t round = 0;; round++) {
+    JsonLineWorker* ready = sets[round & 1];
+    json_pool_wait(&pool);
+    ok = ok && json_lines_ok(ready, count);
+
+    char more = ok && start < end;
+    if (more) {
+      JsonLineWorker* next = sets[(round + 1) & 1];
+      cut = json_lines_window(start, end, count);
+      json_lines_split(next, count, start, cut - start);
+      json_pool_start(&pool, next, sizeof(JsonLineWorker), json_lines_run);
+      start = cut;
+    }
+
+    // Records go out in order, then the arenas start again from their
+    // first block for the round after next
+    for (size_t i = 0; i < count; i++) {
+      for (size_t r = 0; ok && r < ready[i].count; r++) {
+	ok = _callback(_data, index++, ready[i].records[r]);
+      }
+      json_arena_reset(ready[i].arena);
+    }
+
+    if (more == 0) {
+      break;
+    }
+  }
+
+  json_pool_free(&pool);
+  json_lines_free(sets[0], count);
+  json_lines_free(sets[1], count);
+  for (size_t i = 0; i < 2 * count; i++) {
+    json_arena_free(&arenas[i]);
+  }
+  free(arenas);
+  return ok;
+}
+
+void json_free_batch(JsonBatch* _batch) {
+  if (_batch == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < _batch->arenaCount; i++) {
+    json_arena_free(&_batch->arenas[i]);
+  }
+  free(_batch->arenas);
+  free(_batch->records);
+  free(_batch);
+}
+
+/*********************
+ ** INDEXED DECODER **
+ *********************/
+
+// Stage 1 finds every structural character ({}[]:, and opening quotes) and
+// the first byte of every scalar outside strings, 64 bytes at a time.
+// Stage 2 builds the tree by walking those offsets.
+
+enum {
+  JSON_CLASS_QUOTE,
+  JSON_CLASS_BACKSLASH,
+  JSON_CLASS_SPACE,
+  JSON_CLASS_OPERATOR,
+  JSON_CLASS_COUNT
+};
+
+static unsigned json_ctz64(uint64_t _v) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(_v);
+#else
+  unsigned i = 0;
+  while ((_v & 1) == 0) {
+    _v >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+static void json_classify_block_scalar(const char* _block, uint64_t* _masks) {
+  for (size_t i = 0; i < JSON_CLASS_COUNT; i++) {
+    _masks[i] = 0;
+  }
+
+  for (size_t i = 0; i < 64; i++) {
+    uint64_t bit = 1ULL << i;
+    switch (_block[i]) {
+    case '"': _masks[JSON_CLASS_QUOTE] |= bit; break;
+    case '\\': _masks[JSON_CLASS_BACKSLASH] |= bit; break;
+    case ' ': case '\n': case '\r': case '\t': _masks[JSON_CLASS_SPACE] |= bit; break;
+    case '{': case '}': case '[': case ']': case ':': case ',': _masks[JSON_CLASS_OPERATOR] |= bit; break;
+    }
+  }
+}
+
+#if defined(JSON_SIMD_X86)
+// '{' '}' '[' ']' are 0x7B 0x7D 0x5B 0x5D, or-ing 0x20 folds the brackets onto the braces
+__attribute__((target("sse2")))
+static void json_classify_block_sse2(const char* _block, uint64_t* _masks) {
+  for (size_t i = 0; i < JSON_CLASS_COUNT; i++) {
+    _masks[i] = 0;
+  }
+
+  for (size_t i = 0; i < 64; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(_block + i));
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+			      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+    __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+			      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+
+    _masks[JSON_CLASS_QUOTE] |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))) << i;
+    _masks[JSON_CLASS_BACKSLASH] |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))) << i;
+    _masks[JSON_CLASS_SPACE] |= (uint64_t)(unsigned)_mm_movemask_epi8(ws) << i;
+    _masks[JSON_CLASS_OPERATOR] |= (uint64_t)(unsigned)_mm_movemask_epi8(op) << i;
+  }
+}
+
+__attribute__((target("avx2")))
+static void json_classify_block_avx2(const char* _block, uint64_t* _masks) {
+  for (size_t i = 0; i < JSON_CLASS_COUNT; i++) {
+    _masks[i] = 0;
+  }
+
+  for (size_t i = 0; i < 64; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(_block + i));
+    __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))),
+				 _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+    __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))),
+				 _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+
+    _masks[JSON_CLASS_QUOTE] |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))) << i;
+    _masks[JSON_CLASS_BACKSLASH] |= (uint64_t)(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))) << i;
+    _masks[JSON_CLASS_SPACE] |= (uint64_t)(unsigned)_mm256_movemask_epi8(ws) << i;
+    _masks[JSON_CLASS_OPERATOR] |= (uint64_t)(unsigned)_mm256_movemask_epi8(op) << i;
+  }
+}
+#endif
+
+static void json_classify_block(const char* _block, uint64_t* _masks) {
+#if defined(JSON_SIMD_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    json_classify_block_avx2(_block, _masks);
+    return;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    json_classify_block_sse2(_block, _masks);
+    return;
+  }
+#endif
+  json_classify_block_scalar(_block, _masks);
+}
+
+// Bit i is the xor of bits 0..i, turns quote positions into string spans
+static uint64_t json_prefix_xor(uint64_t _v) {
+  _v ^= _v << 1;
+  _v ^= _v << 2;
+  _v ^= _v << 4;
+  _v ^= _v << 8;
+  _v ^= _v << 16;
+  _v ^= _v << 32;
+  return _v;
+}
+
+typedef struct {
+  uint64_t escaped;  // The first byte of the next block is escaped
+  uint64_t inString; // All ones while a string continues into the next block
+} JsonBlockState;
+
+// Classify the 64 bytes at _base (the tail is padded with spaces). The quote
+// mask is left with unescaped quotes only, returns the mask of bytes inside
+// strings: opening quotes included, closing quotes excluded.
+static uint64_t json_scan_block(const char* _json, size_t _len, size_t _base, uint64_t* _masks, JsonBlockState* _state) {
+  const char* block = _json + _base;
+  char tail[64];
+  if (_len - _base < 64) {
+    for (size_t i = 0; i < 64; i++) {
+      tail[i] = _base + i < _len ? block[i] : ' ';
+    }
+    block = tail;
+  }
+
+  json_classify_block(block, _masks);
+
+  // A backslash escapes the next byte unless it's escaped itself,
+  // backslashes are rare enough to walk them one by one
+  uint64_t escaped = _state->escaped;
+  uint64_t backslash = _masks[JSON_CLASS_BACKSLASH] & ~_state->escaped;
+  _state->escaped = 0;
+  while (backslash) {
+    unsigned i = json_ctz64(backslash);
+    if (i == 63) {
+      _state->escaped = 1;
+      break;
+    }
+    escaped |= 2ULL << i;
+    backslash &= ~(3ULL << i);
+  }
+
+  _masks[JSON_CLASS_QUOTE] &= ~escaped;
+  uint64_t inString = json_prefix_xor(_masks[JSON_CLASS_QUOTE]) ^ _state->inString;
+  _state->inString = 0 - (inString >> 63);
+  return inString;
+}
+
+// Writes the offsets to _index (room for _len + 1 entries), returns the count
+static size_t json_structural_index(const char* _json, size_t _len, uint32_t* _index) {
+  uint64_t masks[JSON_CLASS_COUNT];
+  JsonBlockState state = {0, 0};
+  uint64_t prevSeparator = 1; // The last byte of the previous block ends a token
+  size_t count = 0;
+
+  for (size_t base = 0; base < _len; base += 64) {
+    uint64_t inString = json_scan_block(_json, _len, base, masks, &state);
+
+    uint64_t outside = ~inString;
+    uint64_t quote = masks[JSON_CLASS_QUOTE];
+    uint64_t space = masks[JSON_CLASS_SPACE];
+    uint64_t op = masks[JSON_CLASS_OPERATOR] & outside;
+    uint64_t separator = op | (space & outside) | (quote & outside);
+    uint64_t scalars = ((separator << 1) | prevSeparator) & ~(space | op | quote) & outside;
+    prevSeparator = separator >> 63;
+
+    uint64_t structurals = op | (quote & inString) | scalars;
+    while (structurals) {
+      _index[count++] = (uint32_t)(base + json_ctz64(structurals));
+      structurals &= structurals - 1;
+    }
+  }
+
+  return count;
+}
+
+typedef struct {
+  JsonStream* enc;
+  const uint32_t* index;
+  size_t count;
+  size_t next;
+} JsonTape;
+
+static char json_tape_value(JsonTape* _t, JsonValue* _v);
+
+static char json_tape_peek(const JsonTape* _t) {
+  return _t->next < _t->count ? _t->enc->start[_t->index[_t->next]] : '\0';
+}
+
+// Point the stream at the next structural
+static void json_tape_seek(JsonTape* _t) {
+  JsonStream* enc = _t->enc;
+  size_t total = enc->position + enc->length;
+  size_t pos = _t->next < _t->count ? _t->index[_t->next] : total;
+  enc->current = enc->start + pos;
+  enc->position = pos;
+  enc->length = total - pos;
+}
+
+// Only whitespace may sit between a token and the next structural
+static char json_tape_tokenEnd(JsonTape* _t) {
+  json_string_ltrim(_t->enc);
+  _t->next++;
+  return _t->next >= _t->count || _t->enc->position == _t->index[_t->next];
+}
+
+static JsonObject* json_tape_object(JsonTape* _t) {
+  size_t base = _t->enc->scratchLength;
+  _t->next++;
+
+  while (json_tape_peek(_t) != JSON_OBJECT_END) {
+    if (json_tape_peek(_t) != JSON_STRING) {
+      goto clean;
+    }
+
+    JsonObjectAttribute attr;
+    attr.name.value = NULL;
+    attr.value.type = JSON_NULL;
+    attr.value.data = NULL;
+    json_tape_seek(_t);
+    if (json_decode_stringInto(_t->enc, &attr.name) == 0) {
+      goto clean;
+    }
+    if (json_tape_tokenEnd(_t) == 0 || json_tape_peek(_t) != ':') {
+      goto cleanAttribute;
+    }
+
+    _t->next++;
+    if (json_tape_value(_t, &attr.value) == 0) {
+      goto cleanAttribute;
+    }
+    if (json_scratch_push(_t->enc, &attr, sizeof(attr)) == 0) {
+      goto cleanAttribute;
+    }
+
+    if (json_tape_peek(_t) == ',') {
+      _t->next++;
+    }
+    else if (json_tape_peek(_t) != JSON_OBJECT_END) {
+      goto clean;
+    }
+    continue;
+
+  cleanAttribute:
+    if (_t->enc->arena == NULL) {
+      json_free_objectAttribute(&attr);
+    }
+    goto clean;
+  }
+
+  _t->next++;
+  return json_new_object(_t->enc, base);
+
+ clean:
+  json_scratch_drop(_t->enc, base, JSON_OBJECT);
+  return NULL;
+}
+
+static JsonArray* json_tape_array(JsonTape* _t) {
+  size_t base = _t->enc->scratchLength;
+  _t->next++;
+
+  while (json_tape_peek(_t) != JSON_ARRAY_END) {
+    JsonValue item;
+    if (json_tape_value(_t, &item) == 0) {
+      goto clean;
+    }
+    if (json_scratch_push(_t->enc, &item, sizeof(item)) == 0) {
+      if (_t->enc->arena == NULL) {
+	json_free_value(&item);
+      }
+      goto clean;
+    }
+
+    if (json_tape_peek(_t) == ',') {
+      _t->next++;
+    }
+    else if (json_tape_peek(_t) != JSON_ARRAY_END) {
+      goto clean;
+    }
+  }
+
+  _t->next++;
+  return json_new_array(_t->enc, base);
+
+ clean:
+  json_scratch_drop(_t->enc, base, JSON_ARRAY);
+  return NULL;
+}
+
+static char json_tape_value(JsonTape* _t, JsonValue* _v) {
+  if (_t->next >= _t->count) {
+    return 0;
+  }
+
+  JsonValue* data = _v;
+  data->type = -1;
+  data->data = NULL;
+  char ok = 0;
+
+  json_tape_seek(_t);
+  char c = json_tape_peek(_t);
+  switch (c) {
+  case JSON_OBJECT:
+    data->type = JSON_OBJECT;
+    ok = (data->data = json_tape_object(_t)) != NULL;
+    break;
+  case JSON_ARRAY:
+    data->type = JSON_ARRAY;
+    ok = (data->data = json_tape_array(_t)) != NULL;
+    break;
+  case JSON_STRING:
+    data->type = JSON_STRING;
+    ok = (data->data = json_decode_string(_t->enc)) != NULL && json_tape_tokenEnd(_t);
+    break;
+  case 't': case 'f':
+    data->type = JSON_BOOL;
+    ok = json_decode_bool(_t->enc, data) && json_tape_tokenEnd(_t);
+    break;
+  case 'n':
+    data->type = JSON_NULL;
+    ok = json_decode_null(_t->enc, data) && json_tape_tokenEnd(_t);
+    break;
+  default:
+    if (c == '-' || json_is_digit(c)) {
+      data->type = JSON_NUMBER;
+      ok = json_decode_number(_t->enc, data) && json_tape_tokenEnd(_t);
+    }
+    break;
+  }
+
+  if (ok == 0) {
+    if (_t->enc->arena == NULL) {
+      json_free_value(data);
+    }
+    data->type = JSON_NULL;
+    data->data = NULL;
+  }
+
+  return ok;
+}
+
+JsonValue* json_decode_indexed(const char* _json, size_t _len)
+{
+  if (_json == NULL || _len < 1) {
+    return NULL;
+  }
+
+  // Offsets are 32 bits wide
+  if (_len >= UINT32_MAX) {
+    return json_decode_n(_json, _len);
+  }
+
+  JsonTape t;
+  t.enc = json_stream(_json, _len, NULL);
+  t.index = NULL;
+  t.count = 0;
+  t.next = 0;
+
+  uint32_t* index = malloc(sizeof(uint32_t) * (_len + 1));
+  JsonValue* data = NULL;
+  if (index == NULL) {
+    goto clean;
+  }
+
+  t.count = json_structural_index(_json, _len, index);
+  t.index = index;
+
+  if (json_tape_peek(&t) != JSON_OBJECT && json_tape_peek(&t) != JSON_ARRAY) {
+    goto clean;
+  }
+
+  data = malloc(sizeof(JsonValue));
+  if (json_tape_value(&t, data) == 0) {
+    free(data);
+    goto clean;
+  }
+
+  free(index);
+  json_scratch_free(t.enc);
+  free(t.enc);
+  return data;
+
+ clean:
+  json_scratch_free(t.enc);
+  if (t.next >= t.count && t.count) {
+    t.next = t.count - 1;
+  }
+  json_tape_seek(&t);
+  free(index);
+
+  data = malloc(sizeof(JsonValue));
+  data->type = JSON_ERROR;
+  data->data = t.enc;
+  return data;
+}
+
+/**********************
+ ** PARALLEL DECODER **
+ **********************/
+
+// A root array is cut at top level commas found by a structural pre-scan.
+// Each worker decodes its run of elements into its own arena, the items are
+// then copied into one vector and the worker blocks handed to the document.
+// The worker arenas themselves live in the document, objects point to them.
+// Anything a worker can't decode, trailing commas included, sends the whole
+// input through the serial decoder so errors come out the same.
+typedef struct {
+  JsonStream enc; // The run of elements, items collect on its scratch stack
+  JsonArena* arena;
+  unsigned char ok;
+} JsonRangeWorker;
+
+static void json_range_run(void* _task) {
+  JsonRangeWorker* w = (JsonRangeWorker*)_task;
+  JsonStream* enc = &w->enc;
+  w->ok = 0;
+
+  for (;;) {
+    JsonValue item;
+    if (json_decode_value(enc, &item) == 0 || json_scratch_push(enc, &item, sizeof(item)) == 0) {
+      return;
+    }
+
+    json_string_ltrim(enc);
+    if (enc->length == 0) {
+      break;
+    }
+    if (json_stream_peek(enc) != ',') {
+      return;
+    }
+    json_move_stream(enc, 1);
+  }
+
+  w->ok = 1;
+}
+
+// Offsets of up to _count - 1 commas between elements of the array opened at
+// _open, each the first one past an even share of the input. Returns how
+// many were found, fewer when the array has fewer elements.
+static size_t json_range_split(const char* _json, size_t _len, size_t _open, size_t _count, size_t* _cuts) {
+  uint64_t masks[JSON_CLASS_COUNT];
+  JsonBlockState state = {0, 0};
+  size_t found = 0;
+  size_t target = _len / _count;
+  size_t depth = 0;
+
+  for (size_t base = _open & ~(size_t)63; base < _len && found + 1 < _count; base += 64) {
+    uint64_t inString = json_scan_block(_json, _len, base, masks, &state);
+    uint64_t op = masks[JSON_CLASS_OPERATOR] & ~inString;
+    if (base < _open) {
+      op &= ~0ULL << (_open - base);
+    }
+
+    while (op) {
+      size_t pos = base + json_ctz64(op);
+      op &= op - 1;
+
+      switch (_json[pos]) {
+      case JSON_OBJECT: case JSON_ARRAY:
+	depth++;
+	break;
+      case JSON_OBJECT_END: case JSON_ARRAY_END:
+	if (--depth == 0) {
+	  return found;
+	}
+	break;
+      case ',':
+	if (depth == 1 && pos >= target) {
+	  _cuts[found++] = pos;
+	  target = _len / _count * (found + 1);
+	  if (found + 1 == _count) {
+	    return found;
+	  }
+	}
+	break;
+      }
+    }
+  }
+
+  return found;
+}
+
+JsonDocument* json_decode_parallel(const char* _json, size_t _len, size_t _threads)
+{
+  if (_json == NULL || _len < 1) {
+    return NULL;
+  }
+
+  // The array runs from the first to the last non blank byte
+  size_t open = 0;
+  while (open < _len && json_is_space(_json[open])) {
+    open++;
+  }
+  size_t close = _len;
+  while (close > open && json_is_space(_json[close - 1])) {
+    close--;
+  }
+
+  size_t count = json_thread_count(_threads, _len);
+  if (count < 2 || close - open < 2 || _json[open] != JSON_ARRAY || _json[close - 1] != JSON_ARRAY_END) {
+    return json_decode_documentStream(_json, _len, NULL);
+  }
+  close--;
+
+  size_t* cuts = malloc((count - 1) * sizeof(size_t));
+  JsonRangeWorker* workers = malloc(count * sizeof(JsonRangeWorker));
+  JsonDocument* doc = malloc(sizeof(JsonDocument));
+  if (cuts == NULL || workers == NULL || doc == NULL) {
+    free(cuts);
+    free(workers);
+    free(doc);
+    return json_decode_documentStream(_json, _len, NULL);
+  }
+
+  json_arena_init(&doc->arena, 0);
+  doc->buffer = NULL;
+  doc->bufferLength = 0;
+
+  count = json_range_split(_json, _len, open, count, cuts) + 1;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t start = i == 0 ? open + 1 : cuts[i - 1] + 1;
+    size_t end = i + 1 < count ? cuts[i] : close;
+
+    JsonRangeWorker* w = &workers[i];
+    w->arena = json_arena_alloc(&doc->arena, sizeof(JsonArena));
+    json_arena_init(w->arena, (end - start) * 2);
+    json_stream_init(&w->enc, _json + start, end - start, w->arena);
+    w->enc.padded = _len - end >= JSON_PADDING;
+  }
+
+  if (count > 1) {
+    json_thread_runAll(workers, sizeof(JsonRangeWorker), count, json_range_run);
+  }
+
+  char ok = count > 1;
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    ok = ok && workers[i].ok;
+    total += workers[i].enc.scratchLength;
+  }
+
+  if (ok) {
+    JsonValue* root = json_arena_alloc(&doc->arena, sizeof(JsonValue));
+    JsonArray* arr = json_arena_alloc(&doc->arena, sizeof(JsonArray));
+    arr->items = json_arena_alloc(&doc->arena, total);
+    arr->length = 0;
+    root->type = JSON_ARRAY;
+    root->flags = 0;
+    root->data = arr;
+    doc->root = root;
+
+    // Worker blocks go behind the document's own, they are full
+    JsonArenaBlock* last = doc->arena.first;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+      memcpy(arr->items + arr->length, workers[i].enc.scratch, workers[i].enc.scratchLength);
+      arr->length += workers[i].enc.scratchLength / sizeof(JsonValue);
+
+      last->next = workers[i].arena->first;
+      while (last->next != NULL) {
+	last = last->next;
+      }
+      workers[i].arena->first = NULL;
+      workers[i].arena->parent = &doc->arena;
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    json_scratch_free(&workers[i].enc);
+    json_arena_free(workers[i].arena);
+  }
+  free(workers);
+  free(cuts);
+
+  if (ok == 0) {
+    json_free_document(doc);
+    return json_decode_documentStream(_json, _len, NULL);
+  }
+  return doc;
+}
+
+/************
+ ** FROZEN **
+ ************/
+
+// Every object big enough for an index gets it now, later lookups only read
+static void json_freeze_value(const JsonValue* _v) {
+  if (_v->type == JSON_OBJECT) {
+    const JsonObject* obj = (const JsonObject*)_v->data;
+    if (obj->length >= JSON_OBJECT_INDEX_MIN) {
+      json_index_object(obj);
+    }
+    for (size_t i = 0; i < obj->length; i++) {
+      json_freeze_value(&obj->attributes[i].value);
+    }
+  }
+  else if (_v->type == JSON_ARRAY) {
+    const JsonArray* arr = (const JsonArray*)_v->data;
+    for (size_t i = 0; i < arr->length; i++) {
+      json_freeze_value(&arr->items[i]);
+    }
+  }
+}
+
+JsonFrozen* json_freeze(JsonDocument* _doc) {
+  if (_doc == NULL) {
+    return NULL;
+  }
+
+  JsonFrozen* frozen = malloc(sizeof(JsonFrozen));
+  if (frozen == NULL) {
+    return NULL;
+  }
+
+  json_freeze_value(_doc->root);
+  frozen->doc = _doc;
+  frozen->references = 1;
+  return frozen;
+}
+
+const JsonValue* json_frozen_root(const JsonFrozen* _frozen) {
+  return _frozen ? _frozen->doc->root : NULL;
+}
+
+JsonFrozen* json_frozen_retain(JsonFrozen* _frozen) {
+  if (_frozen != NULL) {
+    json_atomic_addSize(&_frozen->references, 1);
+  }
+  return _frozen;
+}
+
+void json_frozen_release(JsonFrozen* _frozen) {
+  if (_frozen == NULL || json_atomic_addSize(&_frozen->references, (size_t)-1) != 0) {
+    return;
+  }
+
+  json_free_document(_frozen->doc);
+  free(_frozen);
+}
+
+// A reader registers in the counter of the generation it saw before loading
+// current and leaves once it holds a reference. A publisher swaps current,
+// moves to the next generation and waits for the previous generation's
+// readers, only they can still be holding the old pointer unretained.
+void json_slot_init(JsonFrozenSlot* _slot, JsonFrozen* _frozen) {
+  _slot->current = _frozen;
+  _slot->readers[0] = 0;
+  _slot->readers[1] = 0;
+  _slot->generation = 0;
+  _slot->publishing = 0;
+}
+
+JsonFrozen* json_slot_acquire(JsonFrozenSlot* _slot) {
+  size_t generation;
+  for (;;) {
+    generation = json_atomic_loadSize(&_slot->generation);
+    json_atomic_addSize(&_slot->readers[generation & 1], 1);
+    if (json_atomic_loadSize(&_slot->generation) == generation) {
+      break;
+    }
+    // A publisher moved on in between, it may not wait for us
+    json_atomic_addSize(&_slot->readers[generation & 1], (size_t)-1);
+  }
+
+  JsonFrozen* frozen = json_frozen_retain(json_atomic_loadPtr((void* volatile*)&_slot->current));
+  json_atomic_addSize(&_slot->readers[generation & 1], (size_t)-1);
+  return frozen;
+}
+
+void json_slot_publish(JsonFrozenSlot* _slot, JsonFrozen* _frozen) {
+  // Publishers take turns, readers never wait
+  while (json_atomic_addSize(&_slot->publishing, 1) != 1) {
+    json_atomic_addSize(&_slot->publishing, (size_t)-1);
+    json_thread_yield();
+  }
+
+  JsonFrozen* old = json_atomic_swapPtr((void* volatile*)&_slot->current, _frozen);
+  size_t generation = json_atomic_addSize(&_slot->generation, 1) - 1;
+  while (json_atomic_loadSize(&_slot->readers[generation & 1]) != 0) {
+    json_thread_yield();
+  }
+
+  json_atomic_addSize(&_slot->publishing, (size_t)-1);
+  json_frozen_release(old);
+}
+
+/************
+ ** PARSER **
+ ************/
+
+// Push parser, the document arrives in chunks. Containers are kept on an
+// explicit stack and a token cut by the end of a chunk is copied to the
+// scratch buffer until the rest of it comes in.
+
+enum {
+  JSON_PARSER_ROOT,  // Waiting for the root object or array
+  JSON_PARSER_VALUE, // A value, or ']' when the array can end
+  JSON_PARSER_KEY,   // A key, or '}' when the object can end
+  JSON_PARSER_COLON,
+  JSON_PARSER_NEXT,  // ',' or the end of the current container
+  JSON_PARSER_DONE,
+  JSON_PARSER_ERROR
+};
+
+JsonParser* json_parser_new(void) {
+  JsonParser* p = malloc(sizeof(JsonParser));
+  if (p == NULL) {
+    return NULL;
+  }
+  json_stream_init(&p->enc, NULL, 0, NULL);
+  json_arena_init(&p->arena, 0);
+  p->root = NULL;
+  p->stack = NULL;
+  p->depth = 0;
+  p->stackCapacity = 0;
+  p->token = NULL;
+  p->tokenLength = 0;
+  p->tokenCapacity = 0;
+  p->tokenType = 0;
+  p->escaped = 0;
+  p->state = JSON_PARSER_ROOT;
+  p->offset = 0;
+  return p;
+}
+
+static void json_parser_clear(JsonParser* _p) {
+  if (_p->enc.arena == NULL) {
+    json_free(_p->root);
+  }
+  // Children of the containers still open
+  while (_p->depth) {
+    _p->depth--;
+    json_scratch_drop(&_p->enc, _p->stack[_p->depth].base, _p->stack[_p->depth].type);
+  }
+  _p->root = NULL;
+  _p->depth = 0;
+  _p->tokenLength = 0;
+  _p->tokenType = 0;
+  _p->escaped = 0;
+  _p->state = JSON_PARSER_ROOT;
+  _p->offset = 0;
+}
+
+void json_parser_free(JsonParser* _p) {
+  if (_p == NULL) {
+    return;
+  }
+
+  json_parser_clear(_p);
+  json_scratch_free(&_p->enc);
+  json_arena_free(&_p->arena);
+  free(_p->stack);
+  free(_p->token);
+  free(_p);
+}
+
+void json_parser_reset(JsonParser* _p) {
+  if (_p == NULL) {
+    return;
+  }
+
+  json_parser_clear(_p);
+  json_arena_reset(&_p->arena);
+}
+
+JsonValue* json_parser_decode(JsonParser* _p, const char* _json, size_t _len) {
+  if (_p == NULL || _json == NULL || _len < 1) {
+    return NULL;
+  }
+
+  // Children go on the parser's scratch stack above anything a push parse
+  // left there, the stream itself stays on the stack
+  JsonStream enc;
+  json_stream_init(&enc, _json, _len, &_p->arena);
+  enc.scratch = _p->enc.scratch;
+  enc.scratchLength = _p->enc.scratchLength;
+  enc.scratchCapacity = _p->enc.scratchCapacity;
+
+  JsonValue* root = json_decode_rootValue(&enc);
+  _p->enc.scratch = enc.scratch;
+  _p->enc.scratchCapacity = enc.scratchCapacity;
+
+  if (root->type == JSON_ERROR) {
+    JsonStream* kept = json_arena_alloc(&_p->arena, sizeof(JsonStream));
+    if (kept == NULL) {
+      return NULL;
+    }
+    *kept = enc;
+    kept->scratch = NULL;
+    kept->scratchLength = 0;
+    kept->scratchCapacity = 0;
+    root->data = kept;
+  }
+
+  return root;
+}
+
+static void json_parser_fail(JsonParser* _p, size_t _pos) {
+  _p->state = JSON_PARSER_ERROR;
+  _p->offset += _pos;
+}
+
+// Buffer part of a token split across chunks, 0 when out of memory
+static char json_parser_keep(JsonParser* _p, const char* _bytes, size_t _len) {
+  if (_p->tokenLength + _len > _p->tokenCapacity) {
+    size_t capacity = _p->tokenCapacity ? _p->tokenCapacity : 64;
+    while (capacity < _p->tokenLength + _len) {
+      capacity *= 2;
+    }
+    char* token = realloc(_p->token, capacity);
+    if (token == NULL) {
+      return 0;
+    }
+    _p->token = token;
+    _p->tokenCapacity = capacity;
+  }
+
+  memcpy(_p->token + _p->tokenLength, _bytes, _len);
+  _p->tokenLength += _len;
+  return 1;
+}
+
+// Point the parser stream at a complete token
+static JsonStream* json_parser_stream(JsonParser* _p, const char* _bytes, size_t _len) {
+  _p->enc.current = _bytes;
+  _p->enc.start = _bytes;
+  _p->enc.position = 0;
+  _p->enc.length = _len;
+  return &_p->enc;
+}
+
+// Hook a finished value into the container on top of the stack
+static char json_parser_attach(JsonParser* _p, JsonValue* _v) {
+  JsonParserFrame* top = &_p->stack[_p->depth - 1];
+  _p->state = JSON_PARSER_NEXT;
+  if (top->type == JSON_ARRAY) {
+    return json_scratch_push(&_p->enc, _v, sizeof(JsonValue));
+  }
+
+  // The attribute waiting for its value is the last one pushed
+  JsonObjectAttribute* attr = (JsonObjectAttribute*)(_p->enc.scratch + _p->enc.scratchLength) - 1;
+  attr->value = *_v;
+  return 1;
+}
+
+// 0 when out of memory
+static char json_parser_open(JsonParser* _p, char _type) {
+  if (_p->depth == _p->stackCapacity) {
+    size_t capacity = _p->stackCapacity ? _p->stackCapacity * 2 : 16;
+    JsonParserFrame* stack = realloc(_p->stack, sizeof(JsonParserFrame) * capacity);
+    if (stack == NULL) {
+      return 0;
+    }
+    _p->stack = stack;
+    _p->stackCapacity = capacity;
+  }
+  _p->stack[_p->depth].type = _type;
+  _p->stack[_p->depth].base = _p->enc.scratchLength;
+  _p->depth++;
+  _p->state = _type == JSON_OBJECT ? JSON_PARSER_KEY : JSON_PARSER_VALUE;
+  return 1;
+}
+
+static char json_parser_close(JsonParser* _p) {
+  JsonParserFrame* top = &_p->stack[--_p->depth];
+  JsonValue v;
+  v.type = top->type;
+  if (top->type == JSON_OBJECT) {
+    v.data = json_new_object(&_p->enc, top->base);
+  }
+  else {
+    v.data = json_new_array(&_p->enc, top->base);
+  }
+
+  if (_p->depth) {
+    if (json_parser_attach(_p, &v) == 0) {
+      if (_p->enc.arena == NULL) {
+	json_free_value(&v);
+      }
+      return 0;
+    }
+    return 1;
+  }
+
+  _p->root = json_alloc(&_p->enc, sizeof(JsonValue));
+  *_p->root = v;
+  _p->state = JSON_PARSER_DONE;
+  return 1;
+}
+
+// A string token with its quotes or a scalar token
+static char json_parser_token(JsonParser* _p, char _type, const char* _bytes, size_t _len) {
+  JsonStream* enc = json_parser_stream(_p, _bytes, _len);
+
+  if (_p->state == JSON_PARSER_KEY) {
+    JsonObjectAttribute attr;
+    attr.value.type = JSON_NULL;
+    attr.value.data = NULL;
+    if (json_decode_stringInto(enc, &attr.name) == 0) {
+      return 0;
+    }
+
+    if (json_scratch_push(enc, &attr, sizeof(attr)) == 0) {
+      if (enc->arena == NULL) {
+	free(attr.name.value);
+      }
+      return 0;
+    }
+    _p->state = JSON_PARSER_COLON;
+    return 1;
+  }
+
+  JsonValue value;
+  JsonValue* v = &value;
+  v->data = NULL;
+  char ok = 0;
+
+  if (_type == JSON_STRING) {
+    v->type = JSON_STRING;
+    ok = (v->data = json_decode_string(enc)) != NULL;
+  }
+  else if (_bytes[0] == 't' || _bytes[0] == 'f') {
+    v->type = JSON_BOOL;
+    ok = json_decode_bool(enc, v);
+  }
+  else if (_bytes[0] == 'n') {
+    v->type = JSON_NULL;
+    ok = json_decode_null(enc, v);
+  }
+  else {
+    v->type = JSON_NUMBER;
+    ok = json_decode_number(enc, v);
+  }
+
+  // The whole token must be used
+  if (ok == 0 || enc->length != 0 || json_parser_attach(_p, v) == 0) {
+    if (enc->arena == NULL) {
+      json_free_value(v);
+    }
+    return 0;
+  }
+
+  return 1;
+}
+
+// Bytes of the string in _str up to and including its closing quote, or
+// _len when the string goes on in the next chunk
+static size_t json_parser_stringEnd(JsonParser* _p, const char* _str, size_t _len, char* _closed) {
+  size_t i = 0;
+  *_closed = 0;
+  if (_p->escaped) {
+    if (_len == 0) {
+      return 0;
+    }
+    _p->escaped = 0;
+    i = 1;
+  }
+
+  while (i < _len) {
+    i += json_scan_string(_str + i, _len - i, 0);
+    if (i >= _len) {
+      break;
+    }
+    if (_str[i] == JSON_STRING) {
+      *_closed = 1;
+      return i + 1;
+    }
+
+    // Backslash, the byte it escapes may be in the next chunk
+    if (i + 1 == _len) {
+      _p->escaped = 1;
+      return _len;
+    }
+    i += 2;
+  }
+
+  return _len;
+}
+
+static char json_is_delimiter(char c) {
+  return json_is_space(c) || c == ',' || c == JSON_ARRAY_END || c == JSON_OBJECT_END;
+}
+
+static size_t json_parser_scalarEnd(const char* _str, size_t _len) {
+  size_t i = 0;
+  while (i < _len && json_is_delimiter(_str[i]) == 0) {
+    i++;
+  }
+  return i;
+}
+
+// Carry on with a token from the previous chunk, returns the bytes used
+static size_t json_parser_resume(JsonParser* _p, const char* _chunk, size_t _len) {
+  size_t end;
+  char closed;
+  if (_p->tokenType == JSON_STRING) {
+    end = json_parser_stringEnd(_p, _chunk, _len, &closed);
+  }
+  else {
+    end = json_parser_scalarEnd(_chunk, _len);
+    closed = end < _len;
+  }
+
+  if (json_parser_keep(_p, _chunk, end) == 0) {
+    json_parser_fail(_p, 0);
+    return end;
+  }
+
+  if (closed == 0) {
+    return end;
+  }
+
+  char type = _p->tokenType;
+  _p->tokenType = 0;
+  if (json_parser_token(_p, type, _p->token, _p->tokenLength) == 0) {
+    json_parser_fail(_p, 0);
+  }
+  _p->tokenLength = 0;
+  return end;
+}
+
+char json_parser_feed(JsonParser* _p, const char* _chunk, size_t _len) {
+  if (_p == NULL || _p->state == JSON_PARSER_ERROR) {
+    return 0;
+  }
+
+  size_t i = 0;
+  if (_p->tokenType != 0) {
+    i = json_parser_resume(_p, _chunk, _len);
+    if (_p->state == JSON_PARSER_ERROR) {
+      return 0;
+    }
+  }
+
+  while (i < _len && _p->state != JSON_PARSER_DONE) {
+    i += json_skip_space(_chunk + i, _len - i, 0);
+    if (i >= _len) {
+      break;
+    }
+
+    char c = _chunk[i];
+    char type = _p->depth ? _p->stack[_p->depth - 1].type : 0;
+    switch (_p->state) {
+    case JSON_PARSER_ROOT:
+      if (c != JSON_OBJECT && c != JSON_ARRAY) {
+	goto fail;
+      }
+      if (json_parser_open(_p, c) == 0) {
+	goto fail;
+      }
+      i++;
+      continue;
+
+    case JSON_PARSER_COLON:
+      if (c != ':') {
+	goto fail;
+      }
+      _p->state = JSON_PARSER_VALUE;
+      i++;
+      continue;
+
+    case JSON_PARSER_NEXT:
+      if (c == ',') {
+	_p->state = type == JSON_OBJECT ? JSON_PARSER_KEY : JSON_PARSER_VALUE;
+      }
+      else if ((c != JSON_OBJECT_END || type != JSON_OBJECT) && (c != JSON_ARRAY_END || type != JSON_ARRAY)) {
+	goto fail;
+      }
+      else if (json_parser_close(_p) == 0) {
+	goto fail;
+      }
+      i++;
+      continue;
+
+    case JSON_PARSER_KEY:
+      if (c == JSON_OBJECT_END) {
+	if (json_parser_close(_p) == 0) {
+	  goto fail;
+	}
+	i++;
+	continue;
+      }
+      if (c != JSON_STRING) {
+	goto fail;
+      }
+      break;
+
+    case JSON_PARSER_VALUE:
+      if (c == JSON_ARRAY_END && type == JSON_ARRAY) {
+	if (json_parser_close(_p) == 0) {
+	  goto fail;
+	}
+	i++;
+	continue;
+      }
+      if (c == JSON_OBJECT || c == JSON_ARRAY) {
+	if (json_parser_open(_p, c) == 0) {
+	  goto fail;
+	}
+	i++;
+	continue;
+      }
+      if (c == ',' || c == ':' || c == JSON_OBJECT_END || c == JSON_ARRAY_END) {
+	goto fail;
+      }
+      break;
+    }
+
+    // String or scalar token
+    size_t end;
+    char closed;
+    if (c == JSON_STRING) {
+      end = i + 1 + json_parser_stringEnd(_p, _chunk + i + 1, _len - i - 1, &closed);
+    }
+    else {
+      end = i + json_parser_scalarEnd(_chunk + i, _len - i);
+      closed = end < _len;
+    }
+
+    if (closed == 0) {
+      _p->tokenType = c == JSON_STRING ? JSON_STRING : JSON_NUMBER;
+      if (json_parser_keep(_p, _chunk + i, end - i) == 0) {
+	goto fail;
+      }
+      break;
+    }
+
+    if (json_parser_token(_p, c == JSON_STRING ? JSON_STRING : JSON_NUMBER, _chunk + i, end - i) == 0) {
+      goto fail;
+    }
+    i = end;
+  }
+
+  _p->offset += _len;
+  return 1;
+
+ fail:
+  json_parser_fail(_p, i);
+  return 0;
+}
+
+JsonValue* json_parser_finish(JsonParser* _p) {
+  if (_p == NULL) {
+    return NULL;
+  }
+
+  // A scalar can't be the root so no token may still be open
+  if (_p->state == JSON_PARSER_DONE && _p->tokenType == 0) {
+    JsonValue* root = _p->root;
+    _p->root = NULL;
+    json_parser_clear(_p);
+    return root;
+  }
+
+  JsonStream* s = malloc(sizeof(JsonStream));
+  json_stream_init(s, "", 0, NULL);
+  s->position = _p->offset;
+  json_parser_clear(_p);
+
+  JsonValue* data = malloc(sizeof(JsonValue));
+  data->type = JSON_ERROR;
+  data->data = s;
+  return data;
+}
+
+JsonError json_get_errorMsg(JsonValue* _e) {
+  JsonError e = {0};
+  size_t len = sizeof(e.msg) - 1;
+
+  if (_e == NULL) {
+    json_string_cat(e.msg, len, "ERROR: No Json error data passed");
+    return e;
+  }
+
+  if (_e->type != JSON_ERROR) {
+    json_string_cat(e.msg, len, "ERROR: Not a valid Json error data passed");
+    return e;
+  }
+
+  JsonStream* s = (JsonStream*)_e->data;
+  snprintf(e.msg, len, "ERROR: Invalid syntax at offset( %ld ): %.*s", s->position, (int)(s->length < len ? s->length : len), s->current);
+  return e;
+}
+
+// 0.name
+// obj.name
+const JsonValue* json_get(const JsonValue* _v, const char* _path) {
+  if (_v == NULL) {
+    return NULL;
+  }
+
+  size_t len = json_string_length(_path);
+  if (len < 1) {
+    return NULL;
+  }
+
+  const JsonValue* v = NULL;
+  JsonObject* obj = NULL;
+  JsonArray* arr = NULL;
+  JsonObjectAttribute* objA = NULL;
+
+  char type = json_is_digit(_path[0]) ? JSON_ARRAY : JSON_OBJECT;
+
+  ssize_t end = json_string_indexOf('.', _path, len, 0);
+  char last = 0;
+  if (end < 0) {
+    last = 1;
+    end = len;
+  }
+
+  const char* name = _path;
+
+  if (type != _v->type) {
+    goto clean;
+  }
+
+  switch (_v->type) {
+  case JSON_OBJECT:
+    obj = (JsonObject*)_v->data;
+    name++;
+    objA = json_get_objectAttribute(obj, name, end - 2);
+    if (objA == NULL) {
+      goto clean;
+    }
+    v = &objA->value;
+    break;
+
+  case JSON_ARRAY:
+    arr = (JsonArray*)_v->data;
+    ssize_t index = json_string_to_size(name, end);
+    if (index < 0) {
+      goto clean;
+    }
+    v = json_get_arrayItem(arr, index);
+    if (v == NULL) {
+      goto clean;
+    }
+    break;
+
+  default:
+    goto clean;
+  }
+
+  if (last != 1) {
+    v = json_get(v, _path + end + 1);
+  }
+
+ clean:
+  return v;
+}
+
+JsonPath* json_path_compile(const char* _path) {
+  size_t len = json_string_length(_path);
+  if (len < 1) {
+    return NULL;
+  }
+
+  size_t count = 1;
+  for (size_t i = 0; i < len; i++) {
+    if (_path[i] == '.') {
+      count++;
+    }
+  }
+
+  // Segments and a copy of the names in one block
+  JsonPath* path = malloc(sizeof(JsonPath) + sizeof(JsonPathSegment) * count + len + 1);
+  if (path == NULL) {
+    return NULL;
+  }
+  path->segments = (JsonPathSegment*)(path + 1);
+  path->length = count;
+  char* names = (char*)(path->segments + count);
+  for (size_t i = 0; i <= len; i++) {
+    names[i] = _path[i];
+  }
+
+  const char* seg = names;
+  for (size_t i = 0; i < count; i++) {
+    ssize_t end = json_string_indexOf('.', seg, len - (seg - names), 0);
+    if (end < 0) {
+      end = len - (seg - names);
+    }
+
+    JsonPathSegment* s = &path->segments[i];
+    if (end >= 2 && seg[0] == JSON_OBJECT && seg[end - 1] == JSON_OBJECT_END) {
+      s->type = JSON_OBJECT;
+      s->name = seg + 1;
+      s->length = end - 2;
+      s->hash = json_string_hash(s->name, s->length);
+      s->index = 0;
+    }
+    else {
+      ssize_t index = json_string_to_size(seg, end);
+      if (end < 1 || index < 0) {
+	free(path);
+	return NULL;
+      }
+      s->type = JSON_ARRAY;
+      s->name = NULL;
+      s->length = 0;
+      s->hash = 0;
+      s->index = index;
+    }
+
+    seg += end + 1;
+  }
+
+  return path;
+}
+
+void json_path_free(JsonPath* _path) {
+  free(_path);
+}
+
+const JsonValue* json_get_compiled(const JsonValue* _v, const JsonPath* _path) {
+  if (_path == NULL) {
+    return NULL;
+  }
+
+  const JsonValue* v = _v;
+  for (size_t i = 0; i < _path->length && v != NULL; i++) {
+    const JsonPathSegment* s = &_path->segments[i];
+    if (v->type != s->type) {
+      return NULL;
+    }
+
+    if (s->type == JSON_OBJECT) {
+      JsonObjectAttribute* attr = json_get_objectAttributeHashed(v->data, s->name, s->length, s->hash);
+      v = attr ? &attr->value : NULL;
+    }
+    else {
+      v = json_get_arrayItem(v->data, s->index);
+    }
+  }
+
+  return v;
+}
+
+/***********
+ ** DTOA **
+ ***********/
+
+// Shortest digits that read back to the same double, Grisu3 over 64 bit
+// "do it yourself" floating point numbers (Loitsch, Printing Floating-Point
+// Numbers Quickly and Accurately with Integers). Grisu3 knows when its
+// answer may not be the shortest or the closest, the 0.5% of values it
+// cannot decide are redone on exact decimals.
+
+typedef struct {
+  uint64_t f;
+  int e;
+} JsonDiyFp;
+
+// Normalized 10^k for k = -348, -340, ..., 340
+static const struct {
+  uint64_t f;
+  short e;
+} JSON_CACHED_POWERS[] = {
+  {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+  {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+  {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+  {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+  {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+  {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+  {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+  {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+  {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+  {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+  {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+  {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+  {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+  {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+  {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+  {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+  {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+  {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+  {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+  {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+  {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+  {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+  {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+  {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+  {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+  {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+  {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+  {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+  {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066}
+};
+
+static const uint32_t JSON_POW10[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static JsonDiyFp json_diyfp(uint64_t _f, int _e) {
+  JsonDiyFp x;
+  x.f = _f;
+  x.e = _e;
+  return x;
+}
+
+// Upper 64 bits of the product, rounded
+static JsonDiyFp json_diyfp_mul(JsonDiyFp _x, JsonDiyFp _y) {
+  const uint64_t M32 = 0xFFFFFFFFu;
+  uint64_t a = _x.f >> 32, b = _x.f & M32;
+  uint64_t c = _y.f >> 32, d = _y.f & M32;
+  uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1u << 31);
+  return json_diyfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), _x.e + _y.e + 64);
+}
+
+static JsonDiyFp json_diyfp_normalize(JsonDiyFp _x) {
+  while ((_x.f & ((uint64_t)1 << 63)) == 0) {
+    _x.f <<= 1;
+    _x.e--;
+  }
+  return _x;
+}
+
+// Neighbours half way to the next and previous double
+static void json_diyfp_boundaries(JsonDiyFp _v, JsonDiyFp* _minus, JsonDiyFp* _plus) {
+  const uint64_t hidden = (uint64_t)1 << 52;
+  JsonDiyFp plus = json_diyfp((_v.f << 1) + 1, _v.e - 1);
+  while ((plus.f & (hidden << 1)) == 0) {
+    plus.f <<= 1;
+    plus.e--;
+  }
+  plus.f <<= 64 - 52 - 2;
+  plus.e -= 64 - 52 - 2;
+
+  // The gap below a power of two is half the gap above it, except at the
+  // smallest normal where the subnormals below keep the same gap
+  JsonDiyFp minus = _v.f == hidden && _v.e > -1074 ? json_diyfp((_v.f << 2) - 1, _v.e - 2) : json_diyfp((_v.f << 1) - 1, _v.e - 1);
+  minus.f <<= minus.e - plus.e;
+  minus.e = plus.e;
+
+  *_minus = minus;
+  *_plus = plus;
+}
+
+// 10^-K with the binary exponent of _e * 10^-K in [-60, -32]
+static JsonDiyFp json_cached_power(int _e, int* _K) {
+  double dk = (-61 - _e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  if (dk - k > 0.0) {
+    k++;
+  }
+
+  unsigned index = (unsigned)((k >> 3) + 1);
+  *_K = -(-348 + (int)(index << 3));
+  return json_diyfp(JSON_CACHED_POWERS[index].f, JSON_CACHED_POWERS[index].e);
+}
+
+static int json_count_digits(uint32_t _n) {
+  int count = 1;
+  while (count < 10 && _n >= JSON_POW10[count]) {
+    count++;
+  }
+  return count;
+}
+
+// Walk the last digit down while that brings it closer to the exact value.
+// 0 when the imprecision of w leaves the digits or their rounding in doubt.
+static char json_grisu_weed(char* _buffer, int _len, uint64_t _distance, uint64_t _unsafe, uint64_t _rest, uint64_t _tenKappa, uint64_t _unit) {
+  uint64_t small = _distance - _unit;
+  uint64_t big = _distance + _unit;
+  while (_rest < small && _unsafe - _rest >= _tenKappa
+	 && (_rest + _tenKappa < small || small - _rest >= _rest + _tenKappa - small)) {
+    _buffer[_len - 1]--;
+    _rest += _tenKappa;
+  }
+
+  // Rounding against the other end of w's error would pick another digit
+  if (_rest < big && _unsafe - _rest >= _tenKappa
+      && (_rest + _tenKappa < big || big - _rest > _rest + _tenKappa - big)) {
+    return 0;
+  }
+  return 2 * _unit <= _rest && _rest <= _unsafe - 4 * _unit;
+}
+
+// Digits of the widest interval w may be in, kept only when weeding proves
+// they lie in the narrowest one
+static char json_grisu_digits(JsonDiyFp _low, JsonDiyFp _w, JsonDiyFp _high, char* _buffer, int* _len, int* _K) {
+  uint64_t unit = 1;
+  JsonDiyFp tooHigh = json_diyfp(_high.f + unit, _high.e);
+  uint64_t unsafe = tooHigh.f - (_low.f - unit);
+  JsonDiyFp one = json_diyfp((uint64_t)1 << -_w.e, _w.e);
+  uint32_t p1 = (uint32_t)(tooHigh.f >> -one.e);
+  uint64_t p2 = tooHigh.f & (one.f - 1);
+  int kappa = json_count_digits(p1);
+  *_len = 0;
+
+  while (kappa > 0) {
+    uint32_t d = p1 / JSON_POW10[kappa - 1];
+    p1 %= JSON_POW10[kappa - 1];
+    if (d || *_len) {
+      _buffer[(*_len)++] = (char)('0' + d);
+    }
+    kappa--;
+
+    uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+    if (rest < unsafe) {
+      *_K += kappa;
+      return json_grisu_weed(_buffer, *_len, tooHigh.f - _w.f, unsafe, rest, (uint64_t)JSON_POW10[kappa] << -one.e, unit);
+    }
+  }
+
+  for (;;) {
+    p2 *= 10;
+    unit *= 10;
+    unsafe *= 10;
+    char d = (char)(p2 >> -one.e);
+    if (d || *_len) {
+      _buffer[(*_len)++] = (char)('0' + d);
+    }
+    p2 &= one.f - 1;
+    kappa--;
+
+    if (p2 < unsafe) {
+      *_K += kappa;
+      return json_grisu_weed(_buffer, *_len, (tooHigh.f - _w.f) * unit, unsafe, p2, one.f, unit);
+    }
+  }
+}
+
+// Digits of a finite positive double, the value is digits * 10^K.
+// 0 when Grisu3 cannot vouch for them.
+static char json_grisu3(double _value, char* _buffer, int* _len, int* _K) {
+  uint64_t bits;
+  memcpy(&bits, &_value, sizeof(bits));
+  int biased = (int)((bits >> 52) & 0x7FF);
+  uint64_t significand = bits & (((uint64_t)1 << 52) - 1);
+  JsonDiyFp v = biased ? json_diyfp(significand | ((uint64_t)1 << 52), biased - 1075) : json_diyfp(significand, -1074);
+
+  JsonDiyFp minus, plus;
+  json_diyfp_boundaries(v, &minus, &plus);
+
+  JsonDiyFp c = json_cached_power(plus.e, _K);
+  JsonDiyFp w = json_diyfp_mul(json_diyfp_normalize(v), c);
+  JsonDiyFp wPlus = json_diyfp_mul(plus, c);
+  JsonDiyFp wMinus = json_diyfp_mul(minus, c);
+  return json_grisu_digits(wMinus, w, wPlus, _buffer, _len, _K);
+}
+
+// Place the decimal point the way JavaScript does: plain notation from
+// 1e-6 up to 1e21, exponent notation outside of that
+static int json_dtoa_format(char* _buffer, int _len, int _K) {
+  int kk = _len + _K; // 10^(kk-1) <= v < 10^kk
+
+  if (_K >= 0 && kk <= 21) {
+    // 1234e7 -> 12340000000
+    for (int i = _len; i < kk; i++) {
+      _buffer[i] = '0';
+    }
+    return kk;
+  }
+
+  if (kk > 0 && kk <= 21) {
+    // 1234e-2 -> 12.34
+    memmove(_buffer + kk + 1, _buffer + kk, _len - kk);
+    _buffer[kk] = '.';
+    return _len + 1;
+  }
+
+  if (kk > -6 && kk <= 0) {
+    // 1234e-6 -> 0.001234
+    int offset = 2 - kk;
+    memmove(_buffer + offset, _buffer, _len);
+    _buffer[0] = '0';
+    _buffer[1] = '.';
+    for (int i = 2; i < offset; i++) {
+      _buffer[i] = '0';
+    }
+    return _len + offset;
+  }
+
+  // 1234e30 -> 1.234e33
+  int pos = 1;
+  if (_len > 1) {
+    memmove(_buffer + 2, _buffer + 1, _len - 1);
+    _buffer[1] = '.';
+    pos = _len + 1;
+  }
+  _buffer[pos++] = 'e';
+
+  int exp = kk - 1;
+  if (exp < 0) {
+    _buffer[pos++] = '-';
+    exp = -exp;
+  }
+  if (exp >= 100) {
+    _buffer[pos++] = (char)('0' + exp / 100);
+    exp %= 100;
+    _buffer[pos++] = (char)('0' + exp / 10);
+  }
+  else if (exp >= 10) {
+    _buffer[pos++] = (char)('0' + exp / 10);
+  }
+  _buffer[pos++] = (char)('0' + exp % 10);
+  return pos;
+}
+
+// Digits of an unsigned integer, returns the length
+static int json_utoa(uint64_t _n, char* _buffer) {
+  char tmp[20];
+  int len = 0;
+  do {
+    tmp[len++] = (char)('0' + _n % 10);
+    _n /= 10;
+  } while (_n);
+
+  for (int i = 0; i < len; i++) {
+    _buffer[i] = tmp[len - 1 - i];
+  }
+  return len;
+}
+
+// Digits of _m * 2^_e2, exact unless the limit drops some
+static void json_decimal_fromBinary(JsonDecimal* _dec, uint64_t _m, int _e2, int _limit) {
+  unsigned char tmp[20];
+  int len = 0;
+  do {
+    tmp[len++] = (unsigned char)(_m % 10);
+    _m /= 10;
+  } while (_m);
+
+  for (int i = 0; i < len; i++) {
+    _dec->digits[i] = tmp[len - 1 - i];
+  }
+  _dec->count = len;
+  _dec->point = len;
+  _dec->limit = _limit;
+  _dec->truncated = 0;
+  json_decimal_trim(_dec);
+  json_decimal_shift(_dec, _e2);
+}
+
+// The first _k digits of _src as an integer, one more when _up
+static uint64_t json_decimal_cut(const JsonDecimal* _src, int _k, char _up) {
+  uint64_t n = 0;
+  for (int i = 0; i < _k; i++) {
+    n = n * 10 + (i < _src->count ? _src->digits[i] : 0);
+  }
+  return n + (uint64_t)_up;
+}
+
+// _m * 10^_exp10 reads back as _value
+static char json_dtoa_readsBack(uint64_t _m, int _exp10, double _value) {
+  double d;
+  if (json_eisel_lemire(_m, _exp10, 0, &d) == 0) {
+    char text[32];
+    int len = snprintf(text, sizeof(text), "%llue%d", (unsigned long long)_m, _exp10);
+    d = json_decimal_value(text, (size_t)len, 0);
+  }
+  return memcmp(&d, &_value, sizeof(d)) == 0;
+}
+
+// Grisu3's undecided cases: cut the exact decimal value to fewer and fewer
+// digits while rounding it down or up still reads back, keep the closest
+static int json_dtoa_exact(double _value, char* _buffer, int* _K) {
+  uint64_t bits;
+  memcpy(&bits, &_value, sizeof(bits));
+  int biased = (int)((bits >> 52) & 0x7FF);
+  uint64_t f = bits & (((uint64_t)1 << 52) - 1);
+  uint64_t m = biased ? f | ((uint64_t)1 << 52) : f;
+  int e = biased ? biased - 1075 : -1074;
+
+  // Each shift by up to 60 bits drops digits past the 40th, a relative error
+  // below a unit in the 37th place over the whole range. The first 17 digits
+  // and how the tail compares to a half stay exact unless digits 18 to 35
+  // are all 0 or all 9, only then pay for the full expansion.
+  JsonDecimal v;
+  json_decimal_fromBinary(&v, m, e, 40);
+  if (v.truncated) {
+    char zeros = 1, nines = 1;
+    for (int i = 17; i < 35; i++) {
+      unsigned char d = i < v.count ? v.digits[i] : 0;
+      zeros = zeros && d == 0;
+      nines = nines && d == 9;
+    }
+    if (zeros || nines) {
+      json_decimal_fromBinary(&v, m, e, JSON_DECIMAL_DIGITS);
+    }
+  }
+
+  // 17 digits always read back, a shorter cut only if a longer one does
+  uint64_t best = 0;
+  int bestLen = 0;
+  for (int k = 17; k > 0; k--) {
+    if (k >= v.count) {
+      if (v.count <= 17) {
+	best = json_decimal_cut(&v, v.count, 0);
+	bestLen = v.count;
+      }
+      continue;
+    }
+
+    uint64_t down = json_decimal_cut(&v, k, 0);
+    char downOk = json_dtoa_readsBack(down, v.point - k, _value);
+    char upOk = json_dtoa_readsBack(down + 1, v.point - k, _value);
+    if (downOk && upOk) {
+      // Both fit, round the exact value to nearest with ties to even
+      unsigned char next = v.digits[k];
+      upOk = next > 5 || (next == 5 && (v.count > k + 1 || (down & 1)));
+      downOk = !upOk;
+    }
+    if (!downOk && !upOk) {
+      break;
+    }
+    best = upOk ? down + 1 : down;
+    bestLen = k;
+  }
+
+  // 99 rounded up to 100 still has a shorter form
+  int K = v.point - bestLen;
+  while (best % 10 == 0) {
+    best /= 10;
+    K++;
+  }
+  *_K = K;
+  return json_utoa(best, _buffer);
+}
+
+// Shortest text that reads back as _value, at most JSON_DTOA_MAX bytes.
+// JSON has no NaN or infinity, those are written as null.
+#define JSON_DTOA_MAX 32
+static int json_dtoa(double _value, char* _buffer) {
+  uint64_t bits;
+  memcpy(&bits, &_value, sizeof(bits));
+  char* out = _buffer;
+
+  if (((bits >> 52) & 0x7FF) == 0x7FF) {
+    memcpy(_buffer, "null", 4);
+    return 4;
+  }
+
+  if (bits >> 63) {
+    *out++ = '-';
+    _value = -_value;
+  }
+
+  // Whole numbers up to 2^53 skip the digit search
+  if (_value < 9007199254740992.0 && _value == (double)(uint64_t)_value) {
+    return (int)(out - _buffer) + json_utoa((uint64_t)_value, out);
+  }
+
+  int K = 0, len;
+  if (json_grisu3(_value, out, &len, &K) == 0) {
+    len = json_dtoa_exact(_value, out, &K);
+  }
+  return (int)(out - _buffer) + json_dtoa_format(out, len, K);
+}
+
+/*************
+ ** ENCODER **
+ *************/
+
+// Every value is appended to the output exactly once. A growing writer
+// doubles its buffer when full, a fixed one writes while the bytes fit and
+// keeps counting after that so the caller learns the size it needed. A
+// writer with a flush function hands its buffer to the sink whenever it
+// fills, so memory stays bounded whatever the size of the output.
+typedef struct JsonWriter {
+  char* value;
+  size_t length; // Bytes encoded so far, written or not
+  size_t capacity;
+  size_t flushed; // Bytes already given to the sink, value holds the rest
+  unsigned char fixed; // Caller owned buffer, never reallocated
+  unsigned char failed; // An allocation failed, the buffer was too small or the sink refused
+  // Writes the buffered bytes then _extra, NULL for a growing or fixed writer
+  char (*flush)(struct JsonWriter* _w, const char* _extra, size_t _extraLen);
+  JsonSink sink;
+  void* target; // FILE* or sink data
+  int fd;
+} JsonWriter;
+
+static void json_encode_value(JsonWriter* _w, const JsonValue* _val);
+
+static void json_writer_init(JsonWriter* _w, char* _buffer, size_t _capacity, unsigned char _fixed) {
+  _w->value = _buffer;
+  _w->length = 0;
+  _w->capacity = _capacity;
+  _w->flushed = 0;
+  _w->fixed = _fixed;
+  _w->failed = 0;
+  _w->flush = NULL;
+  _w->sink = NULL;
+  _w->target = NULL;
+  _w->fd = -1;
+}
+
+// Where the next byte goes
+static char* json_writer_end(JsonWriter* _w) {
+  return _w->value + (_w->length - _w->flushed);
+}
+
+static char json_writer_reserve(JsonWriter* _w, size_t _len) {
+  if (_w->failed == 0 && _w->length - _w->flushed + _len <= _w->capacity) {
+    return 1;
+  }
+
+  if (_w->failed || _w->fixed) {
+    _w->failed = 1;
+    return 0;
+  }
+
+  if (_w->flush != NULL) {
+    if (_w->flush(_w, NULL, 0) == 0 || _len > _w->capacity) {
+      _w->failed = 1;
+      return 0;
+    }
+    _w->flushed = _w->length;
+    return 1;
+  }
+
+  size_t capacity = _w->capacity ? _w->capacity * 2 : 256;
+  while (capacity < _w->length + _len) {
+    capacity *= 2;
+  }
+
+  char* value = realloc(_w->value, capacity);
+  if (value == NULL) {
+    _w->failed = 1;
+    return 0;
+  }
+  _w->value = value;
+  _w->capacity = capacity;
+  return 1;
+}
+
+static void json_writer_append(JsonWriter* _w, const char* _str, size_t _len) {
+  // Large strings skip the copy, the sink gets the buffer and them together
+  if (_w->flush != NULL && _len > _w->capacity / 2) {
+    if (_w->failed == 0 && _w->flush(_w, _str, _len) == 0) {
+      _w->failed = 1;
+    }
+    _w->length += _len;
+    _w->flushed = _w->length;
+    return;
+  }
+
+  if (json_writer_reserve(_w, _len)) {
+    memcpy(json_writer_end(_w), _str, _len);
+  }
+  _w->length += _len;
+}
+
+static void json_writer_char(JsonWriter* _w, char _c) {
+  if (json_writer_reserve(_w, 1)) {
+    *json_writer_end(_w) = _c;
+  }
+  _w->length++;
+}
+
+static void json_encode_string(JsonWriter* _w, const JsonString* _str) {
+  if (_w->flush != NULL && _str->length + 2 > _w->capacity / 2) {
+    json_writer_char(_w, '"');
+    json_writer_append(_w, _str->value, _str->length);
+    json_writer_char(_w, '"');
+    return;
+  }
+
+  if (json_writer_reserve(_w, _str->length + 2)) {
+    char* end = json_writer_end(_w);
+    end[0] = '"';
+    memcpy(end + 1, _str->value, _str->length);
+    end[_str->length + 1] = '"';
+  }
+  _w->length += _str->length + 2;
+}
+
+static void json_encode_number(JsonWriter* _w, double _num) {
+  char value[JSON_DTOA_MAX];
+  json_writer_append(_w, value, json_dtoa(_num, value));
+}
+
+static void json_encode_uint64(JsonWriter* _w, uint64_t _num) {
+  char value[20];
+  json_writer_append(_w, value, json_utoa(_num, value));
+}
+
+static void json_encode_int64(JsonWriter* _w, int64_t _num) {
+  if (_num < 0) {
+    json_writer_char(_w, '-');
+    json_encode_uint64(_w, 0 - (uint64_t)_num);
+    return;
+  }
+  json_encode_uint64(_w, (uint64_t)_num);
+}
+
+static void json_encode_bool(JsonWriter* _w, unsigned char _bol) {
+  json_writer_append(_w, _bol ? TRUE_STR : FALSE_STR, _bol ? 4 : 5);
+}
+
+static void json_encode_null(JsonWriter* _w) {
+  json_writer_append(_w, NULL_STR, 4);
+}
+
+static void json_encode_object(JsonWriter* _w, const JsonObject* _obj) {
+  json_writer_char(_w, JSON_OBJECT);
+
+  for (size_t i = 0; i < _obj->length; i++) {
+    if (i > 0) {
+      json_writer_char(_w, ',');
+    }
+    json_encode_string(_w, &_obj->attributes[i].name);
+    json_writer_char(_w, ':');
+    json_encode_value(_w, &_obj->attributes[i].value);
+  }
+
+  json_writer_char(_w, JSON_OBJECT_END);
+}
+
+static void json_encode_array(JsonWriter* _w, const JsonArray* _arr) {
+  json_writer_char(_w, JSON_ARRAY);
+
+  for (size_t i = 0; i < _arr->length; i++) {
+    if (i > 0) {
+      json_writer_char(_w, ',');
+    }
+    json_encode_value(_w, &_arr->items[i]);
+  }
+
+  json_writer_char(_w, JSON_ARRAY_END);
+}
+
+static void json_encode_value(JsonWriter* _w, const JsonValue* _val) {
+  switch (_val->type) {
+  case JSON_BOOL:
+    json_encode_bool(_w, _val->boolean);
+    break;
+  case JSON_NUMBER:
+    if (_val->flags == JSON_INT64) {
+      json_encode_int64(_w, _val->integer);
+    }
+    else if (_val->flags == JSON_UINT64) {
+      json_encode_uint64(_w, _val->uinteger);
+    }
+    else {
+      json_encode_number(_w, _val->number);
+    }
+    break;
+  case JSON_NULL:
+    json_encode_null(_w);
+    break;
+  case JSON_STRING:
+    json_encode_string(_w, (JsonString*)_val->data);
+    break;
+  case JSON_OBJECT:
+    json_encode_object(_w, (JsonObject*)_val->data);
+    break;
+  case JSON_ARRAY:
+    json_encode_array(_w, (JsonArray*)_val->data);
+    break;
+  }
+}
+
+char* json_encode(JsonValue* _value) {
+  if (_value == NULL) {
+    return NULL;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 0);
+
+  json_encode_value(&w, _value);
+  json_writer_char(&w, '\0');
+
+  if (w.failed) {
+    free(w.value);
+    return NULL;
+  }
+
+  return w.value;
+}
+
+size_t json_encoded_length(const JsonValue* _value) {
+  if (_value == NULL) {
+    return 0;
+  }
+
+  // Nothing fits in no space, only the count is kept
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 1);
+  json_encode_value(&w, _value);
+  return w.length;
+}
+
+size_t json_encode_into(const JsonValue* _value, char* _buffer, size_t _capacity) {
+  if (_value == NULL) {
+    return 0;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, _buffer, _capacity, 1);
+  json_encode_value(&w, _value);
+
+  size_t len = w.length;
+  json_writer_char(&w, '\0');
+  return len;
+}
+
+#if JSON_ENCODE_BUFFER < 256
+#error "JSON_ENCODE_BUFFER must hold at least 256 bytes"
+#endif
+
+static char json_flush_sink(JsonWriter* _w, const char* _extra, size_t _extraLen) {
+  size_t buffered = _w->length - _w->flushed;
+  if (buffered > 0 && _w->sink(_w->target, _w->value, buffered) == 0) {
+    return 0;
+  }
+  return _extraLen == 0 || _w->sink(_w->target, _extra, _extraLen);
+}
+
+static char json_flush_file(JsonWriter* _w, const char* _extra, size_t _extraLen) {
+  FILE* file = (FILE*)_w->target;
+  size_t buffered = _w->length - _w->flushed;
+  if (buffered > 0 && fwrite(_w->value, 1, buffered, file) != buffered) {
+    return 0;
+  }
+  return _extraLen == 0 || fwrite(_extra, 1, _extraLen, file) == _extraLen;
+}
+
+#if !defined(_WIN32)
+static char json_write_fd(int _fd, const char* _bytes, size_t _len) {
+  while (_len > 0) {
+    ssize_t written = write(_fd, _bytes, _len);
+    if (written < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return 0;
+    }
+    _bytes += written;
+    _len -= (size_t)written;
+  }
+  return 1;
+}
+
+// One writev for the buffer and a large string, looping over short writes
+static char json_flush_fd(JsonWriter* _w, const char* _extra, size_t _extraLen) {
+  struct iovec parts[2];
+  int count = 0;
+  size_t buffered = _w->length - _w->flushed;
+  if (buffered > 0) {
+    parts[count].iov_base = _w->value;
+    parts[count++].iov_len = buffered;
+  }
+  if (_extraLen > 0) {
+    parts[count].iov_base = (void*)_extra;
+    parts[count++].iov_len = _extraLen;
+  }
+
+  struct iovec* part = parts;
+  while (count > 0) {
+    ssize_t written = writev(_w->fd, part, count);
+    if (written < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return 0;
+    }
+
+    size_t left = (size_t)written;
+    while (count > 0 && left >= part->iov_len) {
+      left -= part->iov_len;
+      part++;
+      count--;
+    }
+    if (count > 0) {
+      part->iov_base = (char*)part->iov_base + left;
+      part->iov_len -= left;
+    }
+  }
+  return 1;
+}
+#else
+static char json_write_fd(int _fd, const char* _bytes, size_t _len) {
+  while (_len > 0) {
+    unsigned int chunk = _len > 0x40000000 ? 0x40000000 : (unsigned int)_len;
+    int written = _write(_fd, _bytes, chunk);
+    if (written <= 0) {
+      return 0;
+    }
+    _bytes += written;
+    _len -= written;
+  }
+  return 1;
+}
+
+static char json_flush_fd(JsonWriter* _w, const char* _extra, size_t _extraLen) {
+  return json_write_fd(_w->fd, _w->value, _w->length - _w->flushed) && json_write_fd(_w->fd, _extra, _extraLen);
+}
+#endif
+
+static char json_encode_flushing(const JsonValue* _value, JsonWriter* _w) {
+  if (_value == NULL) {
+    return 0;
+  }
+
+  char* buffer = malloc(JSON_ENCODE_BUFFER);
+  if (buffer == NULL) {
+    return 0;
+  }
+  _w->value = buffer;
+  _w->capacity = JSON_ENCODE_BUFFER;
+
+  json_encode_value(_w, _value);
+  if (_w->failed == 0 && _w->length > _w->flushed && _w->flush(_w, NULL, 0) == 0) {
+    _w->failed = 1;
+  }
+
+  free(buffer);
+  return _w->failed == 0;
+}
+
+char json_encode_sink(const JsonValue* _value, JsonSink _sink, void* _data) {
+  if (_sink == NULL) {
+    return 0;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 0);
+  w.flush = json_flush_sink;
+  w.sink = _sink;
+  w.target = _data;
+  return json_encode_flushing(_value, &w);
+}
+
+char json_encode_file(const JsonValue* _value, FILE* _file) {
+  if (_file == NULL) {
+    return 0;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 0);
+  w.flush = json_flush_file;
+  w.target = _file;
+  return json_encode_flushing(_value, &w);
+}
+
+char json_encode_fd(const JsonValue* _value, int _fd) {
+  if (_fd < 0) {
+    return 0;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 0);
+  w.flush = json_flush_fd;
+  w.fd = _fd;
+  return json_encode_flushing(_value, &w);
+}
+
+/**************
+ ** SNAPSHOT **
+ **************/
+
+#define JSON_SNAPSHOT_MAGIC "SLIMJSN1"
+#define JSON_SNAPSHOT_VERSION 1
+#define JSON_SNAPSHOT_ORDER 0x01020304u
+
+// Image header, the nodes follow with the same layout as in memory. Their
+// pointers hold base + offset, so an image mapped at base is ready to use.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t order; // Reads differently on the other byte order
+  uint32_t pointerSize;
+  uint32_t valueSize;
+  uint64_t base; // Address the pointers were laid out for
+  uint64_t size; // Whole image, header included
+  uint64_t root; // Offset of the root JsonValue
+  uint64_t seed; // Hash key of the prebuilt tables, drawn for this image
+  uint64_t indexMin; // JSON_OBJECT_INDEX_MIN of the writer
+} JsonSnapshotHeader;
+
+typedef struct {
+  char* data;
+  size_t length;
+  size_t capacity;
+  uint64_t base;
+  uint64_t seed; // Never the process key, the file must not reveal it
+  char failed;
+} JsonSnapshotImage;
+
+// Preferred address of a new image, a random 1 TiB step in a range the
+// kernel doesn't hand out on its own. 0 on 32 bit, every open relocates.
+static uint64_t json_snapshot_base() {
+#if UINTPTR_MAX > 0xFFFFFFFFu
+  return 0x100000000000ULL + (json_hash_random() % 64) * 0x10000000000ULL;
+#else
+  return 0;
+#endif
+}
+
+// Zeroed room for _size bytes, returns its offset. The buffer moves as it
+// grows so nodes refer to each other by offset until the image is written.
+static size_t json_image_alloc(JsonSnapshotImage* _img, size_t _size) {
+  size_t at = (_img->length + 15) & ~(size_t)15;
+  if (_img->failed || _size > SIZE_MAX / 2 - at) {
+    _img->failed = 1;
+    return 0;
+  }
+
+  if (at + _size > _img->capacity) {
+    size_t capacity = _img->capacity ? _img->capacity : 4096;
+    while (capacity < at + _size) {
+      capacity *= 2;
+    }
+    char* data = realloc(_img->data, capacity);
+    if (data == NULL) {
+      _img->failed = 1;
+      return 0;
+    }
+    _img->data = data;
+    _img->capacity = capacity;
+  }
+
+  memset(_img->data + _img->length, 0, at + _size - _img->length);
+  _img->length = at + _size;
+  return at;
+}
+
+static void json_image_put(JsonSnapshotImage* _img, size_t _at, const void* _src, size_t _size) {
+  if (_img->failed == 0) {
+    memcpy(_img->data + _at, _src, _size);
+  }
+}
+
+// Address of offset _at once the image is mapped at its base
+static void* json_image_pointer(const JsonSnapshotImage* _img, size_t _at) {
+  return (void*)(uintptr_t)(_img->base + _at);
+}
+
+static char* json_image_chars(JsonSnapshotImage* _img, const char* _str, size_t _len) {
+  size_t at = json_image_alloc(_img, _len + 1);
+  json_image_put(_img, at, _str, _len);
+  return json_image_pointer(_img, at);
+}
+
+static void json_image_value(JsonSnapshotImage* _img, size_t _at, const JsonValue* _v);
+
+static size_t json_image_string(JsonSnapshotImage* _img, const JsonString* _str) {
+  size_t at = json_image_alloc(_img, sizeof(JsonString));
+  JsonString copy;
+  copy.value = json_image_chars(_img, _str->value, _str->length);
+  copy.length = _str->length;
+  json_image_put(_img, at, &copy, sizeof(copy));
+  return at;
+}
+
+static size_t json_image_array(JsonSnapshotImage* _img, const JsonArray* _arr) {
+  size_t at = json_image_alloc(_img, sizeof(JsonArray));
+  JsonArray copy;
+  copy.items = NULL;
+  copy.length = _arr->length;
+
+  if (_arr->length > 0) {
+    size_t items = json_image_alloc(_img, sizeof(JsonValue) * _arr->length);
+    for (size_t i = 0; i < _arr->length; i++) {
+      json_image_value(_img, items + sizeof(JsonValue) * i, &_arr->items[i]);
+    }
+    copy.items = json_image_pointer(_img, items);
+  }
+
+  json_image_put(_img, at, &copy, sizeof(copy));
+  return at;
+}
+
+// Hashed with the image key, the slots point at the attributes copied to
+// _attributes
+static size_t json_image_index(JsonSnapshotImage* _img, const JsonObject* _obj, size_t _attributes) {
+  size_t capacity = json_objectIndex_capacity(_obj->length);
+  size_t size = sizeof(JsonObjectIndex) + sizeof(JsonObjectSlot) * capacity;
+  JsonObjectIndex* index = malloc(size);
+  if (index == NULL) {
+    _img->failed = 1;
+    return 0;
+  }
+
+  index->next = NULL;
+  index->mask = capacity - 1;
+  json_fill_objectIndex(index, _obj, _img->seed);
+  for (size_t i = 0; i < capacity; i++) {
+    if (index->slots[i].attribute != NULL) {
+      size_t n = index->slots[i].attribute - _obj->attributes;
+      index->slots[i].attribute = json_image_pointer(_img, _attributes + sizeof(JsonObjectAttribute) * n);
+    }
+  }
+
+  size_t at = json_image_alloc(_img, size);
+  json_image_put(_img, at, index, size);
+  free(index);
+  return at;
+}
+
+static size_t json_image_object(JsonSnapshotImage* _img, const JsonObject* _obj) {
+  size_t at = json_image_alloc(_img, sizeof(JsonObject));
+  JsonObject copy;
+  copy.attributes = NULL;
+  copy.index = NULL;
+  copy.length = _obj->length;
+  copy.arena = NULL;
+
+  if (_obj->length > 0) {
+    size_t attributes = json_image_alloc(_img, sizeof(JsonObjectAttribute) * _obj->length);
+    for (size_t n = 0; n < _obj->length; n++) {
+      const JsonObjectAttribute* attr = &_obj->attributes[n];
+      size_t to = attributes + sizeof(JsonObjectAttribute) * n;
+
+      JsonString name;
+      name.value = json_image_chars(_img, attr->name.value, attr->name.length);
+      name.length = attr->name.length;
+      json_image_put(_img, to + offsetof(JsonObjectAttribute, name), &name, sizeof(name));
+      json_image_value(_img, to + offsetof(JsonObjectAttribute, value), &attr->value);
+    }
+    copy.attributes = json_image_pointer(_img, attributes);
+
+    if (_obj->length >= JSON_OBJECT_INDEX_MIN) {
+      copy.index = json_image_pointer(_img, json_image_index(_img, _obj, attributes));
+    }
+  }
+
+  json_image_put(_img, at, &copy, sizeof(copy));
+  return at;
+}
+
+static void json_image_value(JsonSnapshotImage* _img, size_t _at, const JsonValue* _v) {
+  JsonValue copy = *_v;
+  switch (_v->type) {
+  case JSON_STRING:
+    copy.data = json_image_pointer(_img, json_image_string(_img, (const JsonString*)_v->data));
+    break;
   case JSON_ARRAY:
-    arr = (JsonArray*)_v->data;
-    ssize_t index = json_string_to_size(name, end);
-    if (index < 0) {
+    copy.data = json_image_pointer(_img, json_image_array(_img, (const JsonArray*)_v->data));
+    break;
+  case JSON_OBJECT:
+    copy.data = json_image_pointer(_img, json_image_object(_img, (const JsonObject*)_v->data));
+    break;
+  case JSON_NUMBER:
+  case JSON_BOOL:
+  case JSON_NULL:
+    break;
+  default:
+    _img->failed = 1;
+  }
+  json_image_put(_img, _at, &copy, sizeof(copy));
+}
+
+char json_snapshot_write(const JsonValue* _value, int _fd) {
+  if (_value == NULL || _value->type == JSON_ERROR || _fd < 0) {
+    return 0;
+  }
+
+  JsonSnapshotImage img;
+  img.data = NULL;
+  img.length = 0;
+  img.capacity = 0;
+  img.base = json_snapshot_base();
+  img.seed = json_hash_random() | 1;
+  img.failed = 0;
+
+  JsonSnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  json_image_alloc(&img, sizeof(header));
+  size_t root = json_image_alloc(&img, sizeof(JsonValue));
+  json_image_value(&img, root, _value);
+
+  memcpy(header.magic, JSON_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = JSON_SNAPSHOT_VERSION;
+  header.order = JSON_SNAPSHOT_ORDER;
+  header.pointerSize = sizeof(void*);
+  header.valueSize = sizeof(JsonValue);
+  header.base = img.base;
+  header.size = img.length;
+  header.root = root;
+  header.seed = img.seed;
+  header.indexMin = JSON_OBJECT_INDEX_MIN;
+  json_image_put(&img, 0, &header, sizeof(header));
+
+  char ok = img.failed == 0 && json_write_fd(_fd, img.data, img.length);
+  free(img.data);
+  return ok;
+}
+
+static char json_snapshot_check(const JsonSnapshotHeader* _h, uint64_t _size) {
+  return memcmp(_h->magic, JSON_SNAPSHOT_MAGIC, sizeof(_h->magic)) == 0
+    && _h->version == JSON_SNAPSHOT_VERSION
+    && _h->order == JSON_SNAPSHOT_ORDER
+    && _h->pointerSize == sizeof(void*)
+    && _h->valueSize == sizeof(JsonValue)
+    && _h->size == _size
+    && _size <= SIZE_MAX
+    && _h->seed != 0
+    && _h->root >= sizeof(JsonSnapshotHeader)
+    && _h->root <= _size - sizeof(JsonValue)
+    && _h->root % 16 == 0;
+}
+
+// Moves an image loaded away from its base
+typedef struct {
+  uintptr_t start;
+  uintptr_t end;
+  uintptr_t delta;
+  JsonArena* arena;
+  uint64_t seed;
+} JsonSnapshotMap;
+
+// Rebase a stored pointer to _count nodes of _size bytes. It must land in
+// the image past the node holding it, so a crafted image can't loop.
+static void* json_snapshot_move(const JsonSnapshotMap* _map, void* _ptr, size_t _count, size_t _size, const void* _holder) {
+  uintptr_t p = (uintptr_t)_ptr + _map->delta;
+  if (_ptr == NULL || p <= (uintptr_t)_holder || p >= _map->end || (_map->end - p) / _size < _count) {
+    return NULL;
+  }
+  if (_size > 1 && p % sizeof(void*) != 0) {
+    return NULL;
+  }
+  return (void*)p;
+}
+
+static char* json_snapshot_chars(const JsonSnapshotMap* _map, char* _ptr, size_t _len, const void* _holder) {
+  char* chars = json_snapshot_move(_map, _ptr, _len, 1, _holder);
+  if (chars == NULL || _map->end - (uintptr_t)chars <= _len || chars[_len] != '\0') {
+    return NULL;
+  }
+  return chars;
+}
+
+static char json_snapshot_relocate(const JsonSnapshotMap* _map, JsonValue* _v);
+
+static char json_snapshot_relocateIndex(const JsonSnapshotMap* _map, JsonObject* _obj) {
+  JsonObjectIndex* index = json_snapshot_move(_map, _obj->index, 1, sizeof(JsonObjectIndex), _obj);
+  if (index == NULL) {
+    return 0;
+  }
+  _obj->index = index;
+  index->next = NULL;
+
+  size_t mask = index->mask;
+  size_t room = (_map->end - (uintptr_t)index->slots) / sizeof(JsonObjectSlot);
+  if ((mask & (mask + 1)) != 0 || room <= mask || mask + 1 - (mask + 1) / 4 < _obj->length || index->seed != _map->seed) {
+    return 0;
+  }
+
+  for (size_t i = 0; i <= mask; i++) {
+    JsonObjectAttribute* attr = index->slots[i].attribute;
+    if (attr != NULL) {
+      uintptr_t p = (uintptr_t)attr + _map->delta;
+      size_t offset = p - (uintptr_t)_obj->attributes;
+      if (p < (uintptr_t)_obj->attributes || offset / sizeof(JsonObjectAttribute) >= _obj->length || offset % sizeof(JsonObjectAttribute) != 0) {
+	return 0;
+      }
+      index->slots[i].attribute = (JsonObjectAttribute*)p;
+    }
+  }
+  return 1;
+}
+
+static char json_snapshot_relocateObject(const JsonSnapshotMap* _map, JsonObject* _obj) {
+  _obj->arena = _map->arena;
+  if (_obj->length == 0) {
+    _obj->attributes = NULL;
+    _obj->index = NULL;
+    return 1;
+  }
+
+  _obj->attributes = json_snapshot_move(_map, _obj->attributes, _obj->length, sizeof(JsonObjectAttribute), _obj);
+  if (_obj->attributes == NULL) {
+    return 0;
+  }
+
+  for (size_t n = 0; n < _obj->length; n++) {
+    JsonObjectAttribute* attr = &_obj->attributes[n];
+    attr->name.value = json_snapshot_chars(_map, attr->name.value, attr->name.length, attr);
+    if (attr->name.value == NULL || json_snapshot_relocate(_map, &attr->value) == 0) {
+      return 0;
+    }
+  }
+
+  return _obj->index == NULL || json_snapshot_relocateIndex(_map, _obj);
+}
+
+static char json_snapshot_relocate(const JsonSnapshotMap* _map, JsonValue* _v) {
+  switch (_v->type) {
+  case JSON_STRING: {
+    JsonString* str = json_snapshot_move(_map, _v->data, 1, sizeof(JsonString), _v);
+    if (str == NULL) {
+      return 0;
+    }
+    _v->data = str;
+    str->value = json_snapshot_chars(_map, str->value, str->length, str);
+    return str->value != NULL;
+  }
+  case JSON_ARRAY: {
+    JsonArray* arr = json_snapshot_move(_map, _v->data, 1, sizeof(JsonArray), _v);
+    if (arr == NULL) {
+      return 0;
+    }
+    _v->data = arr;
+    if (arr->length == 0) {
+      arr->items = NULL;
+      return 1;
+    }
+
+    arr->items = json_snapshot_move(_map, arr->items, arr->length, sizeof(JsonValue), arr);
+    if (arr->items == NULL) {
+      return 0;
+    }
+    for (size_t i = 0; i < arr->length; i++) {
+      if (json_snapshot_relocate(_map, &arr->items[i]) == 0) {
+	return 0;
+      }
+    }
+    return 1;
+  }
+  case JSON_OBJECT: {
+    JsonObject* obj = json_snapshot_move(_map, _v->data, 1, sizeof(JsonObject), _v);
+    if (obj == NULL) {
+      return 0;
+    }
+    _v->data = obj;
+    return json_snapshot_relocateObject(_map, obj);
+  }
+  case JSON_NUMBER:
+  case JSON_BOOL:
+  case JSON_NULL:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+// Wrap a loaded image in a document, the caller still owns the image when
+// it returns NULL. Images away from their base are writable copies.
+static JsonDocument* json_snapshot_document(char* _image, const JsonSnapshotHeader* _h, char _relocate) {
+  JsonDocument* doc = malloc(sizeof(JsonDocument));
+  if (doc == NULL) {
+    return NULL;
+  }
+  json_arena_init(&doc->arena, 0);
+  doc->root = (JsonValue*)(_image + _h->root);
+  doc->buffer = _image;
+  doc->bufferLength = (size_t)_h->size;
+
+  if (_relocate) {
+    JsonSnapshotMap map;
+    map.start = (uintptr_t)_image;
+    map.end = map.start + (size_t)_h->size;
+    map.delta = map.start - (uintptr_t)_h->base;
+    map.arena = &doc->arena;
+    map.seed = _h->seed;
+    if (json_snapshot_relocate(&map, doc->root) == 0) {
+      json_arena_free(&doc->arena);
+      free(doc);
+      return NULL;
+    }
+  }
+  return doc;
+}
+
+#if defined(_WIN32)
+// No mmap, the document owns a relocated heap copy
+JsonDocument* json_snapshot_open(const char* _path) {
+  FILE* f = fopen(_path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+
+  JsonSnapshotHeader header;
+  char* image = NULL;
+  long len = -1;
+  if (fseek(f, 0, SEEK_END) == 0) {
+    len = ftell(f);
+  }
+  if (len >= (long)sizeof(header) && fseek(f, 0, SEEK_SET) == 0 && fread(&header, 1, sizeof(header), f) == sizeof(header)
+      && json_snapshot_check(&header, (uint64_t)len) && fseek(f, 0, SEEK_SET) == 0) {
+    image = malloc(len);
+  }
+  if (image == NULL || fread(image, 1, len, f) != (size_t)len) {
+    free(image);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+
+  JsonDocument* doc = json_snapshot_document(image, &header, 1);
+  if (doc == NULL) {
+    free(image);
+  }
+  return doc;
+}
+#else
+JsonDocument* json_snapshot_open(const char* _path) {
+  int fd = open(_path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  JsonSnapshotHeader header;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(header) || pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)
+      || json_snapshot_check(&header, (uint64_t)st.st_size) == 0) {
+    close(fd);
+    return NULL;
+  }
+
+  // Shared read only at the base when every object this build would index
+  // already has a table. Otherwise a private copy anywhere, relocated.
+  size_t size = (size_t)header.size;
+  char* image = MAP_FAILED;
+  if (header.indexMin <= JSON_OBJECT_INDEX_MIN && header.base != 0) {
+    void* base = (void*)(uintptr_t)header.base;
+    image = mmap(base, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (image != MAP_FAILED && image != base) {
+      munmap(image, size);
+      image = MAP_FAILED;
+    }
+  }
+
+  char relocate = image == MAP_FAILED;
+  if (relocate) {
+    image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (image == MAP_FAILED) {
+    return NULL;
+  }
+
+  JsonDocument* doc = json_snapshot_document(image, &header, relocate);
+  if (doc == NULL) {
+    munmap(image, size);
+  }
+  return doc;
+}
+#endif
+
+/**************************
+ ** MESSAGEPACK AND CBOR **
+ *************************/
+
+// Both formats carry the same tree as JSON text. Strings are kept escaped
+// in the tree, so they are unescaped to UTF-8 on the way out and escaped
+// again on the way in. Binary strings, extensions and non string keys have
+// no JSON equivalent and fail the decode.
+
+typedef char (*JsonBinaryItem)(JsonStream* _enc, JsonValue* _v, JsonString* _key);
+
+#define JSON_CBOR_INDEFINITE ((uint64_t)-1)
+
+static size_t json_utf8_put(char* _out, uint32_t _cp) {
+  if (_cp < 0x80) {
+    _out[0] = (char)_cp;
+    return 1;
+  }
+  if (_cp < 0x800) {
+    _out[0] = (char)(0xc0 | (_cp >> 6));
+    _out[1] = (char)(0x80 | (_cp & 0x3f));
+    return 2;
+  }
+  if (_cp < 0x10000) {
+    _out[0] = (char)(0xe0 | (_cp >> 12));
+    _out[1] = (char)(0x80 | ((_cp >> 6) & 0x3f));
+    _out[2] = (char)(0x80 | (_cp & 0x3f));
+    return 3;
+  }
+  _out[0] = (char)(0xf0 | (_cp >> 18));
+  _out[1] = (char)(0x80 | ((_cp >> 12) & 0x3f));
+  _out[2] = (char)(0x80 | ((_cp >> 6) & 0x3f));
+  _out[3] = (char)(0x80 | (_cp & 0x3f));
+  return 4;
+}
+
+// Four hex digits, -1 when one isn't
+static int32_t json_hex4(const char* _str) {
+  int32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    char c = _str[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9') {
+      v |= c - '0';
+    }
+    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+      v |= (c | 0x20) - 'a' + 10;
+    }
+    else {
+      return -1;
+    }
+  }
+  return v;
+}
+
+// UTF-8 length of escaped string text, the bytes go to _out when it isn't
+// NULL. Lone surrogates become U+FFFD, unknown escapes are kept as they are.
+static size_t json_unescape(const char* _str, size_t _len, char* _out) {
+  char buf[4];
+  size_t n = 0;
+  for (size_t i = 0; i < _len; i++) {
+    char* to = _out ? _out + n : buf;
+    if (_str[i] != '\\' || i + 1 == _len) {
+      *to = _str[i];
+      n++;
+      continue;
+    }
+
+    char c = _str[++i];
+    switch (c) {
+    case 'b': *to = '\b'; n++; break;
+    case 'f': *to = '\f'; n++; break;
+    case 'n': *to = '\n'; n++; break;
+    case 'r': *to = '\r'; n++; break;
+    case 't': *to = '\t'; n++; break;
+    case '"': case '\\': case '/': *to = c; n++; break;
+    case 'u': {
+      int32_t cp = i + 4 < _len ? json_hex4(_str + i + 1) : -1;
+      if (cp < 0) {
+	to[0] = '\\';
+	to[1] = c;
+	n += 2;
+	break;
+      }
+      i += 4;
+
+      if (cp >= 0xd800 && cp <= 0xdbff && i + 6 < _len && _str[i + 1] == '\\' && _str[i + 2] == 'u') {
+	int32_t low = json_hex4(_str + i + 3);
+	if (low >= 0xdc00 && low <= 0xdfff) {
+	  cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+	  i += 6;
+	}
+      }
+      if (cp >= 0xd800 && cp <= 0xdfff) {
+	cp = 0xfffd;
+      }
+      n += json_utf8_put(to, (uint32_t)cp);
+      break;
+    }
+    default:
+      to[0] = '\\';
+      to[1] = c;
+      n += 2;
+    }
+  }
+  return n;
+}
+
+// Escaped length of raw text, the bytes go to _out when it isn't NULL
+static size_t json_escape(const char* _str, size_t _len, char* _out) {
+  static const char hex[] = "0123456789abcdef";
+  size_t n = 0;
+  for (size_t i = 0; i < _len; i++) {
+    unsigned char c = (unsigned char)_str[i];
+    char e = 0;
+    switch (c) {
+    case '"': case '\\': e = (char)c; break;
+    case '\b': e = 'b'; break;
+    case '\f': e = 'f'; break;
+    case '\n': e = 'n'; break;
+    case '\r': e = 'r'; break;
+    case '\t': e = 't'; break;
+    }
+
+    if (e == 0 && c >= 0x20) {
+      if (_out) {
+	_out[n] = (char)c;
+      }
+      n++;
+    }
+    else if (e != 0) {
+      if (_out) {
+	_out[n] = '\\';
+	_out[n + 1] = e;
+      }
+      n += 2;
+    }
+    else {
+      if (_out) {
+	memcpy(_out + n, "\\u00", 4);
+	_out[n + 4] = hex[c >> 4];
+	_out[n + 5] = hex[c & 0xf];
+      }
+      n += 6;
+    }
+  }
+  return n;
+}
+
+// Lead byte then _size bytes of _v, big endian
+static void json_writer_head(JsonWriter* _w, unsigned char _lead, uint64_t _v, int _size) {
+  char bytes[9];
+  bytes[0] = (char)_lead;
+  for (int i = 0; i < _size; i++) {
+    bytes[1 + i] = (char)(_v >> (8 * (_size - 1 - i)));
+  }
+  json_writer_append(_w, bytes, 1 + _size);
+}
+
+// Doubles that survive the round trip through float take 4 bytes
+static void json_writer_float(JsonWriter* _w, unsigned char _lead32, unsigned char _lead64, double _num) {
+  if (_num >= -FLT_MAX && _num <= FLT_MAX && (double)(float)_num == _num) {
+    float f = (float)_num;
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    json_writer_head(_w, _lead32, bits, 4);
+    return;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &_num, sizeof(bits));
+  json_writer_head(_w, _lead64, bits, 8);
+}
+
+// Text of _len bytes once unescaped, straight into the buffer. Every escape
+// that changes the text shortens it, same length means nothing to do.
+static void json_writer_text(JsonWriter* _w, const JsonString* _str, size_t _len) {
+  if (_len == _str->length) {
+    json_writer_append(_w, _str->value, _len);
+    return;
+  }
+  if (json_writer_reserve(_w, _len)) {
+    json_unescape(_str->value, _str->length, json_writer_end(_w));
+  }
+  _w->length += _len;
+}
+
+static size_t json_text_length(const JsonString* _str) {
+  if (memchr(_str->value, '\\', _str->length) == NULL) {
+    return _str->length;
+  }
+  return json_unescape(_str->value, _str->length, NULL);
+}
+
+static void json_msgpack_uint(JsonWriter* _w, uint64_t _num) {
+  if (_num < 0x80) {
+    json_writer_char(_w, (char)_num);
+  }
+  else if (_num <= 0xff) {
+    json_writer_head(_w, 0xcc, _num, 1);
+  }
+  else if (_num <= 0xffff) {
+    json_writer_head(_w, 0xcd, _num, 2);
+  }
+  else if (_num <= 0xffffffff) {
+    json_writer_head(_w, 0xce, _num, 4);
+  }
+  else {
+    json_writer_head(_w, 0xcf, _num, 8);
+  }
+}
+
+static void json_msgpack_int(JsonWriter* _w, int64_t _num) {
+  if (_num >= 0) {
+    json_msgpack_uint(_w, (uint64_t)_num);
+  }
+  else if (_num >= -32) {
+    json_writer_char(_w, (char)_num);
+  }
+  else if (_num >= INT8_MIN) {
+    json_writer_head(_w, 0xd0, (uint64_t)_num, 1);
+  }
+  else if (_num >= INT16_MIN) {
+    json_writer_head(_w, 0xd1, (uint64_t)_num, 2);
+  }
+  else if (_num >= INT32_MIN) {
+    json_writer_head(_w, 0xd2, (uint64_t)_num, 4);
+  }
+  else {
+    json_writer_head(_w, 0xd3, (uint64_t)_num, 8);
+  }
+}
+
+// Fixed form below _fixMax, then the 8 (when _lead8 is set), 16 and 32 bit
+// forms, the 32 bit lead follows the 16 bit one
+static void json_msgpack_length(JsonWriter* _w, size_t _n, unsigned char _fix, size_t _fixMax, unsigned char _lead8, unsigned char _lead16) {
+  if (_n < _fixMax) {
+    json_writer_char(_w, (char)(_fix | _n));
+  }
+  else if (_lead8 != 0 && _n <= 0xff) {
+    json_writer_head(_w, _lead8, _n, 1);
+  }
+  else if (_n <= 0xffff) {
+    json_writer_head(_w, _lead16, _n, 2);
+  }
+  else if ((uint64_t)_n <= 0xffffffff) {
+    json_writer_head(_w, _lead16 + 1, _n, 4);
+  }
+  else {
+    _w->failed = 1;
+  }
+}
+
+static void json_msgpack_string(JsonWriter* _w, const JsonString* _str) {
+  size_t len = json_text_length(_str);
+  json_msgpack_length(_w, len, 0xa0, 32, 0xd9, 0xda);
+  json_writer_text(_w, _str, len);
+}
+
+static void json_encode_msgpackValue(JsonWriter* _w, const JsonValue* _val) {
+  switch (_val->type) {
+  case JSON_NULL:
+    json_writer_char(_w, (char)0xc0);
+    break;
+  case JSON_BOOL:
+    json_writer_char(_w, (char)(_val->boolean ? 0xc3 : 0xc2));
+    break;
+  case JSON_NUMBER:
+    if (_val->flags == JSON_INT64) {
+      json_msgpack_int(_w, _val->integer);
+    }
+    else if (_val->flags == JSON_UINT64) {
+      json_msgpack_uint(_w, _val->uinteger);
+    }
+    else {
+      json_writer_float(_w, 0xca, 0xcb, _val->number);
+    }
+    break;
+  case JSON_STRING:
+    json_msgpack_string(_w, (const JsonString*)_val->data);
+    break;
+  case JSON_ARRAY: {
+    const JsonArray* arr = (const JsonArray*)_val->data;
+    json_msgpack_length(_w, arr->length, 0x90, 16, 0, 0xdc);
+    for (size_t i = 0; i < arr->length; i++) {
+      json_encode_msgpackValue(_w, &arr->items[i]);
+    }
+    break;
+  }
+  case JSON_OBJECT: {
+    const JsonObject* obj = (const JsonObject*)_val->data;
+    json_msgpack_length(_w, obj->length, 0x80, 16, 0, 0xde);
+    for (size_t i = 0; i < obj->length; i++) {
+      json_msgpack_string(_w, &obj->attributes[i].name);
+      json_encode_msgpackValue(_w, &obj->attributes[i].value);
+    }
+    break;
+  }
+  default:
+    _w->failed = 1;
+  }
+}
+
+// Major type and argument in the shortest form
+static void json_cbor_head(JsonWriter* _w, unsigned char _major, uint64_t _n) {
+  unsigned char lead = (unsigned char)(_major << 5);
+  if (_n < 24) {
+    json_writer_char(_w, (char)(lead | _n));
+  }
+  else if (_n <= 0xff) {
+    json_writer_head(_w, lead | 24, _n, 1);
+  }
+  else if (_n <= 0xffff) {
+    json_writer_head(_w, lead | 25, _n, 2);
+  }
+  else if (_n <= 0xffffffff) {
+    json_writer_head(_w, lead | 26, _n, 4);
+  }
+  else {
+    json_writer_head(_w, lead | 27, _n, 8);
+  }
+}
+
+static void json_cbor_string(JsonWriter* _w, const JsonString* _str) {
+  size_t len = json_text_length(_str);
+  json_cbor_head(_w, 3, len);
+  json_writer_text(_w, _str, len);
+}
+
+static void json_encode_cborValue(JsonWriter* _w, const JsonValue* _val) {
+  switch (_val->type) {
+  case JSON_NULL:
+    json_writer_char(_w, (char)0xf6);
+    break;
+  case JSON_BOOL:
+    json_writer_char(_w, (char)(_val->boolean ? 0xf5 : 0xf4));
+    break;
+  case JSON_NUMBER:
+    if (_val->flags == JSON_INT64 && _val->integer < 0) {
+      json_cbor_head(_w, 1, ~(uint64_t)_val->integer);
+    }
+    else if (_val->flags == JSON_INT64 || _val->flags == JSON_UINT64) {
+      json_cbor_head(_w, 0, _val->uinteger);
+    }
+    else {
+      json_writer_float(_w, 0xfa, 0xfb, _val->number);
+    }
+    break;
+  case JSON_STRING:
+    json_cbor_string(_w, (const JsonString*)_val->data);
+    break;
+  case JSON_ARRAY: {
+    const JsonArray* arr = (const JsonArray*)_val->data;
+    json_cbor_head(_w, 4, arr->length);
+    for (size_t i = 0; i < arr->length; i++) {
+      json_encode_cborValue(_w, &arr->items[i]);
+    }
+    break;
+  }
+  case JSON_OBJECT: {
+    const JsonObject* obj = (const JsonObject*)_val->data;
+    json_cbor_head(_w, 5, obj->length);
+    for (size_t i = 0; i < obj->length; i++) {
+      json_cbor_string(_w, &obj->attributes[i].name);
+      json_encode_cborValue(_w, &obj->attributes[i].value);
+    }
+    break;
+  }
+  default:
+    _w->failed = 1;
+  }
+}
+
+static char* json_encode_binary(const JsonValue* _value, size_t* _len, void (*_encode)(JsonWriter* _w, const JsonValue* _val)) {
+  if (_value == NULL) {
+    return NULL;
+  }
+
+  JsonWriter w;
+  json_writer_init(&w, NULL, 0, 0);
+  _encode(&w, _value);
+
+  if (w.failed) {
+    free(w.value);
+    return NULL;
+  }
+  if (_len != NULL) {
+    *_len = w.length;
+  }
+  return w.value;
+}
+
+char* json_encode_msgpack(const JsonValue* _value, size_t* _len) {
+  return json_encode_binary(_value, _len, json_encode_msgpackValue);
+}
+
+char* json_encode_cbor(const JsonValue* _value, size_t* _len) {
+  return json_encode_binary(_value, _len, json_encode_cborValue);
+}
+
+// Big endian unsigned of _size bytes
+static char json_read_be(JsonStream* _enc, int _size, uint64_t* _out) {
+  if (_enc->length < (size_t)_size) {
+    return 0;
+  }
+
+  const unsigned char* p = (const unsigned char*)_enc->current;
+  uint64_t v = 0;
+  for (int i = 0; i < _size; i++) {
+    v = (v << 8) | p[i];
+  }
+  *_out = v;
+  json_move_stream(_enc, _size);
+  return 1;
+}
+
+static void json_set_uint64(JsonValue* _v, uint64_t _num) {
+  _v->type = JSON_NUMBER;
+  _v->flags = _num <= INT64_MAX ? JSON_INT64 : JSON_UINT64;
+  _v->uinteger = _num;
+}
+
+static void json_set_int64(JsonValue* _v, int64_t _num) {
+  _v->type = JSON_NUMBER;
+  _v->flags = JSON_INT64;
+  _v->integer = _num;
+}
+
+static void json_set_double(JsonValue* _v, double _num) {
+  _v->type = JSON_NUMBER;
+  _v->flags = 0;
+  _v->number = _num;
+}
+
+static double json_float_bits(uint32_t _bits) {
+  float f;
+  memcpy(&f, &_bits, sizeof(f));
+  return f;
+}
+
+// IEEE half precision, exact in a double
+static double json_half_bits(uint64_t _bits) {
+  uint64_t sign = (_bits & 0x8000) << 48;
+  uint64_t exp = (_bits >> 10) & 0x1f;
+  uint64_t mant = _bits & 0x3ff;
+  if (exp == 0) {
+    double v = (double)mant / 16777216.0;
+    return sign ? -v : v;
+  }
+  exp = exp == 0x1f ? 0x7ff : exp - 15 + 1023;
+  return json_double_fromBits(sign | (exp << 52) | (mant << 42));
+}
+
+// _len raw bytes of the input as escaped text
+static char json_decode_binaryText(JsonStream* _enc, uint64_t _len, JsonString* _str) {
+  if (_len > _enc->length) {
+    return 0;
+  }
+
+  size_t len = json_escape(_enc->current, _len, NULL);
+  char* value = json_alloc(_enc, len + 1);
+  if (value == NULL) {
+    return 0;
+  }
+  if (len == _len) {
+    memcpy(value, _enc->current, len);
+  }
+  else {
+    json_escape(_enc->current, _len, value);
+  }
+  value[len] = '\0';
+
+  _str->value = value;
+  _str->length = len;
+  json_move_stream(_enc, _len);
+  return 1;
+}
+
+// A string item goes into _key for an object key, into a new node otherwise
+static char json_decode_binaryString(JsonStream* _enc, JsonValue* _v, JsonString* _key, uint64_t _len, char (*_text)(JsonStream* _enc, uint64_t _len, JsonString* _str)) {
+  if (_key != NULL) {
+    return _text(_enc, _len, _key);
+  }
+
+  JsonString* str = json_alloc(_enc, sizeof(JsonString));
+  if (str == NULL) {
+    return 0;
+  }
+  if (_text(_enc, _len, str) == 0) {
+    if (_enc->arena == NULL) {
+      free(str);
+    }
+    return 0;
+  }
+  _v->type = JSON_STRING;
+  _v->data = str;
+  return 1;
+}
+
+// Every item takes at least one byte, a count larger than the input is
+// refused before anything is allocated. The CBOR indefinite count runs up
+// to a break byte instead.
+static JsonArray* json_decode_binaryArray(JsonStream* _enc, uint64_t _count, JsonBinaryItem _item) {
+  if (_count != JSON_CBOR_INDEFINITE && _count > _enc->length) {
+    return NULL;
+  }
+
+  size_t base = _enc->scratchLength;
+  for (uint64_t i = 0; i < _count; i++) {
+    if (_count == JSON_CBOR_INDEFINITE && _enc->length > 0 && (unsigned char)_enc->current[0] == 0xff) {
+      json_move_stream(_enc, 1);
+      break;
+    }
+
+    JsonValue item;
+    if (_item(_enc, &item, NULL) == 0) {
+      goto clean;
+    }
+    if (json_scratch_push(_enc, &item, sizeof(item)) == 0) {
+      if (_enc->arena == NULL) {
+	json_free_value(&item);
+      }
+      goto clean;
+    }
+  }
+
+  return json_new_array(_enc, base);
+
+ clean:
+  json_scratch_drop(_enc, base, JSON_ARRAY);
+  return NULL;
+}
+
+static JsonObject* json_decode_binaryObject(JsonStream* _enc, uint64_t _count, JsonBinaryItem _item) {
+  if (_count != JSON_CBOR_INDEFINITE && _count > _enc->length / 2) {
+    return NULL;
+  }
+
+  size_t base = _enc->scratchLength;
+  for (uint64_t i = 0; i < _count; i++) {
+    if (_count == JSON_CBOR_INDEFINITE && _enc->length > 0 && (unsigned char)_enc->current[0] == 0xff) {
+      json_move_stream(_enc, 1);
+      break;
+    }
+
+    JsonObjectAttribute attr;
+    if (_item(_enc, &attr.value, &attr.name) == 0) {
+      goto clean;
+    }
+    if (_item(_enc, &attr.value, NULL) == 0) {
+      if (_enc->arena == NULL) {
+	free(attr.name.value);
+      }
+      goto clean;
+    }
+    if (json_scratch_push(_enc, &attr, sizeof(attr)) == 0) {
+      if (_enc->arena == NULL) {
+	json_free_objectAttribute(&attr);
+      }
       goto clean;
     }
-    arrI = json_get_arrayItem(arr, index);
-    if (arrI == NULL) {
-      goto clean;
+  }
+
+  return json_new_object(_enc, base);
+
+ clean:
+  json_scratch_drop(_enc, base, JSON_OBJECT);
+  return NULL;
+}
+
+static char json_decode_binaryContainer(JsonStream* _enc, JsonValue* _v, char _type, uint64_t _count, JsonBinaryItem _item) {
+  if (_type == JSON_OBJECT) {
+    _v->data = json_decode_binaryObject(_enc, _count, _item);
+  }
+  else {
+    _v->data = json_decode_binaryArray(_enc, _count, _item);
+  }
+  if (_v->data == NULL) {
+    return 0;
+  }
+  _v->type = _type;
+  return 1;
+}
+
+static char json_decode_msgpackValue(JsonStream* _enc, JsonValue* _v, JsonString* _key) {
+  _v->type = JSON_NULL;
+  _v->flags = 0;
+  _v->data = NULL;
+  if (_enc->length == 0) {
+    return 0;
+  }
+
+  unsigned char b = (unsigned char)_enc->current[0];
+  json_move_stream(_enc, 1);
+  uint64_t n;
+
+  // fixstr, str 8, 16 and 32
+  if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb)) {
+    n = b & 0x1f;
+    if (b >= 0xd9 && json_read_be(_enc, 1 << (b - 0xd9), &n) == 0) {
+      return 0;
+    }
+    return json_decode_binaryString(_enc, _v, _key, n, json_decode_binaryText);
+  }
+  if (_key != NULL) {
+    return 0;
+  }
+  if (b <= 0x7f) {
+    json_set_int64(_v, b);
+    return 1;
+  }
+  if (b >= 0xe0) {
+    json_set_int64(_v, (int8_t)b);
+    return 1;
+  }
+  // fixmap and fixarray
+  if (b <= 0x9f) {
+    n = b & 0x0f;
+    if (b <= 0x8f) {
+      return json_decode_binaryContainer(_enc, _v, JSON_OBJECT, n, json_decode_msgpackValue);
+    }
+    return json_decode_binaryContainer(_enc, _v, JSON_ARRAY, n, json_decode_msgpackValue);
+  }
+
+  switch (b) {
+  case 0xc0:
+    return 1;
+  case 0xc2:
+  case 0xc3:
+    _v->type = JSON_BOOL;
+    _v->boolean = b == 0xc3;
+    return 1;
+  case 0xca:
+    if (json_read_be(_enc, 4, &n) == 0) {
+      return 0;
+    }
+    json_set_double(_v, json_float_bits((uint32_t)n));
+    return 1;
+  case 0xcb:
+    if (json_read_be(_enc, 8, &n) == 0) {
+      return 0;
+    }
+    json_set_double(_v, json_double_fromBits(n));
+    return 1;
+  case 0xcc: case 0xcd: case 0xce: case 0xcf:
+    if (json_read_be(_enc, 1 << (b - 0xcc), &n) == 0) {
+      return 0;
+    }
+    json_set_uint64(_v, n);
+    return 1;
+  case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+    int size = 1 << (b - 0xd0);
+    if (json_read_be(_enc, size, &n) == 0) {
+      return 0;
+    }
+    // Sign extend from the top bit of the field
+    int shift = 64 - 8 * size;
+    json_set_int64(_v, (int64_t)(n << shift) >> shift);
+    return 1;
+  }
+  case 0xdc: case 0xdd:
+    if (json_read_be(_enc, b == 0xdc ? 2 : 4, &n) == 0) {
+      return 0;
+    }
+    return json_decode_binaryContainer(_enc, _v, JSON_ARRAY, n, json_decode_msgpackValue);
+  case 0xde: case 0xdf:
+    if (json_read_be(_enc, b == 0xde ? 2 : 4, &n) == 0) {
+      return 0;
     }
-    v = arrI->data;
-    break;
-
+    return json_decode_binaryContainer(_enc, _v, JSON_OBJECT, n, json_decode_msgpackValue);
   default:
-    goto clean;
-  }
-
-  if (last != 1) {
-    v = json_get(v, _path + end + 1);
+    // Never used, bin and ext
+    return 0;
   }
-
- clean:
-  free(sub);
-
-  return v;
 }
 
-/*************
- ** ENCODER **
- *************/
-typedef struct JsonStringNode {
-  char* value;
-  size_t length;
-  struct JsonStringNode* next;
-} JsonStringNode;
+// Major type and argument of a CBOR item, info 31 (indefinite length or
+// break) leaves _n at JSON_CBOR_INDEFINITE
+static char json_decode_cborHead(JsonStream* _enc, unsigned char* _major, unsigned char* _info, uint64_t* _n) {
+  if (_enc->length == 0) {
+    return 0;
+  }
 
-static JsonStringNode* json_encode_value(JsonValue* _val);
+  unsigned char b = (unsigned char)_enc->current[0];
+  json_move_stream(_enc, 1);
+  *_major = b >> 5;
+  *_info = b & 0x1f;
 
-static void json_free_stringNode(JsonStringNode* _node) {
-  if (_node == NULL) {
-    return;
+  if (*_info < 24) {
+    *_n = *_info;
+    return 1;
   }
-
-  JsonStringNode* node = _node;
-  while (node) {
-    _node = node->next;
-    free(node->value);
-    free(node);
-    node = _node;
+  if (*_info <= 27) {
+    return json_read_be(_enc, 1 << (*_info - 24), _n);
   }
+  *_n = JSON_CBOR_INDEFINITE;
+  return *_info == 31;
 }
 
-static JsonStringNode* json_new_stringNode(size_t size) {
-  JsonStringNode* node = malloc(sizeof(JsonStringNode));
-  node->value = malloc(size);
-  node->next = NULL;
-  node->length = size - 1;
-  while (size--) {
-    node->value[size] = '\0';
-  }
-  return node;
-}
+// Chunks of an indefinite text string, each a definite text string, up to
+// the break. Measured on a copy of the stream, then copied.
+static char json_decode_cborChunks(JsonStream* _enc, uint64_t _len, JsonString* _str) {
+  (void)_len;
+  unsigned char major;
+  unsigned char info;
+  uint64_t n;
 
-static JsonStringNode* json_merge_stringNode(JsonStringNode* _node, size_t _start, size_t _offset) {
   size_t len = 0;
-  JsonStringNode* node = _node;
-  while (node != NULL) {
-    len += node->length;
-    node = node->next;
-  }
-
-  JsonStringNode* merge = json_new_stringNode(len + _offset + 1);
-  char* val = merge->value + _start;
-
-  node = _node;
-  len = 0;
-  while (node != NULL) {
-    json_string_cat(val + len, node->length, node->value);
-    len += node->length;
-    node = node->next;
-  }
-
-  json_free_stringNode(_node);
-  return merge;
-}
-
-static JsonStringNode* json_encode_string(JsonString* _str) {
-  JsonStringNode* node = json_new_stringNode(_str->length + 3);
-  size_t len = _str->length + 2;
-  node->value[0] = '"';
-  node->value[len - 1] = '"';
-  json_string_cat(node->value + 1, len - 1, _str->value);
-  return node;
-}
-
-static JsonStringNode* json_encode_number(JsonNumber* _num) {
-  JsonStringNode* node = json_new_stringNode(330);
-  snprintf(node->value, node->length, "%9.16f", _num->value);
-  ssize_t index = json_string_indexOf('.', node->value, node->length, 0);
-  node->length = json_string_length(node->value);
-  if (index > -1) {
-    size_t len = node->length;
-    while (len--) {
-      if (node->value[len] == '0') {
-	node->value[len] = '\0';
-	node->length--;
-	continue;
-      }
+  JsonStream scan = *_enc;
+  for (;;) {
+    if (json_decode_cborHead(&scan, &major, &info, &n) == 0) {
+      return 0;
+    }
+    if (major == 7 && info == 31) {
+      break;
+    }
+    if (major != 3 || info == 31 || n > scan.length) {
+      return 0;
+    }
+    len += json_escape(scan.current, n, NULL);
+    json_move_stream(&scan, n);
+  }
 
-      if (node->value[len] == '.') {
-	node->value[len] = '\0';
-	node->length--;
-      }
+  char* value = json_alloc(_enc, len + 1);
+  if (value == NULL) {
+    return 0;
+  }
 
+  size_t at = 0;
+  for (;;) {
+    json_decode_cborHead(_enc, &major, &info, &n);
+    if (major == 7) {
       break;
     }
+    at += json_escape(_enc->current, n, value + at);
+    json_move_stream(_enc, n);
   }
-  return node;
-}
+  value[len] = '\0';
 
-static JsonStringNode* json_encode_bool(JsonBool* _bol) {
-  size_t len = _bol->value ? 4 : 5;
-  JsonStringNode* node = json_new_stringNode(len + 1);
-  json_string_cat(node->value, len, _bol->value ? TRUE_STR : FALSE_STR);
-  return node;
-}
-
-static JsonStringNode* json_encode_null() {
-  size_t len = 4;
-  JsonStringNode* node = json_new_stringNode(len + 1);
-  json_string_cat(node->value, len, NULL_STR);
-  return node;
+  _str->value = value;
+  _str->length = len;
+  return 1;
 }
 
-static JsonStringNode* json_encode_objectAttribute(JsonObjectAttribute* _attr) {
-  JsonStringNode* name = json_encode_string(_attr->name);
-  JsonStringNode* colon = json_new_stringNode(1);
-  JsonStringNode* value = json_encode_value(_attr->data);
-  colon->value[0] = ':';
-  colon->length++;
-  name->next = colon;
-  colon->next = value;
-  return json_merge_stringNode(name, 0, 0);
-}
+static char json_decode_cborValue(JsonStream* _enc, JsonValue* _v, JsonString* _key) {
+  _v->type = JSON_NULL;
+  _v->flags = 0;
+  _v->data = NULL;
+
+  // Tags are skipped, the tagged item stands for itself
+  unsigned char major;
+  unsigned char info;
+  uint64_t n;
+  do {
+    if (json_decode_cborHead(_enc, &major, &info, &n) == 0) {
+      return 0;
+    }
+  } while (major == 6 && info != 31);
 
-static JsonStringNode* json_encode_object(JsonObject* _obj) {
-  JsonStringNode* first = NULL;
-  JsonStringNode* node = NULL;
+  if (major == 3) {
+    return json_decode_binaryString(_enc, _v, _key, n, info == 31 ? json_decode_cborChunks : json_decode_binaryText);
+  }
+  if (_key != NULL) {
+    return 0;
+  }
 
-  JsonObjectAttribute* attr = _obj->first;
-  while (attr != NULL) {
-    JsonStringNode* attrNode = json_encode_objectAttribute(attr);
-    if (first == NULL) {
-      first = attrNode;
+  switch (major) {
+  case 0:
+    if (info == 31) {
+      return 0;
+    }
+    json_set_uint64(_v, n);
+    return 1;
+  case 1:
+    if (info == 31) {
+      return 0;
+    }
+    if (n <= INT64_MAX) {
+      json_set_int64(_v, -1 - (int64_t)n);
     }
     else {
-      node->next = attrNode;
+      json_set_double(_v, -1.0 - (double)n);
     }
-    node = attrNode;
-    attr = attr->next;
-
-    if (attr != NULL) {
-      JsonStringNode* commaNode = json_new_stringNode(1);
-      commaNode->value[0] = ',';
-      commaNode->length++;
-      node->next = commaNode;
-      node = commaNode;
+    return 1;
+  case 4:
+  case 5:
+    // A definite count of 2^64 - 1 would read as indefinite
+    if (info != 31 && n > _enc->length) {
+      return 0;
     }
+    return json_decode_binaryContainer(_enc, _v, major == 5 ? JSON_OBJECT : JSON_ARRAY, n, json_decode_cborValue);
+  case 7:
+    switch (info) {
+    case 20:
+    case 21:
+      _v->type = JSON_BOOL;
+      _v->boolean = info == 21;
+      return 1;
+    case 22:
+    case 23:
+      return 1;
+    case 25:
+      json_set_double(_v, json_half_bits(n));
+      return 1;
+    case 26:
+      json_set_double(_v, json_float_bits((uint32_t)n));
+      return 1;
+    case 27:
+      json_set_double(_v, json_double_fromBits(n));
+      return 1;
+    }
+    return 0;
+  default:
+    // Byte strings
+    return 0;
   }
+}
 
-  node = json_merge_stringNode(first, 1, 2);
-  node->value[0] = '{';
-  node->value[node->length - 1] = '}';
+// The whole input must be one item. On failure the stream is the error
+// data, pointing at where decoding stopped.
+static JsonValue* json_decode_binaryRoot(JsonStream* _enc, JsonBinaryItem _item) {
+  JsonValue* data = json_alloc(_enc, sizeof(JsonValue));
+  if (_item(_enc, data, NULL) == 0 || _enc->length != 0) {
+    if (_enc->arena == NULL) {
+      json_free_value(data);
+    }
+    data->type = JSON_ERROR;
+    data->data = _enc;
+    _enc->length = 0;
+  }
 
-  return node;
+  json_scratch_free(_enc);
+  if (data->type != JSON_ERROR && _enc->arena == NULL) {
+    free(_enc);
+  }
+  return data;
 }
 
-static JsonStringNode* json_encode_arrayItem(JsonArrayItem* _item) {
-  return json_encode_value(_item->data);
-}
+static JsonDocument* json_decode_binaryDocument(const char* _data, size_t _len, JsonBinaryItem _item) {
+  if (_data == NULL || _len < 1) {
+    return NULL;
+  }
 
-static JsonStringNode* json_encode_array(JsonArray* _arr) {
-  JsonStringNode* first = NULL;
-  JsonStringNode* node = NULL;
+  JsonDocument* doc = malloc(sizeof(JsonDocument));
+  json_arena_init(&doc->arena, _len * 2);
 
-  JsonArrayItem* item = _arr->first;
-  while (item != NULL) {
-    JsonStringNode* itemNode = json_encode_arrayItem(item);
-    if (first == NULL) {
-      first = itemNode;
-    }
-    else {
-      node->next = itemNode;
-    }
-    node = itemNode;
-    item = item->next;
+  doc->buffer = NULL;
+  doc->bufferLength = 0;
+  doc->root = json_decode_binaryRoot(json_stream(_data, _len, &doc->arena), _item);
+  return doc;
+}
 
-    if (item != NULL) {
-      JsonStringNode* commaNode = json_new_stringNode(1);
-      commaNode->value[0] = ',';
-      commaNode->length++;
-      node->next = commaNode;
-      node = commaNode;
-    }
+JsonValue* json_decode_msgpack(const char* _data, size_t _len) {
+  if (_data == NULL || _len < 1) {
+    return NULL;
   }
-
-  node = json_merge_stringNode(first, 1, 2);
-  node->value[0] = '[';
-  node->value[node->length - 1] = ']';
-
-  return node;
+  return json_decode_binaryRoot(json_stream(_data, _len, NULL), json_decode_msgpackValue);
 }
 
-static JsonStringNode* json_encode_value(JsonValue* _val) {
-  switch (_val->type) {
-  case JSON_BOOL:
-    return json_encode_bool((JsonBool*)_val->data);
-    break;
-  case JSON_NUMBER:
-    return json_encode_number((JsonNumber*)_val->data);
-    break;
-  case JSON_NULL:
-    return json_encode_null();
-    break;
-  case JSON_STRING:
-    return json_encode_string((JsonString*)_val->data);
-    break;
-  case JSON_OBJECT:
-    return json_encode_object((JsonObject*)_val->data);
-    break;
-  case JSON_ARRAY:
-    return json_encode_array((JsonArray*)_val->data);
-    break;
+JsonValue* json_decode_cbor(const char* _data, size_t _len) {
+  if (_data == NULL || _len < 1) {
+    return NULL;
   }
+  return json_decode_binaryRoot(json_stream(_data, _len, NULL), json_decode_cborValue);
+}
 
-  return NULL;
+JsonDocument* json_decode_msgpackDocument(const char* _data, size_t _len) {
+  return json_decode_binaryDocument(_data, _len, json_decode_msgpackValue);
 }
 
-char* json_encode(JsonValue* _value) {
-  JsonStringNode* node = json_encode_value(_value);
-  char* result = node->value;
-  node->value = NULL;
-  json_free_stringNode(node);
-  return result;
+JsonDocument* json_decode_cborDocument(const char* _data, size_t _len) {
+  return json_decode_binaryDocument(_data, _len, json_decode_cborValue);
 }
 
 /*****************
@@ -1125,15 +6583,33 @@ const JsonValue* GetValue(const JsonValue* _v, const char* _path) {
     return v;
 }
 
-static const char* json_value_toString(const JsonValue* _v) {
+// Any string with its length, terminated or not
+static const char* json_value_toStringN(const JsonValue* _v, size_t* _len) {
     if (_v == NULL || _v->type != JSON_STRING) {
+      if (_len != NULL) {
+	*_len = 0;
+      }
       return NULL;
     }
 
     const JsonString* s = (const JsonString*)_v->data;
+    if (_len != NULL) {
+      *_len = s->length;
+    }
     return s->value;
 }
 
+// Only C strings. A borrowed string of json_decode_file is followed by its
+// closing quote instead of the '\0' every other decoder writes.
+static const char* json_value_toString(const JsonValue* _v) {
+    size_t len;
+    const char* value = json_value_toStringN(_v, &len);
+    if (value == NULL || value[len] != '\0') {
+      return NULL;
+    }
+    return value;
+}
+
 static double json_undefined() {
       double a = 0;
       return a/a;
@@ -1144,8 +6620,49 @@ static double json_value_toNumber(const JsonValue* _v) {
       return json_undefined();
     }
 
-    const JsonNumber* n = (const JsonNumber*)_v->data;
-    return n->value;
+    if (_v->flags == JSON_INT64) {
+      return (double)_v->integer;
+    }
+    if (_v->flags == JSON_UINT64) {
+      return (double)_v->uinteger;
+    }
+    return _v->number;
+}
+
+static int64_t json_value_toInt64(const JsonValue* _v) {
+    if (_v == NULL || _v->type != JSON_NUMBER || _v->flags == JSON_UINT64) {
+      return 0;
+    }
+
+    if (_v->flags == JSON_INT64) {
+      return _v->integer;
+    }
+
+    // Whole doubles in range, 1e3 or 2.0
+    double d = _v->number;
+    if (d >= -9223372036854775808.0 && d < 9223372036854775808.0 && d == (double)(int64_t)d) {
+      return (int64_t)d;
+    }
+    return 0;
+}
+
+static uint64_t json_value_toUInt64(const JsonValue* _v) {
+    if (_v == NULL || _v->type != JSON_NUMBER) {
+      return 0;
+    }
+
+    if (_v->flags == JSON_UINT64) {
+      return _v->uinteger;
+    }
+    if (_v->flags == JSON_INT64) {
+      return _v->integer < 0 ? 0 : (uint64_t)_v->integer;
+    }
+
+    double d = _v->number;
+    if (d >= 0 && d < 18446744073709551616.0 && d == (double)(uint64_t)d) {
+      return (uint64_t)d;
+    }
+    return 0;
 }
 
 static char json_value_toBool(const JsonValue* _v) {
@@ -1153,8 +6670,7 @@ static char json_value_toBool(const JsonValue* _v) {
       return -1;
     }
 
-    const JsonBool* b = (const JsonBool*)_v->data;
-    return b->value;
+    return _v->boolean;
 }
 
 static char json_value_toNull(const JsonValue* _v) {
@@ -1162,8 +6678,7 @@ static char json_value_toNull(const JsonValue* _v) {
       return -1;
     }
 
-    const JsonNull* n = (const JsonNull*)_v->data;
-    return n->value;
+    return 0;
 }
 
 static const JsonObject* json_value_toObject(const JsonValue* _v) {
@@ -1186,10 +6701,22 @@ const char* json_get_string(const JsonValue* _v, const char* _path) {
     return json_value_toString(json_get(_v, _path));
 }
 
+const char* json_get_string_n(const JsonValue* _v, const char* _path, size_t* _len) {
+    return json_value_toStringN(json_get(_v, _path), _len);
+}
+
 double json_get_number(const JsonValue* _v, const char* _path) {
     return json_value_toNumber(json_get(_v, _path));
 }
 
+int64_t json_get_int64(const JsonValue* _v, const char* _path) {
+    return json_value_toInt64(json_get(_v, _path));
+}
+
+uint64_t json_get_uint64(const JsonValue* _v, const char* _path) {
+    return json_value_toUInt64(json_get(_v, _path));
+}
+
 char json_get_bool(const JsonValue* _v, const char* _path) {
     return json_value_toBool(json_get(_v, _path));
 }
@@ -1198,6 +6725,26 @@ char json_get_null(const JsonValue* _v, const char* _path) {
     return json_value_toNull(json_get(_v, _path));
 }
 
+const char* json_get_compiled_string(const JsonValue* _v, const JsonPath* _path) {
+    return json_value_toString(json_get_compiled(_v, _path));
+}
+
+const char* json_get_compiled_string_n(const JsonValue* _v, const JsonPath* _path, size_t* _len) {
+    return json_value_toStringN(json_get_compiled(_v, _path), _len);
+}
+
+double json_get_compiled_number(const JsonValue* _v, const JsonPath* _path) {
+    return json_value_toNumber(json_get_compiled(_v, _path));
+}
+
+char json_get_compiled_bool(const JsonValue* _v, const JsonPath* _path) {
+    return json_value_toBool(json_get_compiled(_v, _path));
+}
+
+char json_get_compiled_null(const JsonValue* _v, const JsonPath* _path) {
+    return json_value_toNull(json_get_compiled(_v, _path));
+}
+
 const JsonObject* json_get_object(const JsonValue* _v, const char* _path) {
     if (_path != NULL) {
         _v = json_get(_v, _path);
@@ -1211,7 +6758,12 @@ const char* json_get_object_string(const JsonObject* _obj, const char* _attribut
     if (attr == NULL) {
       return NULL;
     }
-    return json_value_toString(attr->data);
+    return json_value_toString(&attr->value);
+}
+
+const char* json_get_object_string_n(const JsonObject* _obj, const char* _attributeName, size_t* _len) {
+    JsonObjectAttribute* attr = json_get_objectAttribute(_obj, _attributeName, json_string_length(_attributeName));
+    return json_value_toStringN(attr != NULL ? &attr->value : NULL, _len);
 }
 
 double json_get_object_number(const JsonObject* _obj, const char* _attributeName) {
@@ -1219,7 +6771,23 @@ double json_get_object_number(const JsonObject* _obj, const char* _attributeName
     if (attr == NULL) {
       return json_undefined();
     }
-    return json_value_toNumber(attr->data);
+    return json_value_toNumber(&attr->value);
+}
+
+int64_t json_get_object_int64(const JsonObject* _obj, const char* _attributeName) {
+    JsonObjectAttribute* attr = json_get_objectAttribute(_obj, _attributeName, json_string_length(_attributeName));
+    if (attr == NULL) {
+      return 0;
+    }
+    return json_value_toInt64(&attr->value);
+}
+
+uint64_t json_get_object_uint64(const JsonObject* _obj, const char* _attributeName) {
+    JsonObjectAttribute* attr = json_get_objectAttribute(_obj, _attributeName, json_string_length(_attributeName));
+    if (attr == NULL) {
+      return 0;
+    }
+    return json_value_toUInt64(&attr->value);
 }
 
 char json_get_object_bool(const JsonObject* _obj, const char* _attributeName) {
@@ -1227,7 +6795,7 @@ char json_get_object_bool(const JsonObject* _obj, const char* _attributeName) {
     if (attr == NULL) {
       return '\0';
     }
-    return json_value_toBool(attr->data);
+    return json_value_toBool(&attr->value);
 }
 
 char json_get_object_null(const JsonObject* _obj, const char* _attributeName) {
@@ -1235,7 +6803,7 @@ char json_get_object_null(const JsonObject* _obj, const char* _attributeName) {
     if (attr == NULL) {
       return '\0';
     }
-    return json_value_toNull(attr->data);
+    return json_value_toNull(&attr->value);
 }
 
 const JsonArray* json_get_object_array(const JsonObject* _obj, const char* _attributeName) {
@@ -1243,7 +6811,7 @@ const JsonArray* json_get_object_array(const JsonObject* _obj, const char* _attr
     if (attr == NULL) {
       return NULL;
     }
-    return json_value_toArray(attr->data);
+    return json_value_toArray(&attr->value);
 }
 
 const JsonObject* json_get_object_object(const JsonObject* _obj, const char* _attributeName) {
@@ -1251,7 +6819,7 @@ const JsonObject* json_get_object_object(const JsonObject* _obj, const char* _at
     if (attr == NULL) {
       return NULL;
     }
-    return json_value_toObject(attr->data);
+    return json_value_toObject(&attr->value);
 }
 
 const JsonArray* json_get_array(const JsonValue* _v, const char* _path) {
@@ -1263,49 +6831,284 @@ const JsonArray* json_get_array(const JsonValue* _v, const char* _path) {
 }
 
 const char* json_get_array_string(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return NULL;
     }
-    return json_value_toString(item->data);
+    return json_value_toString(item);
+}
+
+const char* json_get_array_string_n(const JsonArray* _arr, size_t _itemIndex, size_t* _len) {
+    return json_value_toStringN(json_get_arrayItem(_arr, _itemIndex), _len);
 }
 
 double json_get_array_number(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return json_undefined();
     }
-    return json_value_toNumber(item->data);
+    return json_value_toNumber(item);
+}
+
+int64_t json_get_array_int64(const JsonArray* _arr, size_t _itemIndex) {
+    return json_value_toInt64(json_get_arrayItem(_arr, _itemIndex));
+}
+
+uint64_t json_get_array_uint64(const JsonArray* _arr, size_t _itemIndex) {
+    return json_value_toUInt64(json_get_arrayItem(_arr, _itemIndex));
 }
 
 char json_get_array_bool(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return '\0';
     }
-    return json_value_toBool(item->data);
+    return json_value_toBool(item);
 }
 
 char json_get_array_null(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return '\0';
     }
-    return json_value_toNull(item->data);
+    return json_value_toNull(item);
 }
 
 const JsonArray* json_get_array_array(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return NULL;
     }
-    return json_value_toArray(item->data);
+    return json_value_toArray(item);
 }
 
 const JsonObject* json_get_array_object(const JsonArray* _arr, size_t _itemIndex) {
-    JsonArrayItem* item = json_get_arrayItem(_arr, _itemIndex);
+    const JsonValue* item = json_get_arrayItem(_arr, _itemIndex);
     if (item == NULL) {
       return NULL;
     }
-    return json_value_toObject(item->data);
+    return json_value_toObject(item);
+}
+
+/***************
+ ** ON DEMAND **
+ ***************/
+
+// Reads one value straight from the JSON text. Only the bytes on the way to
+// it are looked at: siblings are skipped by bracket matching and are not
+// validated, nothing is allocated.
+
+static const char* json_peek_space(const char* _s, const char* _end) {
+  return _s < _end ? _s + json_skip_space(_s, _end - _s, 0) : _end;
+}
+
+// Bytes of the string at _s, quotes included, 0 when it never ends
+static size_t json_peek_skipString(const char* _s, size_t _len) {
+  size_t i = 1;
+  while (i < _len) {
+    i += json_scan_string(_s + i, _len - i, 0);
+    if (i >= _len) {
+      break;
+    }
+    if (_s[i] == JSON_STRING) {
+      return i + 1;
+    }
+    i += 2;
+  }
+
+  return 0;
+}
+
+// Bytes of the object or array at _s, 0 when it never closes
+static size_t json_peek_skipContainer(const char* _s, size_t _len) {
+  uint64_t masks[JSON_CLASS_COUNT];
+  JsonBlockState state = {0, 0};
+  size_t depth = 0;
+
+  for (size_t base = 0; base < _len; base += 64) {
+    uint64_t inString = json_scan_block(_s, _len, base, masks, &state);
+    uint64_t op = masks[JSON_CLASS_OPERATOR] & ~inString;
+    while (op) {
+      size_t i = base + json_ctz64(op);
+      switch (_s[i]) {
+      case JSON_OBJECT:
+      case JSON_ARRAY:
+	depth++;
+	break;
+      case JSON_OBJECT_END:
+      case JSON_ARRAY_END:
+	if (--depth == 0) {
+	  return i + 1;
+	}
+	break;
+      }
+      op &= op - 1;
+    }
+  }
+
+  return 0;
+}
+
+static size_t json_peek_skipValue(const char* _s, size_t _len) {
+  switch (_s[0]) {
+  case JSON_STRING:
+    return json_peek_skipString(_s, _len);
+  case JSON_OBJECT:
+  case JSON_ARRAY:
+    return json_peek_skipContainer(_s, _len);
+  }
+
+  return json_parser_scalarEnd(_s, _len);
+}
+
+// Start of the value at _path, NULL when it isn't there
+static const char* json_peek(const char* _json, size_t _len, const char* _path, const char** _end) {
+  if (_json == NULL || _path == NULL || _path[0] == '\0') {
+    return NULL;
+  }
+
+  const char* end = _json + _len;
+  const char* cur = json_peek_space(_json, end);
+  const char* seg = _path;
+  size_t n;
+
+  while (*seg != '\0') {
+    const char* segEnd = seg;
+    while (*segEnd != '\0' && *segEnd != '.') {
+      segEnd++;
+    }
+
+    if (cur >= end) {
+      return NULL;
+    }
+
+    if (seg[0] == JSON_OBJECT) {
+      if (*cur != JSON_OBJECT || segEnd - seg < 2 || segEnd[-1] != JSON_OBJECT_END) {
+	return NULL;
+      }
+
+      const char* name = seg + 1;
+      size_t nameLen = segEnd - seg - 2;
+      cur = json_peek_space(cur + 1, end);
+      for (;;) {
+	if (cur >= end || *cur != JSON_STRING || (n = json_peek_skipString(cur, end - cur)) == 0) {
+	  return NULL;
+	}
+
+	char found = json_equal_strings(cur + 1, n - 2, name, nameLen);
+	cur = json_peek_space(cur + n, end);
+	if (cur >= end || *cur != ':') {
+	  return NULL;
+	}
+	cur = json_peek_space(cur + 1, end);
+	if (found || cur >= end) {
+	  break;
+	}
+
+	if ((n = json_peek_skipValue(cur, end - cur)) == 0) {
+	  return NULL;
+	}
+	cur = json_peek_space(cur + n, end);
+	if (cur >= end || *cur != ',') {
+	  return NULL;
+	}
+	cur = json_peek_space(cur + 1, end);
+      }
+    }
+    else {
+      ssize_t index = json_string_to_size(seg, segEnd - seg);
+      if (segEnd == seg || index < 0 || *cur != JSON_ARRAY) {
+	return NULL;
+      }
+
+      cur = json_peek_space(cur + 1, end);
+      for (; index > 0; index--) {
+	if (cur >= end || *cur == JSON_ARRAY_END || (n = json_peek_skipValue(cur, end - cur)) == 0) {
+	  return NULL;
+	}
+	cur = json_peek_space(cur + n, end);
+	if (cur >= end || *cur != ',') {
+	  return NULL;
+	}
+	cur = json_peek_space(cur + 1, end);
+      }
+
+      if (cur < end && *cur == JSON_ARRAY_END) {
+	return NULL;
+      }
+    }
+
+    seg = *segEnd == '.' ? segEnd + 1 : segEnd;
+  }
+
+  if (cur >= end) {
+    return NULL;
+  }
+
+  *_end = end;
+  return cur;
+}
+
+// Decode the scalar at _path into _v with the regular scalar decoders
+static char json_peek_scalar(const char* _json, size_t _len, const char* _path, char _type, JsonValue* _v) {
+  const char* end;
+  const char* cur = json_peek(_json, _len, _path, &end);
+  if (cur == NULL) {
+    return 0;
+  }
+
+  JsonStream enc;
+  json_stream_init(&enc, cur, json_parser_scalarEnd(cur, end - cur), NULL);
+
+  char ok = 0;
+  switch (_type) {
+  case JSON_NUMBER: ok = json_decode_number(&enc, _v); break;
+  case JSON_BOOL: ok = json_decode_bool(&enc, _v); break;
+  case JSON_NULL: ok = json_decode_null(&enc, _v); break;
+  }
+  _v->type = _type;
+
+  return ok && enc.length == 0;
+}
+
+double json_peek_number(const char* _json, size_t _len, const char* _path) {
+    JsonValue v;
+    if (json_peek_scalar(_json, _len, _path, JSON_NUMBER, &v) == 0) {
+      return json_undefined();
+    }
+    return json_value_toNumber(&v);
+}
+
+char json_peek_bool(const char* _json, size_t _len, const char* _path) {
+    JsonValue v;
+    if (json_peek_scalar(_json, _len, _path, JSON_BOOL, &v) == 0) {
+      return -1;
+    }
+    return v.boolean;
+}
+
+char json_peek_null(const char* _json, size_t _len, const char* _path) {
+    JsonValue v;
+    if (json_peek_scalar(_json, _len, _path, JSON_NULL, &v) == 0) {
+      return -1;
+    }
+    return 0;
+}
+
+const char* json_peek_string(const char* _json, size_t _len, const char* _path, size_t* _strLen) {
+    const char* end;
+    const char* cur = json_peek(_json, _len, _path, &end);
+    if (cur == NULL || *cur != JSON_STRING) {
+      return NULL;
+    }
+
+    size_t n = json_peek_skipString(cur, end - cur);
+    if (n == 0) {
+      return NULL;
+    }
+
+    if (_strLen != NULL) {
+      *_strLen = n - 2;
+    }
+    return cur + 1;
 }
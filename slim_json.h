@@ -27,6 +27,8 @@
 #define __SLIM_JSON_H__
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #define JSON_OBJECT '{'
 #define JSON_ARRAY  '['
@@ -39,20 +41,69 @@
 #define JSON_OBJECT_END '}'
 #define JSON_ARRAY_END  ']'
 
+// How a JSON_NUMBER is stored, see JsonValue.flags
+#define JSON_INT64  1 // integer
+#define JSON_UINT64 2 // uinteger, only above INT64_MAX
+
+// Readable bytes json_decode_padded may touch past the end of the input
+#define JSON_PADDING 32
+
+// Objects with fewer keys are scanned instead of hashed
+#ifndef JSON_OBJECT_INDEX_MIN
+#define JSON_OBJECT_INDEX_MIN 8
+#endif
+
+// Bytes buffered by the streaming encoders before each write
+#ifndef JSON_ENCODE_BUFFER
+#define JSON_ENCODE_BUFFER 65536
+#endif
+
 typedef struct {
   char msg[250];
 } JsonError;
 
+// Arena: bump-pointer blocks released all at once
+typedef struct JsonArenaBlock {
+  struct JsonArenaBlock* next;
+  size_t size;
+  size_t used;
+} JsonArenaBlock;
+
+typedef struct JsonArena {
+  JsonArenaBlock* first; // Block currently being filled, older blocks follow
+  size_t blockSize;
+  struct JsonObjectIndex* indexes; // Object indexes built after the decode, malloc'd
+  struct JsonObjectIndex* spare; // Indexes kept by a reset for the next document
+  struct JsonArena* parent; // Took over the blocks and keeps the indexes, NULL for a document's own arena
+} JsonArena;
+
 typedef struct {
   const char* current;
   const char* start;
   size_t position;
   size_t length;
+  JsonArena* arena; // NULL when decoding into malloc'd nodes
+  char* insitu; // Mutable alias of start when strings are decoded in place
+  unsigned char borrowed; // Strings point into the input unterminated, nothing is written to it
+  unsigned char padded; // JSON_PADDING bytes are readable after the end
+  char* scratch; // Children of the open containers, moved out when one closes
+  size_t scratchLength;
+  size_t scratchCapacity;
 } JsonStream;
 
+// Numbers and bools are stored inline, everything else lives behind data.
+// Integral numbers that fit 64 bits keep every digit in integer or uinteger,
+// flags tells which member a JSON_NUMBER uses (0 for number).
 typedef struct {
   char type;
-  void* data;
+  unsigned char flags;
+  union {
+    void* data;
+    double number;
+    int64_t integer;
+    uint64_t uinteger;
+    unsigned char boolean;
+  };
 } JsonValue;
 
 // String
@@ -61,58 +112,193 @@ typedef struct {
   size_t length;
 } JsonString;
 
-// Number
+// Array, the items are stored side by side
 typedef struct {
-  double value;
-} JsonNumber;
+  JsonValue* items;
+  size_t length;
+} JsonArray;
 
-// Bool
+// Object
 typedef struct {
-  unsigned char value;
-} JsonBool;
+  JsonString name;
+  JsonValue value;
+} JsonObjectAttribute;
 
-// Null
 typedef struct {
-  unsigned char value;
-} JsonNull;
+  size_t hash; // Full key hash, the low bits give the home slot
+  JsonObjectAttribute* attribute; // NULL when the slot is empty
+} JsonObjectSlot;
 
-// Array
-typedef struct JsonArrayItem {
-  struct JsonArrayItem* next;
-  JsonValue* data;
-} JsonArrayItem;
+// Open addressing table, built on the first lookup
+typedef struct JsonObjectIndex {
+  struct JsonObjectIndex* next; // Other indexes owned by the same arena
+  size_t mask; // Table size - 1
+  uint64_t seed; // Key of the slot hashes, the process key except in snapshots
+  JsonObjectSlot slots[];
+} JsonObjectIndex;
 
 typedef struct {
-  JsonArrayItem* first;
-  JsonArrayItem* last;
-  JsonArrayItem** array; // Array of items, created after the decode is completed
+  JsonObjectAttribute* attributes; // In document order
+  JsonObjectIndex* index; // NULL until an object with JSON_OBJECT_INDEX_MIN keys is queried
   size_t length;
-} JsonArray;
-
-// Object
-typedef struct JsonObjectAttribute {
-  struct JsonObjectAttribute* next;
-  JsonString* name;
-  JsonValue* data;
-} JsonObjectAttribute;
+  JsonArena* arena; // Owner of the nodes, NULL when malloc'd
+} JsonObject;
 
-typedef struct JsonObjectDataNode {
-  struct JsonObjectDataNode* next; // If the hash collide, insert here so we can compare the item key's
-  JsonObjectAttribute* attribute;
-} JsonObjectDataNode;
+// Compiled path
+typedef struct {
+  char type; // JSON_OBJECT or JSON_ARRAY
+  const char* name;
+  size_t length;
+  size_t hash; // Key hash, computed once
+  size_t index;
+} JsonPathSegment;
 
 typedef struct {
-  JsonObjectAttribute* first;
-  JsonObjectAttribute* last;
-  JsonObjectDataNode** object; // Array for the hash
+  JsonPathSegment* segments;
   size_t length;
-} JsonObject;
+} JsonPath;
+
+// Push parser
+typedef struct {
+  char type; // JSON_OBJECT or JSON_ARRAY
+  size_t base; // Scratch offset of the first child
+} JsonParserFrame;
+
+typedef struct {
+  JsonStream enc; // Allocation settings, points at the token being decoded
+  JsonValue* root;
+  JsonParserFrame* stack;
+  size_t depth;
+  size_t stackCapacity;
+  char* token; // Token cut by the end of a chunk
+  size_t tokenLength;
+  size_t tokenCapacity;
+  char tokenType; // JSON_STRING or JSON_NUMBER (any scalar), 0 when no token is open
+  unsigned char escaped; // The last chunk ended inside a string escape
+  char state;
+  size_t offset; // Bytes fed so far
+  JsonArena arena; // Documents of json_parser_decode, kept until json_parser_reset
+} JsonParser;
+
+// Document, the whole tree lives in the arena
+typedef struct {
+  JsonArena arena;
+  JsonValue* root;
+  void* buffer; // Input owned by the document, json_decode_file and json_snapshot_open only
+  size_t bufferLength;
+} JsonDocument;
+
+// Read only document shared between threads. Objects are indexed when it is
+// frozen, so every json_get_* call on the tree only reads and never locks.
+typedef struct {
+  JsonDocument* doc;
+  volatile size_t references;
+} JsonFrozen;
+
+// Hands the current version of a frozen document to reader threads while a
+// reloader publishes new ones. Readers never block.
+typedef struct {
+  JsonFrozen* volatile current;
+  volatile size_t readers[2]; // Readers about to retain current, per generation parity
+  volatile size_t generation;
+  volatile size_t publishing; // Publishers take turns
+} JsonFrozenSlot;
 
 // Decode
 JsonValue* json_decode(const char* _json);
 
+// Decode exactly _len bytes, no '\0' terminator needed
+JsonValue* json_decode_n(const char* _json, size_t _len);
+
+// Same as json_decode_n, the caller guarantees _len + JSON_PADDING readable
+// bytes (of any value) so the scanners can work a word at a time
+JsonValue* json_decode_padded(const char* _json, size_t _len);
+
+// Two stage decoder: a SIMD pass indexes every structural character, then
+// the tree is built from the index. Produces the same tree as json_decode_n.
+JsonValue* json_decode_indexed(const char* _json, size_t _len);
+
+// Decode into a document, the root must not be passed to json_free
+JsonDocument* json_decode_document(const char* _json);
+
+// Same as json_decode_document but strings point into _json. The closing
+// quote of every string is overwritten with '\0', so _json is modified and
+// must outlive the document.
+JsonDocument* json_decode_insitu(char* _json);
+
+// Map the file read only and decode it, the document owns the mapping.
+// Strings are not copied: each JsonString points into the mapping and is
+// NOT '\0' terminated, read it with the _n getters. The file pages stay
+// shared in the page cache. Returns NULL when the file can't be read or is
+// empty.
+JsonDocument* json_decode_file(const char* _path);
+
+// Decode a large root array on _threads workers (0 for one per core) cut
+// at top level commas. Same tree as json_decode_document, any other root or
+// an input that doesn't decode cleanly in parts goes through the serial path.
+JsonDocument* json_decode_parallel(const char* _json, size_t _len, size_t _threads);
+
+// Records of a newline delimited (NDJSON) input, in input order. Lines that
+// don't parse are JSON_ERROR values pointing into the input, blank lines
+// are skipped. The records are owned by the batch, free it with
+// json_free_batch and never json_free a record.
+typedef struct {
+  JsonValue** records;
+  size_t length;
+  JsonArena* arenas; // One per worker
+  size_t arenaCount;
+} JsonBatch;
+
+// Decode NDJSON on _threads workers (0 for one per core), each with its own
+// arena. Returns NULL when out of memory.
+JsonBatch* json_decode_ndjson(const char* _json, size_t _len, size_t _threads);
+
+// Same split, each record is passed to the callback in input order with its
+// index and is only valid during the call. The callback runs on the calling
+// thread while the workers decode the next window of lines. Memory stays
+// bounded: two windows per worker, their arenas reused from one window to
+// the next. Returns 1 when every record was delivered, 0 when out of memory
+// or the callback returned 0.
+typedef char (*JsonRecordCallback)(void* _data, size_t _index, JsonValue* _record);
+char json_decode_ndjsonEach(const char* _json, size_t _len, size_t _threads, JsonRecordCallback _callback, void* _data);
+
+// Freeze a document, the frozen copy owns it and starts with one reference.
+// Retain and release are atomic, the last release frees the document.
+JsonFrozen* json_freeze(JsonDocument* _doc);
+const JsonValue* json_frozen_root(const JsonFrozen* _frozen);
+JsonFrozen* json_frozen_retain(JsonFrozen* _frozen);
+void json_frozen_release(JsonFrozen* _frozen);
+
+// The slot takes over the reference it is given. json_slot_acquire returns
+// the current version retained (NULL when empty), release it when done.
+// json_slot_publish swaps in the next version (or NULL) and releases the
+// previous one once no reader can still be picking it up; readers holding
+// it keep it alive until their own release.
+void json_slot_init(JsonFrozenSlot* _slot, JsonFrozen* _frozen);
+JsonFrozen* json_slot_acquire(JsonFrozenSlot* _slot);
+void json_slot_publish(JsonFrozenSlot* _slot, JsonFrozen* _frozen);
+
+// Push parser, feed the document in chunks of any size. json_parser_feed
+// returns 0 once the input is known to be invalid. json_parser_finish
+// returns the value (or JSON_ERROR) to be passed to json_free, the parser
+// is then ready for the next document.
+JsonParser* json_parser_new(void);
+char json_parser_feed(JsonParser* _p, const char* _chunk, size_t _len);
+JsonValue* json_parser_finish(JsonParser* _p);
+void json_parser_free(JsonParser* _p);
+
+// Decode a whole document into the parser, meant for one parser per thread.
+// The tree belongs to the parser (never json_free it) and stays valid until
+// json_parser_reset, which drops it but keeps the arena block, scratch stack
+// and object index tables. A loop of decode and reset on similar documents
+// stops calling malloc once warmed up.
+JsonValue* json_parser_decode(JsonParser* _p, const char* _json, size_t _len);
+void json_parser_reset(JsonParser* _p);
+
 // Free
 void json_free(JsonValue* _data);
+void json_free_document(JsonDocument* _doc);
+void json_free_batch(JsonBatch* _batch);
 
 // Error
 JsonError json_get_errorMsg(JsonValue* _e);
@@ -120,16 +306,37 @@ JsonError json_get_errorMsg(JsonValue* _e);
 // Get
 const JsonValue* json_get(const JsonValue* _v, const char* _path);
 
+// The string getters return '\0' terminated text, or NULL for a string of a
+// json_decode_file document, which is not terminated. The _n getters return
+// any string and set _len (0 when missing).
 const char* json_get_string(const JsonValue* _v, const char* _path);
+const char* json_get_string_n(const JsonValue* _v, const char* _path, size_t* _len);
 double json_get_number(const JsonValue* _v, const char* _path);
+// 0 when the number is missing, not integral or out of range
+int64_t json_get_int64(const JsonValue* _v, const char* _path);
+uint64_t json_get_uint64(const JsonValue* _v, const char* _path);
 char json_get_bool(const JsonValue* _v, const char* _path);
 char json_get_null(const JsonValue* _v, const char* _path);
 
+// Compiled path, parse "{a}.{1}.0" once and reuse it from any thread.
+// Returns NULL for an invalid path or when out of memory.
+JsonPath* json_path_compile(const char* _path);
+void json_path_free(JsonPath* _path);
+const JsonValue* json_get_compiled(const JsonValue* _v, const JsonPath* _path);
+
+const char* json_get_compiled_string(const JsonValue* _v, const JsonPath* _path);
+const char* json_get_compiled_string_n(const JsonValue* _v, const JsonPath* _path, size_t* _len);
+double json_get_compiled_number(const JsonValue* _v, const JsonPath* _path);
+char json_get_compiled_bool(const JsonValue* _v, const JsonPath* _path);
+char json_get_compiled_null(const JsonValue* _v, const JsonPath* _path);
+
 // Object
 const JsonObject* json_get_object(const JsonValue* _v, const char* _path);
 const char* json_get_object_string(const JsonObject* _obj, const char* _attributeName);
-const char* json_get_object_string(const JsonObject* _obj, const char* _attributeName);
+const char* json_get_object_string_n(const JsonObject* _obj, const char* _attributeName, size_t* _len);
 double json_get_object_number(const JsonObject* _obj, const char* _attributeName);
+int64_t json_get_object_int64(const JsonObject* _obj, const char* _attributeName);
+uint64_t json_get_object_uint64(const JsonObject* _obj, const char* _attributeName);
 char json_get_object_bool(const JsonObject* _obj, const char* _attributeName);
 char json_get_object_null(const JsonObject* _obj, const char* _attributeName);
 const JsonArray* json_get_object_array(const JsonObject* _obj, const char* _attributeName);
@@ -138,13 +345,61 @@ const JsonObject* json_get_object_object(const JsonObject* _obj, const char* _at
 // Array
 const JsonArray* json_get_array(const JsonValue* _v, const char* _path);
 const char* json_get_array_string(const JsonArray* _arr, size_t _itemIndex);
+const char* json_get_array_string_n(const JsonArray* _arr, size_t _itemIndex, size_t* _len);
 double json_get_array_number(const JsonArray* _arr, size_t _itemIndex);
+int64_t json_get_array_int64(const JsonArray* _arr, size_t _itemIndex);
+uint64_t json_get_array_uint64(const JsonArray* _arr, size_t _itemIndex);
 char json_get_array_bool(const JsonArray* _arr, size_t _itemIndex);
 char json_get_array_null(const JsonArray* _arr, size_t _itemIndex);
 const JsonArray* json_get_array_array(const JsonArray* _arr, size_t _itemIndex);
 const JsonObject* json_get_array_object(const JsonArray* _arr, size_t itemIndex);
 
+// On demand, read one value from the JSON text without decoding the rest.
+// Siblings on the way are skipped without validation, nothing is allocated.
+double json_peek_number(const char* _json, size_t _len, const char* _path);
+char json_peek_bool(const char* _json, size_t _len, const char* _path);
+char json_peek_null(const char* _json, size_t _len, const char* _path);
+// Raw bytes of the string (escapes kept, not terminated), NULL if missing
+const char* json_peek_string(const char* _json, size_t _len, const char* _path, size_t* _strLen);
+
 // Encode
 char* json_encode(JsonValue* _value);
+// Bytes json_encode would produce, without the NUL
+size_t json_encoded_length(const JsonValue* _value);
+// Encode into _buffer without allocating. Returns the encoded length like
+// snprintf, the output is complete and NUL terminated only if it is < _capacity.
+size_t json_encode_into(const JsonValue* _value, char* _buffer, size_t _capacity);
+
+// Streaming encode, output goes out in pieces of at most JSON_ENCODE_BUFFER
+// bytes (or one large string) so the whole text is never held in memory.
+// The sink gets each piece in order and returns 0 to stop. All return 1 when
+// every byte was written.
+typedef char (*JsonSink)(void* _data, const char* _bytes, size_t _len);
+char json_encode_sink(const JsonValue* _value, JsonSink _sink, void* _data);
+char json_encode_file(const JsonValue* _value, FILE* _file);
+char json_encode_fd(const JsonValue* _value, int _fd);
+
+// Snapshot: a binary image of the tree laid out like the nodes in memory,
+// with the object tables already built. json_snapshot_open maps it and the
+// result is read with the usual accessors, freed with json_free_document.
+// Processes opening the same file at its preferred address share the pages
+// and do no work per node, elsewhere the image is copied on write and
+// relocated. Returns NULL for a file written by an incompatible build (word
+// size or byte order) or that doesn't check out. Only open images from a
+// trusted writer, the shared mapping is used without checks.
+char json_snapshot_write(const JsonValue* _value, int _fd);
+JsonDocument* json_snapshot_open(const char* _path);
+
+// MessagePack and CBOR, the same trees as JSON text. The encoders return a
+// malloc'd buffer and its length in _len, NULL when out of memory. Decoding
+// works like json_decode_n: the input must be exactly one value (of any
+// type), failures give a JSON_ERROR value. Binary strings, extension types
+// and keys that aren't strings have no JSON form and fail the decode.
+char* json_encode_msgpack(const JsonValue* _value, size_t* _len);
+char* json_encode_cbor(const JsonValue* _value, size_t* _len);
+JsonValue* json_decode_msgpack(const char* _data, size_t _len);
+JsonValue* json_decode_cbor(const char* _data, size_t _len);
+JsonDocument* json_decode_msgpackDocument(const char* _data, size_t _len);
+JsonDocument* json_decode_cborDocument(const char* _data, size_t _len);
 
 #endif /* __SLIM_JSON_H__ */
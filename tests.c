@@ -1,5 +1,9 @@
 #include "slim_json.h"
 #include "stdio.h"
+#include "string.h"
+#include <locale.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define DEBUG 0
 char test_1() {
@@ -143,6 +147,1071 @@ char test_7() {
   return r;
 }
 
+char test_8() {
+  char json[] = "{\"a\":{\"1\":[{\"b\":[3,[4],{\"a\":1}]}]},\"b\":[2,{\"str\":\"aaa\",\"q\":true,\"rrr\":null}]}";
+  JsonDocument* doc = json_decode_document(json);
+  char r = doc != NULL && doc->root->type == JSON_OBJECT;
+
+  r = r && json_get_number(doc->root, "{a}.{1}.0.{b}.2.{a}") == 1;
+  r = r && json_get_bool(doc->root, "{b}.1.{q}") == 1;
+  r = r && json_get_null(doc->root, "{b}.1.{rrr}") == 0;
+  r = r && json_get_string(doc->root, "{b}.1.{str}")[2] == 'a';
+
+  char* encoded = json_encode(doc->root);
+  r = r && encoded[0] == '{';
+  free(encoded);
+
+  json_free_document(doc);
+
+  char bad[] = "  {\"a\":[1,2,z]}";
+  doc = json_decode_document(bad);
+  r = r && doc->root->type == JSON_ERROR;
+  json_free_document(doc);
+
+  return r;
+}
+
+char test_9() {
+  char json[] = "[1.5,-20,true,false,null,\"x\"]";
+  JsonValue* v = json_decode(json);
+  char r = 1;
+
+  const JsonValue* n = json_get(v, "0");
+  r = r && n->type == JSON_NUMBER && n->number == 1.5;
+  r = r && json_get(v, "1")->flags == JSON_INT64 && json_get(v, "1")->integer == -20;
+  r = r && json_get(v, "2")->boolean == 1;
+  r = r && json_get(v, "3")->boolean == 0;
+  r = r && json_get(v, "4")->type == JSON_NULL;
+  r = r && json_get_array_null(json_get_array(v, NULL), 4) == 0;
+  r = r && json_get_string(v, "5")[0] == 'x';
+
+  json_free(v);
+
+  return r;
+}
+
+char test_10() {
+  char json[] = "{\"name\":\"slim\",\"list\":[\"a\\\"b\",\"\"],\"n\":3}";
+  JsonDocument* doc = json_decode_insitu(json);
+  char r = doc != NULL && doc->root->type == JSON_OBJECT;
+
+  const char* name = json_get_string(doc->root, "{name}");
+  r = r && name >= json && name < json + sizeof(json);
+  r = r && name[0] == 's' && name[4] == '\0';
+  r = r && json_get_string(doc->root, "{list}.0")[2] == '"';
+  r = r && json_get_string(doc->root, "{list}.1")[0] == '\0';
+  r = r && json_get_number(doc->root, "{n}") == 3;
+
+  json_free_document(doc);
+
+  return r;
+}
+
+char test_11() {
+  const char json[] = "{\"a\" :  [1, 2.5,\n\t\t\"x\\\"y\"],\n        \"b\":{\"c\":true}}";
+  size_t len = sizeof(json) - 1;
+  char r = 1;
+
+  // Not terminated
+  char* buf = malloc(len);
+  for (size_t i = 0; i < len; i++) {
+    buf[i] = json[i];
+  }
+  JsonValue* v = json_decode_n(buf, len);
+  r = r && v->type == JSON_OBJECT;
+  r = r && json_get_number(v, "{a}.1") == 2.5;
+  r = r && json_get_string(v, "{a}.2")[1] == '\\';
+  r = r && json_get_bool(v, "{b}.{c}") == 1;
+  json_free(v);
+
+  // Cut in the middle of a value
+  v = json_decode_n(buf, 20);
+  r = r && v->type == JSON_ERROR;
+  json_free(v);
+  free(buf);
+
+  // Padding bytes must never be read as input
+  buf = malloc(len + JSON_PADDING);
+  for (size_t i = 0; i < len + JSON_PADDING; i++) {
+    buf[i] = i < len ? json[i] : '"';
+  }
+  v = json_decode_padded(buf, len);
+  r = r && v->type == JSON_OBJECT;
+  r = r && json_get_string(v, "{a}.2")[3] == 'y';
+  json_free(v);
+
+  v = json_decode_padded(buf, 17);
+  r = r && v->type == JSON_ERROR;
+  json_free(v);
+  free(buf);
+
+  return r;
+}
+
+char test_12() {
+  const char path[] = "/tmp/slim_json_test_12.json";
+  FILE* f = fopen(path, "wb");
+  if (f == NULL) {
+    return 0;
+  }
+  fputs("{\n  \"name\": \"file\",\n  \"values\": [1, 2, 3]\n}", f);
+  fclose(f);
+
+  JsonDocument* doc = json_decode_file(path);
+  char r = doc != NULL && doc->root->type == JSON_OBJECT;
+
+  // Strings point into the read only mapping, ending at the closing quote,
+  // so only the _n getters return them
+  size_t len = 0;
+  const char* name = json_get_string_n(doc->root, "{name}", &len);
+  r = r && name != NULL && len == 4 && memcmp(name, "file", 4) == 0 && name[4] == '"';
+  r = r && json_get_string(doc->root, "{name}") == NULL;
+  r = r && json_get_object_string(json_get_object(doc->root, NULL), "{name}") == NULL;
+  name = json_get_object_string_n(json_get_object(doc->root, NULL), "name", &len);
+  r = r && name != NULL && len == 4;
+  r = r && json_get_array_string_n(json_get_array(doc->root, "{values}"), 0, &len) == NULL && len == 0;
+
+  JsonPath* compiled = json_path_compile("{name}");
+  r = r && json_get_compiled_string(doc->root, compiled) == NULL;
+  name = json_get_compiled_string_n(doc->root, compiled, &len);
+  r = r && name != NULL && len == 4;
+  json_path_free(compiled);
+  char* text = json_encode(doc->root);
+  r = r && text != NULL && strcmp(text, "{\"name\":\"file\",\"values\":[1,2,3]}") == 0;
+  free(text);
+  r = r && json_get_number(doc->root, "{values}.2") == 3;
+  json_free_document(doc);
+  remove(path);
+
+  r = r && json_decode_file(path) == NULL;
+
+  return r;
+}
+
+char test_13() {
+  char r = 1;
+
+  // Escaped backslash right before the closing quote
+  char json[] = "[\"a\\\\\",\"b\\\"\\\\\\\"c\",1]";
+  JsonValue* v = json_decode(json);
+  r = r && v->type == JSON_ARRAY;
+  r = r && json_get_string(v, "0")[2] == '\\' && json_get_string(v, "0")[3] == '\0';
+  r = r && json_get_string(v, "1")[7] == 'c';
+  r = r && json_get_number(v, "2") == 1;
+  json_free(v);
+
+  // Whitespace runs and strings longer than a SIMD block
+  char big[600];
+  size_t n = 0;
+  big[n++] = '[';
+  for (size_t i = 0; i < 70; i++) {
+    big[n++] = i % 3 ? ' ' : '\n';
+  }
+  big[n++] = '"';
+  for (size_t i = 0; i < 100; i++) {
+    big[n++] = i == 64 ? '\\' : 'x';
+  }
+  big[n++] = '"';
+  for (size_t i = 0; i < 40; i++) {
+    big[n++] = '\t';
+  }
+  big[n++] = ']';
+  big[n] = '\0';
+  v = json_decode(big);
+  r = r && v->type == JSON_ARRAY;
+  const JsonArray* a = json_get_array(v, NULL);
+  r = r && a->length == 1 && ((JsonString*)a->items[0].data)->length == 100;
+  json_free(v);
+
+  return r;
+}
+
+char test_14() {
+  const char* docs[] = {
+    "{\"a\":{\"1\":[{\"b\":[3,[4],{\"a\":1}]}]},\"b\":[2,{\"str\":\"aaa\",\"q\":true,\"rrr\":null}]}",
+    "  [ 1 , -2.5 , \"x\\\\\" , \"}{][:,\" , true , false , null , [ ] , { } ]  ",
+    "{\"padding to push the escape over the 64 byte block boundary...\\\"\":\"\\\\\",\"k\":[\"v\\\"\"]}",
+    "[1,[2,[3,[4,[5,[6]]]]],{\"a\":{\"b\":{\"c\":\"d\"}}}]",
+  };
+  char r = 1;
+
+  for (size_t i = 0; i < sizeof(docs) / sizeof(docs[0]); i++) {
+    size_t len = 0;
+    while (docs[i][len] != '\0') {
+      len++;
+    }
+
+    JsonValue* a = json_decode_n(docs[i], len);
+    JsonValue* b = json_decode_indexed(docs[i], len);
+    r = r && a->type != JSON_ERROR && b->type == a->type;
+    if (r) {
+      char* ea = json_encode(a);
+      char* eb = json_encode(b);
+      size_t j = 0;
+      while (ea[j] != '\0' && ea[j] == eb[j]) {
+	j++;
+      }
+      r = r && ea[j] == eb[j];
+      free(ea);
+      free(eb);
+    }
+    json_free(a);
+    json_free(b);
+  }
+
+  const char* bad[] = { "[1,2", "{\"a\" 1}", "[tru]", "[1 2]", "{\"a\":1", "[\"abc]" };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+    size_t len = 0;
+    while (bad[i][len] != '\0') {
+      len++;
+    }
+
+    JsonValue* b = json_decode_indexed(bad[i], len);
+    r = r && b->type == JSON_ERROR;
+    json_free(b);
+  }
+
+  return r;
+}
+
+char test_15() {
+  const char json[] = " {\"k\\\\\":0,\"a\":[1.25, true,null ,\"x\\\"y\"], \"bb\" : {\"c\":false, \"d\":[]},\"e\":-7} ";
+  size_t len = sizeof(json) - 1;
+  char r = 1;
+
+  JsonValue* ref = json_decode_n(json, len);
+  char* expected = json_encode(ref);
+  json_free(ref);
+
+  JsonParser* p = json_parser_new();
+  for (size_t chunk = 1; chunk <= 9; chunk += 4) {
+    for (size_t i = 0; i < len; i += chunk) {
+      r = r && json_parser_feed(p, json + i, i + chunk < len ? chunk : len - i);
+    }
+
+    JsonValue* v = json_parser_finish(p);
+    r = r && v->type == JSON_OBJECT;
+    r = r && json_get_number(v, "{e}") == -7;
+    r = r && json_get_string(v, "{a}.3")[2] == '"';
+
+    char* encoded = json_encode(v);
+    size_t j = 0;
+    while (expected[j] != '\0' && expected[j] == encoded[j]) {
+      j++;
+    }
+    r = r && expected[j] == encoded[j];
+    free(encoded);
+    json_free(v);
+  }
+
+  // Invalid and truncated input
+  r = r && json_parser_feed(p, "[1,", 3) == 1;
+  r = r && json_parser_feed(p, "x]", 2) == 0;
+  JsonValue* v = json_parser_finish(p);
+  r = r && v->type == JSON_ERROR;
+  json_free(v);
+
+  r = r && json_parser_feed(p, "{\"a\":\"abc", 9) == 1;
+  v = json_parser_finish(p);
+  r = r && v->type == JSON_ERROR;
+  json_free(v);
+
+  json_parser_free(p);
+  free(expected);
+
+  return r;
+}
+
+char test_16() {
+  const char json[] = "{\"skip\":{\"x\":[1,{\"y\":\"}]\\\"\"}],\"z\":\"{\"}, \"a\" : [ 10, [11], {\"b\":2.5, \"c\":\"str\", \"d\":true, \"e\":null} ]}";
+  size_t len = sizeof(json) - 1;
+  char r = 1;
+
+  r = r && json_peek_number(json, len, "{a}.0") == 10;
+  r = r && json_peek_number(json, len, "{a}.1.0") == 11;
+  r = r && json_peek_number(json, len, "{a}.2.{b}") == 2.5;
+  r = r && json_peek_bool(json, len, "{a}.2.{d}") == 1;
+  r = r && json_peek_null(json, len, "{a}.2.{e}") == 0;
+  r = r && json_peek_null(json, len, "{a}.2.{d}") == -1;
+
+  size_t n = 0;
+  const char* str = json_peek_string(json, len, "{a}.2.{c}", &n);
+  r = r && str != NULL && n == 3 && str[0] == 's';
+
+  double missing = json_peek_number(json, len, "{a}.3");
+  r = r && missing != missing;
+  r = r && json_peek_string(json, len, "{q}", &n) == NULL;
+  r = r && json_peek_bool(json, len, "{skip}") == -1;
+
+  return r;
+}
+
+char test_17() {
+  char json[] = "{\"a\":{\"1\":[{\"b\":[3,[4],{\"a\":1}]}]},\"b\":[2,{\"str\":\"aaa\",\"q\":true,\"rrr\":null}]}";
+  JsonValue* v = json_decode(json);
+  char r = 1;
+
+  JsonPath* p1 = json_path_compile("{a}.{1}.0.{b}.2.{a}");
+  JsonPath* p2 = json_path_compile("{b}.1.{str}");
+  JsonPath* p3 = json_path_compile("{b}.1.{q}");
+  JsonPath* p4 = json_path_compile("{b}.1.{rrr}");
+  JsonPath* p5 = json_path_compile("{b}.7");
+  r = r && p1 && p2 && p3 && p4 && p5;
+
+  for (int i = 0; r && i < 3; i++) {
+    r = r && json_get_compiled_number(v, p1) == 1;
+    r = r && json_get_compiled_string(v, p2)[0] == 'a';
+    r = r && json_get_compiled_bool(v, p3) == 1;
+    r = r && json_get_compiled_null(v, p4) == 0;
+    r = r && json_get_compiled(v, p5) == NULL;
+    r = r && json_get_compiled(v, p2) == json_get(v, "{b}.1.{str}");
+  }
+
+  r = r && json_path_compile("{a}.x") == NULL;
+  r = r && json_path_compile("{a}..0") == NULL;
+
+  json_path_free(p1);
+  json_path_free(p2);
+  json_path_free(p3);
+  json_path_free(p4);
+  json_path_free(p5);
+  json_free(v);
+
+  return r;
+}
+
+char test_18() {
+  // Long keys sharing a 100 byte prefix and a 100 byte suffix
+  static char json[300000];
+  char* p = json;
+  *p++ = '{';
+  for (int i = 0; i < 1000; i++) {
+    p += sprintf(p, "%s\"%0100d%04d%0100d\":%d", i ? "," : "", 0, i, 0, i);
+  }
+  p += sprintf(p, ",\"0\":1,\"0\":2}");
+
+  JsonValue* v = json_decode(json);
+  char r = v->type == JSON_OBJECT;
+
+  char path[256];
+  for (int i = 0; r && i < 1000; i++) {
+    sprintf(path, "{%0100d%04d%0100d}", 0, i, 0);
+    r = json_get_number(v, path) == i;
+  }
+
+  sprintf(path, "{%0100d%04d%0100d}", 0, 1000, 0);
+  r = r && json_get(v, path) == NULL;
+
+  // Duplicate keys resolve to the first one
+  r = r && json_get_number(v, "{0}") == 1;
+  r = r && json_get(v, "{1}") == NULL;
+
+  json_free(v);
+
+  return r;
+}
+
+char test_19() {
+  char json[] = "{\"a\":1,\"b\":{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8},\"ab\":2}";
+  JsonDocument* doc = json_decode_document(json);
+  JsonObject* root = doc->root->data;
+  JsonObject* big = json_get(doc->root, "{b}")->data;
+  char r = 1;
+
+  // Nothing is hashed until it is needed
+  r = r && root->index == NULL && big->index == NULL;
+  r = r && json_get_number(doc->root, "{ab}") == 2;
+  r = r && json_get(doc->root, "{aa}") == NULL;
+  r = r && root->index == NULL;
+
+  r = r && big->index == NULL;
+  r = r && json_get_number(doc->root, "{b}.{k8}") == 8;
+  r = r && big->index != NULL;
+  JsonObjectIndex* index = big->index;
+  r = r && json_get_number(doc->root, "{b}.{k0}") == 0;
+  r = r && json_get(doc->root, "{b}.{k9}") == NULL;
+  r = r && big->index == index;
+
+  json_free_document(doc);
+
+  JsonValue* v = json_decode(json);
+  r = r && json_get_number(v, "{b}.{k3}") == 3;
+  json_free(v);
+
+  return r;
+}
+
+char test_20() {
+  char json[] = "{\"a\":[1,\"x\",[true,null],{}],\"b\":{\"c\":[],\"d\":2},\"e\":\"f\"}";
+  size_t len = sizeof(json) - 1;
+  JsonValue* values[4];
+  JsonDocument* doc = json_decode_document(json);
+  JsonParser* p = json_parser_new();
+  values[0] = json_decode(json);
+  values[1] = json_decode_indexed(json, len);
+  values[2] = doc->root;
+  for (size_t i = 0; i < len; i += 5) {
+    json_parser_feed(p, json + i, len - i < 5 ? len - i : 5);
+  }
+  values[3] = json_parser_finish(p);
+  char r = 1;
+
+  for (int i = 0; i < 4; i++) {
+    const JsonObject* obj = values[i]->data;
+    r = r && values[i]->type == JSON_OBJECT && obj->length == 3;
+    r = r && obj->attributes[0].name.length == 1 && obj->attributes[0].name.value[0] == 'a';
+    r = r && obj->attributes[2].value.type == JSON_STRING;
+
+    const JsonArray* arr = obj->attributes[0].value.data;
+    r = r && arr->length == 4;
+    r = r && arr->items[0].type == JSON_NUMBER && arr->items[0].integer == 1;
+    r = r && arr->items[1].type == JSON_STRING && arr->items[3].type == JSON_OBJECT;
+
+    const JsonArray* inner = arr->items[2].data;
+    r = r && inner->length == 2 && inner->items[0].boolean == 1 && inner->items[1].type == JSON_NULL;
+    r = r && json_get(values[i], "{a}.2.1") == &inner->items[1];
+
+    const JsonObject* b = obj->attributes[1].value.data;
+    r = r && ((JsonArray*)b->attributes[0].value.data)->length == 0;
+    r = r && ((JsonObject*)arr->items[3].data)->length == 0;
+    r = r && json_get_number(values[i], "{b}.{d}") == 2;
+  }
+
+  json_free(values[0]);
+  json_free(values[1]);
+  json_free(values[3]);
+  json_free_document(doc);
+  json_parser_free(p);
+
+  return r;
+}
+
+char test_21() {
+  // Deep nesting encodes in one pass and round trips
+  size_t depth = 2000;
+  char* json = malloc(depth * 16 + 1);
+  char* p = json;
+  for (size_t i = 0; i < depth; i++) {
+    p += sprintf(p, "{\"a\":[");
+  }
+  p += sprintf(p, "1.5,\"x\",true,null");
+  for (size_t i = 0; i < depth; i++) {
+    p += sprintf(p, "]}");
+  }
+
+  JsonValue* v = json_decode(json);
+  char* encoded = json_encode(v);
+  char r = encoded != NULL && strcmp(encoded, json) == 0;
+  free(encoded);
+  json_free(v);
+
+  v = json_decode("[-12,0.25,{},[],\"\"]");
+  encoded = json_encode(v);
+  r = r && strcmp(encoded, "[-12,0.25,{},[],\"\"]") == 0;
+  free(encoded);
+  json_free(v);
+
+  free(json);
+
+  return r;
+}
+
+char test_22() {
+  char json[] = "{\"a\":[1,2.5,\"xy\"],\"b\":{\"c\":null,\"d\":false}}";
+  JsonValue* v = json_decode(json);
+  size_t len = json_encoded_length(v);
+  char r = len == sizeof(json) - 1;
+
+  char buf[128];
+  memset(buf, '#', sizeof(buf));
+  r = r && json_encode_into(v, buf, sizeof(buf)) == len && strcmp(buf, json) == 0;
+
+  // Exact fit needs room for the NUL, nothing past the capacity is touched
+  memset(buf, '#', sizeof(buf));
+  r = r && json_encode_into(v, buf, len) == len && buf[len] == '#';
+  r = r && json_encode_into(v, buf, len + 1) == len && strcmp(buf, json) == 0;
+
+  memset(buf, '#', sizeof(buf));
+  r = r && json_encode_into(v, buf, 10) == len && buf[10] == '#';
+  r = r && json_encode_into(v, NULL, 0) == len;
+
+  json_free(v);
+
+  return r;
+}
+
+char test_23() {
+  double numbers[] = {0.1, -2.5, 100, 1e21, 1e-7, 0.000025, 5e-324, 1.7976931348623157e308, 123456789012345678.0, -0.0, 0.0 / 0.0};
+  const char* expected = "[0.1,-2.5,100,1e21,1e-7,0.000025,5e-324,1.7976931348623157e308,123456789012345680,-0,null]";
+  size_t n = sizeof(numbers) / sizeof(numbers[0]);
+
+  JsonValue items[sizeof(numbers) / sizeof(numbers[0])];
+  for (size_t i = 0; i < n; i++) {
+    items[i].type = JSON_NUMBER;
+    items[i].flags = 0;
+    items[i].number = numbers[i];
+  }
+  JsonArray arr = {items, n};
+  JsonValue v;
+  v.type = JSON_ARRAY;
+  v.data = &arr;
+
+  char buf[256];
+  char r = json_encode_into(&v, buf, sizeof(buf)) < sizeof(buf) && strcmp(buf, expected) == 0;
+
+  // Shortest digits read back to the same double
+  for (size_t i = 0; r && i < 8; i++) {
+    char* end;
+    json_encode_into(&items[i], buf, sizeof(buf));
+    r = strtod(buf, &end) == numbers[i] && *end == '\0';
+  }
+
+  // Values Grisu2 wrote with a digit too many, and ones Grisu3 cannot decide
+  double hard[] = {65294498705027987.0, 0x1p-1017, 0x1p172, 1e23, 8.41e21};
+  const char* shortest[] = {"65294498705027980", "7.120236347223045e-307", "5.986310706507379e51", "1e23", "8.41e21"};
+  for (size_t i = 0; r && i < sizeof(hard) / sizeof(hard[0]); i++) {
+    items[0].number = hard[i];
+    json_encode_into(&items[0], buf, sizeof(buf));
+    r = strcmp(buf, shortest[i]) == 0;
+  }
+
+  return r;
+}
+
+char test_24() {
+  char json[] = "[1e10,-2.5E-3,0.1,79.754412,1.7976931348623157e308,5e-324,4.9406564584124654e-324,123456789012345678901234567890,0.30000000000000004,-0,1e400,2e-400]";
+  double expected[] = {1e10, -2.5e-3, 0.1, 79.754412, 1.7976931348623157e308, 5e-324, 5e-324, 1.2345678901234568e29, 0.30000000000000004, -0.0, 1.0 / 0.0, 0};
+  JsonValue* v = json_decode(json);
+  char r = v->type == JSON_ARRAY;
+
+  for (size_t i = 0; r && i < sizeof(expected) / sizeof(expected[0]); i++) {
+    double d = json_get_array_number(v->data, i);
+    r = memcmp(&d, &expected[i], sizeof(d)) == 0;
+  }
+
+  // Decode and encode round trip bit for bit
+  char* encoded = json_encode(v);
+  JsonValue* v2 = json_decode(encoded);
+  for (size_t i = 0; r && i < 10; i++) {
+    double a = json_get_array_number(v->data, i);
+    double b = json_get_array_number(v2->data, i);
+    r = memcmp(&a, &b, sizeof(a)) == 0;
+  }
+  free(encoded);
+  json_free(v2);
+  json_free(v);
+
+  // Strict grammar
+  const char* invalid[] = {"[01]", "[1.]", "[.5]", "[-]", "[1e]", "[1e+]", "[+1]", "[1.e5]", "[0x10]"};
+  for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+    v = json_decode(invalid[i]);
+    r = r && v->type == JSON_ERROR;
+    json_free(v);
+  }
+
+  return r;
+}
+
+char test_25() {
+  char json[] = "{\"id\":9007199254740993,\"max\":9223372036854775807,\"min\":-9223372036854775808,\"u\":18446744073709551615,\"over\":18446744073709551616,\"low\":-9223372036854775809,\"f\":2.0,\"e\":1e3,\"x\":1.5,\"z\":0,\"nz\":-0}";
+  JsonValue* v = json_decode(json);
+  const JsonObject* o = json_get_object(v, NULL);
+  char r = v->type == JSON_OBJECT;
+
+  r = r && json_get(v, "{id}")->flags == JSON_INT64 && json_get_int64(v, "{id}") == 9007199254740993LL;
+  r = r && json_get_object_int64(o, "max") == INT64_MAX;
+  r = r && json_get_object_int64(o, "min") == INT64_MIN;
+  r = r && json_get(v, "{u}")->flags == JSON_UINT64 && json_get_uint64(v, "{u}") == UINT64_MAX;
+  r = r && json_get_object_int64(o, "u") == 0;
+  r = r && json_get(v, "{over}")->flags == 0 && json_get_number(v, "{over}") == 18446744073709551616.0;
+  r = r && json_get(v, "{low}")->flags == 0;
+  r = r && json_get(v, "{f}")->flags == 0 && json_get_int64(v, "{f}") == 2;
+  r = r && json_get_uint64(v, "{e}") == 1000;
+  r = r && json_get_int64(v, "{x}") == 0;
+  r = r && json_get_int64(v, "{z}") == 0 && json_get(v, "{z}")->flags == JSON_INT64;
+  r = r && json_get(v, "{nz}")->flags == 0;
+  r = r && json_get_number(v, "{max}") == 9223372036854775807.0;
+  r = r && json_get_uint64(v, "{min}") == 0;
+
+  // Integers encode digit for digit
+  char* encoded = json_encode(v);
+  r = r && strcmp(encoded, "{\"id\":9007199254740993,\"max\":9223372036854775807,\"min\":-9223372036854775808,\"u\":18446744073709551615,\"over\":18446744073709552000,\"low\":-9223372036854776000,\"f\":2,\"e\":1000,\"x\":1.5,\"z\":0,\"nz\":-0}") == 0;
+  free(encoded);
+
+  json_free(v);
+
+  v = json_decode("[1,-2,3]");
+  const JsonArray* a = json_get_array(v, NULL);
+  r = r && json_get_array_int64(a, 1) == -2 && json_get_array_uint64(a, 2) == 3 && json_get_array_uint64(a, 1) == 0;
+  json_free(v);
+
+  return r;
+}
+
+typedef struct {
+  char* value;
+  size_t length;
+  size_t calls;
+  size_t limit; // Refuse after this many calls
+} TestSink;
+
+static char test_sink(void* _data, const char* _bytes, size_t _len) {
+  TestSink* sink = (TestSink*)_data;
+  if (sink->calls++ == sink->limit) {
+    return 0;
+  }
+  memcpy(sink->value + sink->length, _bytes, _len);
+  sink->length += _len;
+  return 1;
+}
+
+static char test_readBack(FILE* _file, const char* _expected, size_t _len) {
+  char* back = malloc(_len + 1);
+  rewind(_file);
+  size_t n = fread(back, 1, _len + 1, _file);
+  char r = n == _len && memcmp(back, _expected, _len) == 0;
+  free(back);
+  return r;
+}
+
+char test_26() {
+  // Many small values around one string larger than the buffer
+  size_t big = JSON_ENCODE_BUFFER * 2 + 17;
+  size_t cap = big + 400000;
+  char* json = malloc(cap);
+  size_t len = 0;
+  len += sprintf(json + len, "{\"head\":[");
+  for (int i = 0; i < 20000; i++) {
+    len += sprintf(json + len, "%s%d", i ? "," : "", i * 7);
+  }
+  len += sprintf(json + len, "],\"big\":\"");
+  memset(json + len, 'x', big);
+  len += big;
+  len += sprintf(json + len, "\",\"tail\":[1.5,true,null]}");
+
+  JsonValue* v = json_decode(json);
+  char* expected = json_encode(v);
+  size_t n = strlen(expected);
+  char r = v->type == JSON_OBJECT && n == len;
+
+  TestSink sink = { malloc(n), 0, 0, (size_t)-1 };
+  r = r && json_encode_sink(v, test_sink, &sink) == 1;
+  r = r && sink.length == n && memcmp(sink.value, expected, n) == 0 && sink.calls > 2;
+
+  // A refusing sink stops the encode
+  sink.length = 0;
+  sink.calls = 0;
+  sink.limit = 1;
+  r = r && json_encode_sink(v, test_sink, &sink) == 0 && sink.calls == 2;
+  free(sink.value);
+
+  FILE* file = tmpfile();
+  r = r && file != NULL && json_encode_file(v, file) == 1 && test_readBack(file, expected, n);
+  fclose(file);
+
+  file = tmpfile();
+  r = r && file != NULL && json_encode_fd(v, fileno(file)) == 1 && test_readBack(file, expected, n);
+  fclose(file);
+
+  r = r && json_encode_fd(v, -1) == 0 && json_encode_sink(NULL, test_sink, &sink) == 0;
+
+  free(expected);
+  free(json);
+  json_free(v);
+  return r;
+}
+
+typedef struct {
+  size_t next;
+  size_t stopAt;
+  char r;
+} TestLines;
+
+// Record _index must be {"i":_index,...}
+static char test_lines(void* _data, size_t _index, JsonValue* _record) {
+  TestLines* lines = (TestLines*)_data;
+  lines->r = lines->r && _index == lines->next++ && json_get_int64(_record, "{i}") == (int64_t)_index;
+  return _index + 1 != lines->stopAt;
+}
+
+char test_27() {
+  const char small[] = "{\"a\":1}\n\n[2,3]\r\n  \n{\"a\":}\n{\"b\":\"x\"}";
+  char r = 1;
+
+  for (size_t threads = 1; threads <= 4; threads += 3) {
+    JsonBatch* b = json_decode_ndjson(small, sizeof(small) - 1, threads);
+    r = r && b != NULL && b->length == 4;
+    r = r && json_get_int64(b->records[0], "{a}") == 1;
+    r = r && json_get_int64(b->records[1], "1") == 3;
+    r = r && b->records[2]->type == JSON_ERROR;
+    r = r && strcmp(json_get_string(b->records[3], "{b}"), "x") == 0;
+    json_free_batch(b);
+  }
+
+  // Several windows of records on several workers
+  size_t count = 100000;
+  char* json = malloc(count * 120);
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++) {
+    len += sprintf(json + len, "{\"i\":%zu,\"name\":\"record %zu\",\"tags\":[1,2,3],\"ok\":true,\"e\":0,\"f\":0,\"g\":0,\"h\":0}\n", i, i);
+  }
+
+  JsonBatch* b = json_decode_ndjson(json, len, 4);
+  r = r && b != NULL && b->length == count && b->arenaCount > 1;
+  for (size_t i = 0; r && i < count; i++) {
+    r = json_get_int64(b->records[i], "{i}") == (int64_t)i;
+  }
+  json_free_batch(b);
+
+  TestLines lines = { 0, 0, 1 };
+  r = r && json_decode_ndjsonEach(json, len, 3, test_lines, &lines) == 1;
+  r = r && lines.r && lines.next == count;
+
+  // Stopping early
+  lines.next = 0;
+  lines.stopAt = 70000;
+  r = r && json_decode_ndjsonEach(json, len, 2, test_lines, &lines) == 0;
+  r = r && lines.r && lines.next == 70000;
+
+  // No lines at all
+  lines.next = 0;
+  lines.stopAt = 0;
+  r = r && json_decode_ndjsonEach(json, 0, 2, test_lines, &lines) == 1 && lines.next == 0;
+
+  free(json);
+  return r;
+}
+
+// Same tree (or same error) as the serial document decoder
+static char test_parallelSame(const char* _json, size_t _len, size_t _threads) {
+  JsonDocument* serial = json_decode_document(_json);
+  JsonDocument* parallel = json_decode_parallel(_json, _len, _threads);
+  char r = serial != NULL && parallel != NULL && serial->root->type == parallel->root->type;
+
+  if (r && serial->root->type == JSON_ERROR) {
+    r = strcmp(json_get_errorMsg(serial->root).msg, json_get_errorMsg(parallel->root).msg) == 0;
+  }
+  else if (r) {
+    char* a = json_encode(serial->root);
+    char* b = json_encode(parallel->root);
+    r = strcmp(a, b) == 0;
+    free(a);
+    free(b);
+  }
+
+  json_free_document(serial);
+  json_free_document(parallel);
+  return r;
+}
+
+char test_28() {
+  size_t count = 20000;
+  char* json = malloc(count * 140 + 64);
+  size_t len = 0;
+  len += sprintf(json + len, " [");
+  for (size_t i = 0; i < count; i++) {
+    // Commas, brackets and escaped quotes inside strings must not split
+    len += sprintf(json + len, "%s{\"i\":%zu,\"s\":\"a,]\\\"[,\",\"v\":[%zu.5,{\"x\":null}],\"d\":0,\"e\":0,\"f\":0,\"g\":0,\"h\":0}", i ? ", " : "", i, i);
+  }
+  len += sprintf(json + len, "]\n");
+
+  char r = test_parallelSame(json, len, 4) && test_parallelSame(json, len, 3);
+
+  JsonDocument* doc = json_decode_parallel(json, len, 4);
+  const JsonArray* arr = json_get_array(doc->root, NULL);
+  r = r && arr != NULL && arr->length == count;
+  r = r && json_get_int64(&arr->items[count - 1], "{i}") == (int64_t)count - 1;
+  r = r && strcmp(json_get_string(&arr->items[7], "{s}"), "a,]\\\"[,") == 0;
+  json_free_document(doc);
+
+  // Errors and endings the parts can't vouch for are decoded serially
+  char* at = strstr(json + len / 2, ", {");
+  at[1] = ':';
+  r = r && test_parallelSame(json, len, 4);
+  at[1] = ' ';
+
+  json[len - 2] = ',';
+  json[len - 1] = ']';
+  r = r && test_parallelSame(json, len, 4);
+
+  json[len - 2] = ']';
+  json[len - 1] = ']';
+  r = r && test_parallelSame(json, len, 4);
+
+  // Not an array
+  json[1] = '{';
+  r = r && test_parallelSame(json, len, 4);
+
+  r = r && test_parallelSame("[1,2,3]", 7, 4);
+
+  free(json);
+  return r;
+}
+
+static JsonFrozen* test_version(int _version) {
+  char json[256];
+  sprintf(json, "{\"version\":%d,\"copy\":%d,\"a\":0,\"b\":0,\"c\":0,\"d\":0,\"e\":0,\"f\":0,\"routes\":[\"r%d\"]}", _version, _version, _version);
+  return json_freeze(json_decode_document(json));
+}
+
+typedef struct {
+  JsonFrozenSlot* slot;
+  int* done;
+  char r;
+} TestReader;
+
+// Every snapshot is consistent and versions never go back
+static void* test_reader(void* _data) {
+  TestReader* reader = (TestReader*)_data;
+  int64_t seen = 0;
+
+  while (__atomic_load_n(reader->done, __ATOMIC_ACQUIRE) == 0) {
+    JsonFrozen* f = json_slot_acquire(reader->slot);
+    const JsonValue* root = json_frozen_root(f);
+    int64_t version = json_get_int64(root, "{version}");
+    reader->r = reader->r && version >= seen && json_get_int64(root, "{copy}") == version;
+    seen = version;
+    json_frozen_release(f);
+  }
+  return NULL;
+}
+
+char test_29() {
+  JsonFrozen* f = test_version(1);
+  const JsonObject* obj = json_get_object(json_frozen_root(f), NULL);
+  char r = f != NULL && obj->index != NULL && f->references == 1;
+
+  r = r && json_frozen_retain(f) == f && f->references == 2;
+  json_frozen_release(f);
+
+  JsonFrozenSlot slot;
+  json_slot_init(&slot, f);
+  JsonFrozen* held = json_slot_acquire(&slot);
+  r = r && held == f && f->references == 2;
+
+  // The reader keeps version 1 alive after it is replaced
+  json_slot_publish(&slot, test_version(2));
+  r = r && f->references == 1 && json_get_int64(json_frozen_root(held), "{version}") == 1;
+  json_frozen_release(held);
+
+  int done = 0;
+  TestReader readers[4];
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    readers[i].slot = &slot;
+    readers[i].done = &done;
+    readers[i].r = 1;
+    pthread_create(&threads[i], NULL, test_reader, &readers[i]);
+  }
+
+  for (int v = 3; v < 300; v++) {
+    json_slot_publish(&slot, test_version(v));
+  }
+  __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+
+  for (int i = 0; i < 4; i++) {
+    pthread_join(threads[i], NULL);
+    r = r && readers[i].r;
+  }
+
+  held = json_slot_acquire(&slot);
+  r = r && strcmp(json_get_string(json_frozen_root(held), "{routes}.0"), "r299") == 0;
+  json_frozen_release(held);
+
+  json_slot_publish(&slot, NULL);
+  r = r && json_slot_acquire(&slot) == NULL;
+  return r;
+}
+
+char test_30() {
+  char json[] = "{\"id\":7,\"user\":{\"a\":1,\"b\":2,\"c\":3,\"d\":4,\"e\":5,\"f\":6,\"g\":7,\"name\":\"x\"},\"tags\":[\"p\",\"q\"]}";
+  size_t len = sizeof(json) - 1;
+  JsonParser* p = json_parser_new();
+  char r = 1;
+
+  JsonValue* v = json_parser_decode(p, json, len);
+  r = r && v->type == JSON_OBJECT && strcmp(json_get_string(v, "{user}.{name}"), "x") == 0;
+  const JsonObjectIndex* index = json_get_object(v, "{user}")->index;
+  JsonArenaBlock* block = p->arena.first;
+  r = r && index != NULL;
+
+  // After a reset the same block and index table are used again
+  for (int i = 0; r && i < 3; i++) {
+    json_parser_reset(p);
+    v = json_parser_decode(p, json, len);
+    r = r && json_get_int64(v, "{user}.{g}") == 7 && json_get_object(v, "{user}")->index == index;
+    r = r && p->arena.first == block && block->next == NULL;
+  }
+
+  // Several documents can live until the next reset
+  JsonValue* bad = json_parser_decode(p, "[1,", 3);
+  JsonValue* other = json_parser_decode(p, "[1,2]", 5);
+  r = r && bad->type == JSON_ERROR && strstr(json_get_errorMsg(bad).msg, "offset") != NULL;
+  r = r && json_get_int64(other, "1") == 2 && json_get_int64(v, "{id}") == 7;
+
+  // A push parse in progress is not disturbed
+  r = r && json_parser_feed(p, "{\"k\":[1,", 8);
+  other = json_parser_decode(p, "[3]", 3);
+  r = r && json_parser_feed(p, "2]}", 3) && json_get_int64(other, "0") == 3;
+  JsonValue* pushed = json_parser_finish(p);
+  r = r && json_get_int64(pushed, "{k}.1") == 2;
+  json_free(pushed);
+
+  json_parser_free(p);
+  return r;
+}
+
+char test_31() {
+  char json[1024] = "{\"name\":\"snap\\u0000shot\",\"big\":18446744073709551615,\"neg\":-42,\"pi\":3.25,"
+    "\"list\":[true,false,null,[],{}],\"wide\":{";
+  for (int i = 0; i < 12; i++) {
+    sprintf(json + strlen(json), "%s\"k%d\":%d", i ? "," : "", i, i * 3);
+  }
+  strcat(json, "}}");
+
+  JsonDocument* src = json_decode_document(json);
+  char* expected = json_encode(src->root);
+
+  char path[] = "/tmp/slim_json_XXXXXX";
+  int fd = mkstemp(path);
+  char r = fd >= 0 && json_snapshot_write(src->root, fd) == 1;
+  json_free_document(src);
+
+  // The second open can't have the preferred address and relocates
+  JsonDocument* a = json_snapshot_open(path);
+  JsonDocument* b = json_snapshot_open(path);
+  r = r && a != NULL && b != NULL && a->buffer != b->buffer;
+  for (int i = 0; r && i < 2; i++) {
+    JsonDocument* doc = i ? b : a;
+    char* encoded = json_encode(doc->root);
+    const JsonObject* wide = json_get_object(doc->root, "{wide}");
+    r = r && strcmp(encoded, expected) == 0 && wide->index != NULL;
+    r = r && json_get_object_int64(wide, "k11") == 33 && json_get_object(doc->root, "{nope}") == NULL;
+    // The tables use the image's own key, compiled paths still find keys
+    JsonPath* path = json_path_compile("{wide}.{k5}");
+    r = r && json_get_compiled_number(doc->root, path) == 15;
+    json_path_free(path);
+    r = r && json_get_uint64(doc->root, "{big}") == 18446744073709551615ULL && json_get_int64(doc->root, "{neg}") == -42;
+    free(encoded);
+  }
+  json_free_document(a);
+  json_free_document(b);
+
+  // Truncated or foreign files are refused
+  r = r && ftruncate(fd, 100) == 0 && json_snapshot_open(path) == NULL;
+  r = r && lseek(fd, 0, SEEK_SET) == 0 && write(fd, "SLIMJSN0", 8) == 8 && json_snapshot_open(path) == NULL;
+  r = r && json_snapshot_open("/nonexistent/snapshot") == NULL;
+
+  JsonValue* err = json_decode("[1,");
+  r = r && json_snapshot_write(err, fd) == 0;
+  json_free(err);
+
+  close(fd);
+  unlink(path);
+  free(expected);
+  return r;
+}
+
+char test_32() {
+  // {"a":[1,-2,1.5,"é\n"],"b":null}
+  JsonValue* v = json_decode("{\"a\":[1,-2,1.5,\"\\u00e9\\n\"],\"b\":null}");
+  const unsigned char msgpack[] = { 0x82, 0xa1, 'a', 0x94, 0x01, 0xfe, 0xca, 0x3f, 0xc0, 0x00, 0x00, 0xa3, 0xc3, 0xa9, '\n', 0xa1, 'b', 0xc0 };
+  const unsigned char cbor[] = { 0xa2, 0x61, 'a', 0x84, 0x01, 0x21, 0xfa, 0x3f, 0xc0, 0x00, 0x00, 0x63, 0xc3, 0xa9, '\n', 0x61, 'b', 0xf6 };
+
+  size_t len = 0;
+  char* m = json_encode_msgpack(v, &len);
+  char r = len == sizeof(msgpack) && memcmp(m, msgpack, len) == 0;
+  char* c = json_encode_cbor(v, &len);
+  r = r && len == sizeof(cbor) && memcmp(c, cbor, len) == 0;
+
+  // Strings come back escaped, the tree prints as JSON again
+  JsonValue* fromMsgpack = json_decode_msgpack(m, sizeof(msgpack));
+  JsonDocument* fromCbor = json_decode_cborDocument(c, sizeof(cbor));
+  char* text = json_encode(fromMsgpack);
+  r = r && strcmp(text, "{\"a\":[1,-2,1.5,\"\xc3\xa9\\n\"],\"b\":null}") == 0;
+  r = r && json_get_int64(fromCbor->root, "{a}.1") == -2 && json_get(fromCbor->root, "{b}")->type == JSON_NULL;
+  free(text);
+  json_free(fromMsgpack);
+  json_free_document(fromCbor);
+  free(m);
+  free(c);
+  json_free(v);
+
+  // Large integers keep their kind, CBOR indefinite lengths and half floats
+  v = json_decode_msgpack("\xcf\xff\xff\xff\xff\xff\xff\xff\xff", 9);
+  r = r && v->type == JSON_NUMBER && v->flags == JSON_UINT64 && v->uinteger == UINT64_MAX;
+  json_free(v);
+  v = json_decode_cbor("\xbf\x61\x61\x9f\xf9\x3e\x00\xff\x7f\x61\x62\x61\x63\xff\xf5\xff", 16);
+  r = r && json_get_number(v, "{a}.0") == 1.5 && json_get_bool(v, "{bc}") == 1;
+  json_free(v);
+
+  // Truncated input, trailing bytes, binary strings and integer keys fail
+  const char* bad[] = { "\x92\x01", "\x01\x02", "\xc4\x01\x00", "\x81\x01\x02" };
+  const size_t badLen[] = { 2, 2, 3, 3 };
+  for (int i = 0; i < 4; i++) {
+    v = json_decode_msgpack(bad[i], badLen[i]);
+    r = r && v->type == JSON_ERROR;
+    json_free(v);
+    v = json_decode_cbor(bad[i], badLen[i]);
+    r = r && v->type == JSON_ERROR;
+    json_free(v);
+  }
+
+  return r;
+}
+
+char test_33() {
+  // Indexed objects return the first of duplicate keys, like the scan
+  char r = 1;
+  char json[1024];
+  for (int n = 0; n < 2000 && r; n++) {
+    int len = sprintf(json, "{\"k\":1,\"k\":2");
+    for (int i = 0; i < 20; i++) {
+      len += sprintf(json + len, ",\"x%d_%d\":%d", n, i, i);
+    }
+    strcpy(json + len, "}");
+
+    JsonValue* v = json_decode(json);
+    r = json_get_number(v, "{k}") == 1;
+    json_free(v);
+  }
+  return r;
+}
+
+char test_34() {
+  // Cases Eisel-Lemire hands to the exact decimal path
+  const char* texts[] = {"9007199254740993", "9007199254740993.0000000000000000001", "2.2250738585072011e-308", "2.4703282292062327e-324", "2.4703282292062328e-324", "1.7976931348623158e308", "1.7976931348623159e308", "0.1000000000000000055511151231257827021181583404541015625"};
+  double expected[] = {0x1p53, 0x1.0000000000001p53, 0x0.fffffffffffffp-1022, 0.0, 0x0.0000000000001p-1022, 0x1.fffffffffffffp1023, 1.0 / 0.0, 0x1.999999999999ap-4};
+  char json[1200];
+  char r = 1;
+
+  for (int pass = 0; pass < 2; pass++) {
+    // The conversion must not follow a locale with a decimal comma
+    if (pass == 1 && setlocale(LC_NUMERIC, "de_DE.UTF-8") == NULL) {
+      break;
+    }
+    for (size_t i = 0; r && i < sizeof(expected) / sizeof(expected[0]); i++) {
+      sprintf(json, "[%s]", texts[i]);
+      JsonValue* v = json_decode(json);
+      double d = json_get_array_number(v->data, 0);
+      r = memcmp(&d, &expected[i], sizeof(d)) == 0;
+      json_free(v);
+    }
+  }
+  setlocale(LC_NUMERIC, "C");
+
+  // More digits than the decimal buffer holds, the last one breaks the tie
+  memset(json, '0', sizeof(json));
+  memcpy(json, "[9007199254740993.", 18);
+  strcpy(json + 1000, "1]");
+  JsonValue* v = json_decode(json);
+  double d = json_get_array_number(v->data, 0);
+  r = r && d == 0x1.0000000000001p53;
+  json_free(v);
+
+  return r;
+}
+
 int main()
 {
   printf("test_1: %d\n", test_1());
@@ -152,6 +1221,33 @@ int main()
   printf("test_5: %d\n", test_5());
   printf("test_6: %d\n", test_6());
   printf("test_7: %d\n", test_7());
+  printf("test_8: %d\n", test_8());
+  printf("test_9: %d\n", test_9());
+  printf("test_10: %d\n", test_10());
+  printf("test_11: %d\n", test_11());
+  printf("test_12: %d\n", test_12());
+  printf("test_13: %d\n", test_13());
+  printf("test_14: %d\n", test_14());
+  printf("test_15: %d\n", test_15());
+  printf("test_16: %d\n", test_16());
+  printf("test_17: %d\n", test_17());
+  printf("test_18: %d\n", test_18());
+  printf("test_19: %d\n", test_19());
+  printf("test_20: %d\n", test_20());
+  printf("test_21: %d\n", test_21());
+  printf("test_22: %d\n", test_22());
+  printf("test_23: %d\n", test_23());
+  printf("test_24: %d\n", test_24());
+  printf("test_25: %d\n", test_25());
+  printf("test_26: %d\n", test_26());
+  printf("test_27: %d\n", test_27());
+  printf("test_28: %d\n", test_28());
+  printf("test_29: %d\n", test_29());
+  printf("test_30: %d\n", test_30());
+  printf("test_31: %d\n", test_31());
+  printf("test_32: %d\n", test_32());
+  printf("test_33: %d\n", test_33());
+  printf("test_34: %d\n", test_34());
 
   return 0;
 }